@@ -0,0 +1,180 @@
+/*
+    boardtable.h = Precomputed table of all TicTacToe boards
+    Author = Vikram, CS19B021
+    Purpose = A board is packed into an index = sum of cell(r,c) * 3^(3r+c), where a cell is 0 (unfilled), 1 ('X')
+              or 2 ('O'). There are only 3^9 = 19683 indices, so the status of every board, its unfilled cells and
+              its "Game Status" text are computed at compile time and a move costs one table lookup. The table also
+              holds the perfect play (by minimax) for every board, which is what the server's bot plays.
+*/
+#ifndef BOARDTABLE_H
+#define BOARDTABLE_H
+#include <bits/stdc++.h>
+#define NBOARDS 19683                                                   // num of board indices = 3^9
+#define BOARDTEXTLEN 48                                                 // size of the "Game Status" text of a board (with the NUL)
+
+// powers of 3. placing player p's symbol at cell k adds p * pow3[k] to the index
+constexpr int pow3[10] = {1,3,9,27,81,243,729,2187,6561,19683};
+
+// cells of the lines of the board. rows first, then columns and then the diagonals, like the checks of the old makemove()
+constexpr int boardlines[8][3] = {{0,1,2},{3,4,5},{6,7,8},{0,3,6},{1,4,7},{2,5,8},{0,4,8},{2,4,6}};
+
+// structure to represent the precomputed data of one board
+struct BOARDINFO {
+    uint8_t status;                                                     // 0 -> not over, 1 -> 'X' won, 2 -> 'O' won, 3 -> draw
+    uint16_t unfilled;                                                  // bit k is set iff cell k is unfilled
+    uint8_t turn;                                                       // player to move next (1 or 2)
+};
+
+// structure to represent the table of all boards. the text, the perfect play and the rest of the data of the
+// boards are kept in separate tables since compile time evaluation has a limit on the work done for one table
+struct BOARDTABLE {
+    BOARDINFO info[NBOARDS];
+};
+
+// function to decode the index idx into the cells of its board
+constexpr void decodeboard(int idx, int cell[9]) {
+    for(int k=0;k<9;++k) {
+        cell[k] = idx % 3; idx /= 3;
+    }
+}
+
+// function to compute the table. status follows the order of the checks of the old makemove(): rows first,
+// then columns, then the two diagonals and finally the check for unfilled cells
+constexpr BOARDTABLE makeboardtable() {
+    BOARDTABLE t{};
+    for(int idx=0;idx<NBOARDS;++idx) {
+        int cell[9] = {};
+        int count[3] = {};
+        decodeboard(idx,cell);
+        for(int k=0;k<9;++k)
+            ++count[cell[k]];
+        // line win checks
+        int status = 0;
+        for(int l=0;l<8 && status == 0;++l) {
+            const int* line = boardlines[l];
+            if(cell[line[0]] != 0 && cell[line[0]] == cell[line[1]] && cell[line[1]] == cell[line[2]])
+                status = cell[line[0]];
+        }
+        uint16_t unfilled = 0;
+        for(int k=0;k<9;++k) {
+            if(cell[k] == 0)
+                unfilled |= 1 << k;
+        }
+        if(status == 0 && unfilled == 0)
+            status = 3;
+        t.info[idx].status = status;
+        t.info[idx].unfilled = unfilled;
+        t.info[idx].turn = (count[1] > count[2]) ? 2 : 1;
+    }
+    return t;
+}
+
+constexpr BOARDTABLE boardtable = makeboardtable();
+
+// structure to represent the "Game Status" text of all boards
+struct BOARDTEXT {
+    char text[NBOARDS][BOARDTEXTLEN];
+};
+
+// function to compute the text of all boards
+constexpr BOARDTEXT makeboardtext() {
+    BOARDTEXT t{};
+    const char sym[3] = {'_','X','O'};
+    const char head[] = "Game Status:-\n";
+    for(int idx=0;idx<NBOARDS;++idx) {
+        int cell[9] = {};
+        decodeboard(idx,cell);
+        // text in human-friendly form, "Game Status:-\n" and then rows like "X | _ | O \n"
+        int pos = 0;
+        for(int i=0;head[i] != '\0';++i)
+            t.text[idx][pos++] = head[i];
+        for(int k=0;k<9;++k) {
+            t.text[idx][pos++] = sym[cell[k]];
+            t.text[idx][pos++] = ' ';
+            if(k % 3 != 2) {
+                t.text[idx][pos++] = '|'; t.text[idx][pos++] = ' ';
+            }
+            else {
+                t.text[idx][pos++] = '\n';
+            }
+        }
+        t.text[idx][pos] = '\0';
+    }
+    return t;
+}
+
+constexpr BOARDTEXT boardtext = makeboardtext();
+
+// structure to represent the perfect play on one board
+struct PLAYINFO {
+    int8_t score;                                                       // minimax score. > 0 -> 'X' wins with perfect play, < 0 -> 'O' wins, 0 -> draw
+    uint16_t best;                                                      // bit k is set iff placing the symbol of turn at cell k is a best move
+};
+
+// structure to represent the perfect play on all boards
+struct PLAYTABLE {
+    PLAYINFO info[NBOARDS];
+};
+
+// function to compute the perfect play on all boards by minimax
+constexpr PLAYTABLE makeplaytable() {
+    PLAYTABLE t{};
+    // minimax. a move adds to the index, so the boards after a move are done before the board itself.
+    // wins score 1 + num of unfilled cells so that faster wins (and slower losses) are preferred
+    for(int idx=NBOARDS-1;idx>=0;--idx) {
+        const BOARDINFO& info = boardtable.info[idx];
+        PLAYINFO& play = t.info[idx];
+        int empty = 0;
+        for(int k=0;k<9;++k)
+            empty += (info.unfilled >> k) & 1;
+        if(info.status != 0) {
+            play.score = (info.status == 3) ? 0 : (info.status == 1 ? 1 + empty : -1 - empty);
+            continue;
+        }
+        int best = (info.turn == 1) ? -100 : 100;
+        for(int k=0;k<9;++k) {
+            if(!((info.unfilled >> k) & 1))
+                continue;
+            int score = t.info[idx + info.turn * pow3[k]].score;
+            if(score == best)
+                play.best |= 1 << k;
+            else if((info.turn == 1) ? score > best : score < best) {
+                best = score; play.best = 1 << k;
+            }
+        }
+        play.score = best;
+    }
+    return t;
+}
+
+constexpr PLAYTABLE playtable = makeplaytable();
+
+// function to try placing the symbol of player p (1 -> 'X', 2 -> 'O') at the position (r,c) in the game board
+// if (r,c) is not valid, -1 is returned.
+// else if (r,c) is already filled, -2 is returned.
+// otherwise, the move is made and the game over check is looked up in boardtable.
+// if game is over, 1 is returned if 'X' won, 2 is returned if 'O' won and 3 is returned for a draw.
+// if game is not over, 0 is returned.
+inline int makemove(uint16_t* board, int p, int r, int c) {
+
+    // valid indices check
+    if(!(r>=0 && r<=2 && c>=0 && c<=2))
+        return -1;
+    // unfilled position check
+    int cell = 3*r + c;
+    if(!(boardtable.info[*board].unfilled & (1 << cell)))
+        return -2;
+    // now, we place the symbol at (r,c) and look up the status of the new board
+    *board += p * pow3[cell];
+    return boardtable.info[*board].status;
+}
+
+// a few spot checks of the table at compile time
+static_assert(boardtable.info[0].status == 0 && boardtable.info[0].unfilled == 0x1FF, "empty board");
+static_assert(boardtable.info[1 + 3 + 9].status == 1, "'X' in the first row");
+static_assert(boardtable.info[2*1 + 2*27 + 2*729].status == 2, "'O' in the first column");
+static_assert(playtable.info[0].score == 0 && boardtable.info[2*pow3[4]].turn == 1, "perfect play draws");
+static_assert(playtable.info[1 + 3 + 2*pow3[4]].best == (1 << 2), "'O' must block the first row");
+static_assert(boardtext.text[NBOARDS-1][14] == 'O' && boardtext.text[0][BOARDTEXTLEN-1] == '\0', "text");
+
+#endif
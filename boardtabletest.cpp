@@ -0,0 +1,93 @@
+/*
+    boardtabletest.cpp = Test of the board table of the TicTacToe server (see boardtable.h) against the old board code
+    Author = Vikram, CS19B021
+    Compilation CMD = g++ boardtabletest.cpp -o boardtabletest --std=c++17 -O2
+    Usage = ./boardtabletest
+    Purpose = The char array makemove() and gamestring() that the server used before boardtable.h are kept below as the
+              reference. For every one of the 3^9 boards, both players and every (r,c) in [-1,3]^2, the table driven
+              makemove() must return what the old one returns and leave the same board, and the text of the board
+              in the table must be the old gamestring(). Mismatches are printed and the exit status is 1 if any.
+*/
+#include <bits/stdc++.h>
+#include "boardtable.h"
+#define nloop3(i,j) for(int i=0;i<3;++i) for(int j=0;j<3;++j)
+using namespace std;
+
+// the old gamestring(): the game array as a string in human-friendly form
+string oldgamestring(char array[3][3]) {
+    string res("Game Status:-\n");
+    nloop3(a,b) {
+        res += array[a][b];
+        res += " ";
+        if(b != 2)
+            res += "| ";
+        else
+            res += "\n";
+    }
+    return res;
+}
+
+// the old makemove(): -1 -> (r,c) is not valid, -2 -> (r,c) is filled, 1 or 2 -> 'X' or 'O' won, 3 -> draw, 0 -> not over
+int oldmakemove(char array[3][3], char sym, int r, int c) {
+    if(!(r>=0 && r<=2 && c>=0 && c<=2))
+        return -1;
+    if(array[r][c] != '_')
+        return -2;
+    array[r][c] = sym;
+    for(int a=0;a<3;++a)
+        if(array[a][0] != '_' && array[a][0] == array[a][1] && array[a][1] == array[a][2])
+            return array[a][0] == 'X' ? 1 : 2;
+    for(int a=0;a<3;++a)
+        if(array[0][a] != '_' && array[0][a] == array[1][a] && array[1][a] == array[2][a])
+            return array[0][a] == 'X' ? 1 : 2;
+    if(array[0][0] != '_' && array[0][0] == array[1][1] && array[1][1] == array[2][2])
+        return array[0][0] == 'X' ? 1 : 2;
+    if(array[0][2] != '_' && array[0][2] == array[1][1] && array[1][1] == array[2][0])
+        return array[0][2] == 'X' ? 1 : 2;
+    nloop3(a,b) {
+        if(array[a][b] == '_')
+            return 0;
+    }
+    return 3;
+}
+
+// function to fill array with the board of index idx
+void toarray(int idx, char array[3][3]) {
+    const char sym[3] = {'_','X','O'};
+    int cell[9];
+    decodeboard(idx,cell);
+    nloop3(a,b) {
+        array[a][b] = sym[cell[3*a + b]];
+    }
+}
+
+int main() {
+    long long cases = 0, mismatches = 0;
+    for(int idx=0;idx<NBOARDS;++idx) {
+        char array[3][3];
+        toarray(idx,array);
+        if(oldgamestring(array) != boardtext.text[idx]) {
+            ++mismatches;
+            printf("board %d: text differs\n",idx);
+        }
+        for(int p=1;p<=2;++p) {
+            for(int r=-1;r<=3;++r) {
+                for(int c=-1;c<=3;++c) {
+                    char old[3][3];
+                    toarray(idx,old);
+                    uint16_t board = idx;
+                    int want = oldmakemove(old,p == 1 ? 'X' : 'O',r,c);
+                    int got = makemove(&board,p,r,c);
+                    toarray(board,array);
+                    ++cases;
+                    if(got != want || memcmp(array,old,sizeof old) != 0 || oldgamestring(old) != boardtext.text[board]) {
+                        ++mismatches;
+                        printf("board %d, player %d, (%d,%d): old makemove() = %d, table makemove() = %d\n",idx,p,r,c,want,got);
+                    }
+                }
+            }
+        }
+    }
+    printf("%lld cases, %lld mismatches\n",cases,mismatches);
+    return mismatches == 0 ? 0 : 1;
+}
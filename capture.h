@@ -0,0 +1,166 @@
+/*
+    capture.h = Capture of the traffic of the clients of the TicTacToe server, for replaying it (see replay.cpp)
+    Author = Vikram, CS19B021
+    Purpose = With a capture file open, the server notes every connection it accepts, every chunk of bytes it recvs
+              from a client and every connection the client closes, with the time the server saw it. Only what the
+              clients send is kept. The server's answers are made again by the server that the capture is replayed
+              against. Every record also holds the num of prompts (T_PROMPT msgs) the client had been sent when the
+              chunk came in, so a replay can hold a chunk back till the new server has asked for it. A multiplexed
+              connection is recorded a frame at a time, with the num of prompts sent for the frame's game. Records are
+              added to a buffer under a lock and the buffer is appended to the file once it holds CAPBATCH bytes and
+              when the server exits.
+    Layout = The file starts with a CAPFILEHDR. Each record is then the varints conn id, (len << 2) | kind, time
+             since the previous record (in us) and prompts, followed by len bytes of data (CK_DATA only). Conn ids
+             start from 1 and are never reused within a file.
+*/
+#ifndef CAPTURE_H
+#define CAPTURE_H
+#include <bits/stdc++.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "gamestore.h"
+#define CAPMAGIC 0x50414354                                             // first field of a capture file
+#define CAPVERSION 1                                                    // version of the capture format
+#define CAPBATCH (1 << 16)                                              // num of buffered bytes after which they are written
+#define CAPMAXHDR 40                                                    // max size of the varints of a record
+
+// kinds of records. CK_OPEN -> the server accepted the connection; CK_DATA -> bytes recved from the client;
+// CK_CLOSE -> the client closed the connection (or it broke)
+enum CAPKIND { CK_OPEN, CK_DATA, CK_CLOSE };
+
+// structure to represent the header of a capture file
+struct CAPFILEHDR {
+    uint32_t magic, version;
+    int64_t startus;                                                    // wall clock time (in us since the epoch) the capture started at
+};
+
+// structure to represent a record read back from a capture file
+struct CAPEVENT {
+    uint32_t conn;                                                      // id of the connection in its file
+    int kind;                                                           // one of CAPKIND
+    long long us;                                                       // time (in us) since the capture started
+    uint32_t prompts;                                                   // num of prompts sent on the connection before the record
+    std::string data;                                                   // recved bytes (CK_DATA only)
+};
+
+// structure to represent the capture file being written
+struct CAPTURE {
+    std::mutex lock;                                                    // guards the fields below
+    int fd = -1;                                                        // capture file. -1 -> no capture
+    std::string buf;                                                    // records not written yet
+    long long startus;                                                  // time (in us, steady clock) the capture started at
+    long long lastus;                                                   // time (in us since startus) of the last record
+    std::atomic<uint32_t> nextid;                                       // id of the next connection
+};
+
+CAPTURE capture;
+
+// function to get the current time in us from a monotonic clock
+inline long long capnowus() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// function to return true iff the traffic is being captured
+inline bool capturing() {
+    return capture.fd != -1;
+}
+
+// function to write the buffered records to the capture file. capture.lock must be held
+inline void capwrite() {
+    size_t done = 0;
+    while(done < capture.buf.size()) {
+        ssize_t ret = write(capture.fd,capture.buf.data() + done,capture.buf.size() - done);
+        if(ret < 0) {
+            if(errno == EINTR)
+                continue;
+            perror("ERROR - capture write failed.");
+            break;
+        }
+        done += ret;
+    }
+    capture.buf.clear();
+}
+
+// function to write every record added so far to the capture file
+inline void capflush() {
+    if(!capturing())
+        return;
+    std::lock_guard<std::mutex> guard(capture.lock);
+    capwrite();
+}
+
+// function to start capturing into the file at path. the records left in the buffer are written at exit
+inline void capopen(const char* path) {
+    if((capture.fd = open(path,O_WRONLY|O_CREAT|O_TRUNC,0644)) == -1) {
+        perror("ERROR - capture file open failed"); exit(-1);
+    }
+    capture.startus = capnowus();
+    capture.lastus = 0;
+    capture.nextid = 1;
+    CAPFILEHDR hdr = {CAPMAGIC,CAPVERSION,
+                      std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count()};
+    capture.buf.reserve(CAPBATCH + CAPMAXHDR + 4096);
+    capture.buf.append((const char*)&hdr,sizeof hdr);
+    atexit(capflush);
+}
+
+// function to get an id for a new connection. returns 0 (a connection that isn't captured) if there is no capture
+inline uint32_t capnewconn() {
+    return capturing() ? capture.nextid++ : 0;
+}
+
+// function to add a record of the given kind for the connection conn, which has been sent prompts prompts, with the
+// len bytes of data. connections without an id are skipped
+inline void caprecord(uint32_t conn, int kind, uint32_t prompts, const char* data = NULL, int len = 0) {
+    if(conn == 0 || !capturing())
+        return;
+    uint8_t hdr[CAPMAXHDR];
+    std::lock_guard<std::mutex> guard(capture.lock);
+    // the time is taken under the lock, so that the times of the file never go back
+    long long us = capnowus() - capture.startus;
+    int n = putvarint(hdr,conn);
+    n += putvarint(hdr + n,((uint64_t)len << 2) | kind);
+    n += putvarint(hdr + n,std::max(0LL,us - capture.lastus));
+    n += putvarint(hdr + n,prompts);
+    capture.lastus = std::max(us,capture.lastus);
+    capture.buf.append((const char*)hdr,n);
+    if(len > 0)
+        capture.buf.append(data,len);
+    if(capture.buf.size() >= CAPBATCH)
+        capwrite();
+}
+
+// function to read the capture file at path into events, in the order of their times. returns false if the file
+// can't be read or isn't a capture file. a record cut short at the end (by a crash of the server) is left out
+inline bool capload(const char* path, std::vector<CAPEVENT>& events) {
+    std::ifstream in(path,std::ios::binary);
+    if(!in)
+        return false;
+    std::string file((std::istreambuf_iterator<char>(in)),std::istreambuf_iterator<char>());
+    CAPFILEHDR hdr;
+    if(file.size() < sizeof hdr)
+        return false;
+    memcpy(&hdr,file.data(),sizeof hdr);
+    if(hdr.magic != CAPMAGIC || hdr.version != CAPVERSION)
+        return false;
+    const uint8_t* p = (const uint8_t*)file.data() + sizeof hdr;
+    const uint8_t* end = (const uint8_t*)file.data() + file.size();
+    long long us = 0;
+    while(p < end) {
+        uint64_t f[4];
+        int n = 0, got = 1;
+        for(int i=0;i<4 && got != 0;++i) {
+            got = getvarint(p + n,end - p - n,&f[i]);
+            n += got;
+        }
+        uint64_t len = f[1] >> 2;
+        if(got == 0 || (f[1] & 3) > CK_CLOSE || len > (uint64_t)(end - p - n))
+            break;
+        us += f[2];
+        events.push_back({(uint32_t)f[0],(int)(f[1] & 3),us,(uint32_t)f[3],std::string((const char*)p + n,len)});
+        p += n + len;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,133 @@
+/*
+    fanbench.cpp = Benchmark of the fan-out of game updates to spectators (see fanout.h)
+    Author = Vikram, CS19B021
+    Compilation CMD = g++ fanbench.cpp -o fanbench --std=c++17 -O2
+    Usage = ./fanbench [-k MAX SPECTATORS] [-u UPDATES]
+    Purpose = For 1, 10, 100, ... up to k spectators (connected through socketpairs), u game updates are fanned
+              out the way the server does it: encoded once and sent to every spectator from the shared buffer.
+              The same updates are then sent the naive way, with a frame encoded and copied for every spectator.
+              The time per update and per spectator is printed for both. The spectators read everything between
+              two updates, outside of the timed part. At the end, a spectator who never reads is fed updates till
+              the server would drop it, to show how many board snapshots it skipped on the way.
+*/
+#include <bits/stdc++.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include "fanout.h"
+using namespace std;
+
+// function to get the current time in ns from a monotonic clock
+long long nowns() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// function to read everything that has been sent to the spectator end fd
+void drain(int fd) {
+    char buf[4096];
+    while(recv(fd,buf,sizeof buf,MSG_DONTWAIT) > 0);
+}
+
+// function to return the text of update u: a board after every move and some other event every 10th update
+const char* updatetext(int u, bool* board) {
+    static const char* boards[9] = {
+        "Game Status:-\nX | _ | _ \n_ | _ | _ \n_ | _ | _ \n", "Game Status:-\nX | O | _ \n_ | _ | _ \n_ | _ | _ \n",
+        "Game Status:-\nX | O | _ \nX | _ | _ \n_ | _ | _ \n", "Game Status:-\nX | O | _ \nX | O | _ \n_ | _ | _ \n",
+        "Game Status:-\nX | O | _ \nX | O | _ \nX | _ | _ \n", "Game Status:-\n_ | _ | _ \n_ | _ | _ \n_ | _ | _ \n",
+        "Game Status:-\n_ | X | _ \n_ | _ | _ \n_ | _ | _ \n", "Game Status:-\n_ | X | _ \n_ | O | _ \n_ | _ | _ \n",
+        "Game Status:-\n_ | X | X \n_ | O | _ \n_ | _ | _ \n"
+    };
+    *board = (u % 10 != 9);
+    return *board ? boards[u % 9] : "Player 1 has won!!";
+}
+
+int main(int argc, char** argv) {
+    int maxspecs = 5000, updates = 1000;
+    int opt;
+    while((opt = getopt(argc,argv,"k:u:")) != -1) {
+        if(opt == 'k')
+            maxspecs = max(1,atoi(optarg));
+        else if(opt == 'u')
+            updates = max(1,atoi(optarg));
+        else {
+            cout << "Usage: ./fanbench [-k MAX SPECTATORS] [-u UPDATES]" << endl;
+            exit(-1);
+        }
+    }
+    // every spectator needs 2 fds. so, raise the limit on open fds as far as allowed
+    rlimit lim;
+    if(getrlimit(RLIMIT_NOFILE,&lim) == 0) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE,&lim);
+        maxspecs = min<long long>(maxspecs,(lim.rlim_cur - 16) / 2);
+    }
+    vector<int> counts;
+    for(int k=1;k<maxspecs;k*=10)
+        counts.push_back(k);
+    counts.push_back(maxspecs);
+    for(int k : counts) {
+        vector<array<int,2>> fds(k);
+        for(auto& p : fds) {
+            if(socketpair(AF_UNIX,SOCK_STREAM,0,p.data()) == -1) {
+                perror("ERROR - socketpair failed"); exit(-1);
+            }
+        }
+        vector<FANQUEUE> queues(k);
+        // shared buffer: one encoding per update, one sendmsg() per spectator from it
+        long long shared = 0;
+        for(int u=0;u<updates;++u) {
+            bool board;
+            const char* text = updatetext(u,&board);
+            long long start = nowns();
+            FANBUF* b = fanbuf(board,T_PRINT,1,text,strlen(text));
+            for(FANQUEUE& q : queues)
+                fanpush(&q,b);
+            fanrelease(b);
+            for(int i=0;i<k;++i)
+                fanflush(fds[i][0],&queues[i]);
+            shared += nowns() - start;
+            for(auto& p : fds)
+                drain(p[1]);
+        }
+        // naive: a frame is encoded and copied for every spectator
+        long long naive = 0;
+        for(int u=0;u<updates;++u) {
+            bool board;
+            const char* text = updatetext(u,&board);
+            long long start = nowns();
+            for(int i=0;i<k;++i) {
+                int len = strlen(text);
+                string frame(sizeof(FRAMEHDR) + len,'\0');
+                makehdr((FRAMEHDR*)&frame[0],T_PRINT,1,len);
+                memcpy(&frame[sizeof(FRAMEHDR)],text,len);
+                send(fds[i][0],frame.data(),frame.size(),MSG_NOSIGNAL|MSG_DONTWAIT);
+            }
+            naive += nowns() - start;
+            for(auto& p : fds)
+                drain(p[1]);
+        }
+        printf("spectators = %5d: shared %9.1f us/update (%6.0f ns/spectator), naive %9.1f us/update (%6.0f ns/spectator)\n",
+               k,shared / 1e3 / updates,(double)shared / updates / k,naive / 1e3 / updates,(double)naive / updates / k);
+        for(auto& p : fds) {
+            close(p[0]); close(p[1]);
+        }
+    }
+    // a spectator who never reads. its socket fills up, then its queue grows till it is over FANMAXBYTES
+    int p[2];
+    socketpair(AF_UNIX,SOCK_STREAM,0,p);
+    FANQUEUE q;
+    int u = 0;
+    bool ok = true;
+    while(ok) {
+        bool board;
+        const char* text = updatetext(u++,&board);
+        FANBUF* b = fanbuf(board,T_PRINT,1,text,strlen(text));
+        ok = fanpush(&q,b);
+        fanrelease(b);
+        fanflush(p[0],&q);
+    }
+    printf("slow spectator: dropped after %d updates, %lu board snapshots skipped, %zu bytes queued\n",u,
+           (unsigned long)q.skipped,q.bytes - q.off);
+    fanclear(&q);
+    close(p[0]); close(p[1]);
+    return 0;
+}
@@ -0,0 +1,128 @@
+/*
+    fanout.h = Fan-out of game updates to the spectators of a game of the TicTacToe server
+    Author = Vikram, CS19B021
+    Purpose = An update is encoded once, as a whole frame of protocol.h, into a FANBUF: an immutable buffer with a
+              count of the queues that hold it. Every spectator has a FANQUEUE of such buffers and sends straight
+              out of them with one scatter-gather send, so one more spectator costs a pointer and no copy. A game and
+              its spectators belong to one thread, so the count is a plain int. Board frames are snapshots: a board
+              that still waits in a queue is replaced by a newer one, i.e. a slow spectator skips intermediate
+              boards. A queue that holds more than FANMAXBYTES anyway belongs to a spectator who doesn't read at
+              all and its owner disconnects it. Either way, spectators never hold up the players.
+*/
+#ifndef FANOUT_H
+#define FANOUT_H
+#include <bits/stdc++.h>
+#include <sys/socket.h>
+#include "protocol.h"
+#define FANMAXBYTES 65536                                               // max num of unsent bytes of a spectator
+#define FANMAXIOV 64                                                    // max num of buffers sent by one sendmsg()
+
+// structure to represent an encoded update
+struct FANBUF {
+    int refs;                                                           // num of queues holding the buffer
+    bool board;                                                         // true iff the frame is a board snapshot
+    int len;                                                            // num of bytes in data
+    char data[];                                                        // the frame
+};
+
+// structure to represent the updates that are yet to be sent to a spectator
+struct FANQUEUE {
+    std::deque<FANBUF*> bufs;
+    size_t off;                                                         // num of bytes of bufs.front() sent already
+    size_t bytes;                                                       // num of bytes in bufs, including the sent part of the front
+    uint64_t skipped;                                                   // num of board snapshots replaced by newer ones
+};
+
+// function to encode a frame of the given type, game id and payload of len bytes into a new FANBUF
+inline FANBUF* fanbuf(bool board, int type, uint32_t gameid, const char* payload, int len) {
+    FANBUF* b = (FANBUF*)malloc(sizeof(FANBUF) + sizeof(FRAMEHDR) + len);
+    b->refs = 0;
+    b->board = board;
+    b->len = sizeof(FRAMEHDR) + len;
+    FRAMEHDR hdr;
+    makehdr(&hdr,type,gameid,len);
+    memcpy(b->data,&hdr,sizeof hdr);
+    memcpy(b->data + sizeof hdr,payload,len);
+    return b;
+}
+
+// function to let go of b. it is freed once no queue holds it
+inline void fanrelease(FANBUF* b) {
+    if(b->refs == 0)
+        free(b);
+}
+
+// function to take b out of a queue
+inline void fanunref(FANBUF* b) {
+    --b->refs;
+    fanrelease(b);
+}
+
+// function to add b to q. a board snapshot replaces an unsent one at the end of q.
+// returns false iff q holds more than FANMAXBYTES unsent bytes
+inline bool fanpush(FANQUEUE* q, FANBUF* b) {
+    if(b->board && !q->bufs.empty() && q->bufs.back()->board && !(q->bufs.size() == 1 && q->off > 0)) {
+        FANBUF* old = q->bufs.back();
+        q->bufs.pop_back();
+        q->bytes -= old->len;
+        fanunref(old);
+        ++q->skipped;
+    }
+    ++b->refs;
+    q->bufs.push_back(b);
+    q->bytes += b->len;
+    return q->bytes - q->off <= FANMAXBYTES;
+}
+
+// function to send as much of q to fd as the socket takes now without blocking. returns -1 iff the send failed
+inline int fanflush(int fd, FANQUEUE* q) {
+    while(!q->bufs.empty()) {
+        iovec iov[FANMAXIOV];
+        int n = 0;
+        size_t total = 0;
+        for(auto it = q->bufs.begin();it != q->bufs.end() && n < FANMAXIOV;++it,++n) {
+            size_t skip = (n == 0) ? q->off : 0;
+            iov[n] = {(*it)->data + skip,(*it)->len - skip};
+            total += (*it)->len - skip;
+        }
+        msghdr mh;
+        memset(&mh,0,sizeof mh);
+        mh.msg_iov = iov; mh.msg_iovlen = n;
+        ssize_t ret = sendmsg(fd,&mh,MSG_NOSIGNAL|MSG_DONTWAIT);
+        if(ret < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                return 0;
+            if(errno == EINTR)
+                continue;
+            return -1;
+        }
+        // drop the buffers that are sent completely
+        size_t done = ret;
+        while(done > 0) {
+            FANBUF* b = q->bufs.front();
+            size_t left = b->len - q->off;
+            if(done < left) {
+                q->off += done;
+                break;
+            }
+            done -= left;
+            q->off = 0;
+            q->bytes -= b->len;
+            q->bufs.pop_front();
+            fanunref(b);
+        }
+        if((size_t)ret < total)
+            return 0;                                   // the socket is full
+    }
+    return 0;
+}
+
+// function to empty q
+inline void fanclear(FANQUEUE* q) {
+    for(FANBUF* b : q->bufs)
+        fanunref(b);
+    q->bufs.clear();
+    q->off = q->bytes = 0;
+}
+
+#endif
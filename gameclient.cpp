@@ -2,8 +2,17 @@
     gameclient.cpp = Code for Problem 1(TicTacToe) client side
     Author = Vikram, CS19B021
     Compilation CMD = g++ gameclient.cpp -o gameclient --std=c++17
-    Usage = Usage : ./gameclient [SERVER IP ADDRESS] [SERVER PORT NO]
+    Usage = Usage : ./gameclient [SERVER IP ADDRESS] [SERVER PORT NO] [PLAYER NAME] [-c] [-w GAME ID] [-v M,N,K]
     Purpose = Client code for problem 1 
+    Protocol = The client asks for the framed protocol of protocol.h with a T_HELLO frame, whose payload is the
+               player name. The server remembers the rating of a named player across sessions. It still understands
+               the legacy "@i@ data" msgs, which servers send to clients that don't ask for frames. With -c, the
+               client also asks for compact updates (HELLO_COMPACT) and keeps and prints the board itself. With -w, the
+               client watches the live game with the given id (HELLO_WATCH) instead of playing. At any prompt, the
+               player may type /stats for his record or /top for the leaderboard (T_QUERY). The server answers and
+               then asks its question again. With -v, the player asks for a game on an M x N board where K in a
+               row wins (one of the variants of mnkboard.h, e.g. -v 4,4,4 or -v gomoku) and is matched with players
+               who asked for the same board.
 */
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -12,21 +21,141 @@
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <poll.h>
+#include "protocol.h"
+#include "mnkboard.h"
 #define SERVERPORT argv[2]          // server port number
 #define BUFLEN 100                  // size of buffers used for sending and recving data
 #define STDINFD 0                   // fd for stdin
 #define SERVERIPADDR argv[1]        // server ip address
+#define RECVBUFLEN 4096             // size of the buffer for recved but unhandled bytes
+#define USAGE "Usage : ./gameclient [SERVER IP ADDRESS] [SERVER PORT NO] [PLAYER NAME] [-c] [-w GAME ID] [-v M,N,K]"
 using namespace std;
 
 // response to code-0 msg from server. This is to reply that the client is alive
 const char ackbuffer[BUFLEN] = "I_AM_ALIVE";
 
+char recvbuffer[RECVBUFLEN];        // buffer for storing recved data
+int recvlen = 0;                    // num of bytes in recvbuffer
+char board[MNKMAXCELLS];            // board kept by a compact client. 'X', 'O' or '_'
+int rows = 3, cols = 3;             // size of the board
+
+// function to send all len bytes of buf to sockfd, even if send() writes only a part of them
+void sendall(int sockfd, const void* buf, int len) {
+    while(len > 0) {
+        int ret = send(sockfd,buf,len,MSG_NOSIGNAL);
+        if(ret < 0) {
+            if(errno == EINTR)
+                continue;
+            return;
+        }
+        buf = (const char*)buf + ret; len -= ret;
+    }
+}
+
+// function to send a frame with the given type and payload to sockfd using one scatter-gather send
+void sendframe(int sockfd, int type, const char* data, int len, uint32_t gameid = 0) {
+    FRAMEHDR hdr;
+    makehdr(&hdr,type,gameid,len);
+    iovec iov[2] = {{&hdr,sizeof hdr},{(void*)data,(size_t)len}};
+    msghdr mh;
+    memset(&mh,0,sizeof mh);
+    mh.msg_iov = iov; mh.msg_iovlen = 2;
+    int ret = sendmsg(sockfd,&mh,MSG_NOSIGNAL);
+    // send the rest if only a part of the frame was written
+    if(ret >= 0 && ret < (int)sizeof hdr) {
+        sendall(sockfd,(char*)&hdr + ret,sizeof hdr - ret);
+        sendall(sockfd,data,len);
+    }
+    else if(ret >= (int)sizeof hdr) {
+        sendall(sockfd,data + ret - sizeof hdr,len - (ret - sizeof hdr));
+    }
+}
+
+// function to check recvbuffer for a whole msg. returns its size, or 0 if more bytes are needed.
+// a legacy msg is always BUFLEN bytes. anything else must be a frame
+int msgsize() {
+    if(recvlen == 0)
+        return 0;
+    if(recvbuffer[0] == '@')
+        return recvlen < BUFLEN ? 0 : BUFLEN;
+    return max(framesize(recvbuffer,recvlen),0);
+}
+
+// function to recv the next server msg. its code is put in code, its text is put in text as a NUL terminated
+// string and framed is set iff it came as a frame. returns false if the server closed the connection
+bool nextmsg(int sockfd, char* code, char* text, bool* framed) {
+    int size;
+    while((size = msgsize()) == 0) {
+        int ret = recv(sockfd,recvbuffer + recvlen,RECVBUFLEN - recvlen,0);
+        if(ret <= 0)
+            return false;
+        recvlen += ret;
+    }
+    *framed = (recvbuffer[0] != '@');
+    if(*framed) {
+        int len = size - sizeof(FRAMEHDR);
+        *code = '0' + recvbuffer[1];
+        memcpy(text,recvbuffer + sizeof(FRAMEHDR),len);
+        text[len] = '\0';
+    }
+    else {
+        // legacy msg. first 4 bytes contain a code in the form "@i@ " where i is in {0,1,2,3}
+        *code = recvbuffer[1];
+        memcpy(text,recvbuffer + 4,BUFLEN - 4);
+        text[BUFLEN - 4] = '\0';
+    }
+    recvlen -= size;
+    memmove(recvbuffer,recvbuffer + size,recvlen);
+    return true;
+}
+
+// function to apply the MOVEUPDATE u of a T_MOVE frame to the board and print the board the way the server's
+// game status text does. the player whose turn is next is told that his partner is playing
+void onupdate(const MOVEUPDATE* u) {
+    if(u->p == 0)
+        memset(board,'_',sizeof board);
+    else if(u->r >= 1 && u->r <= rows && u->c >= 1 && u->c <= cols)
+        board[cols*(u->r - 1) + u->c - 1] = (u->p == 1) ? 'X' : 'O';
+    cout << "Game Status:-" << endl;
+    for(int r=0;r<rows;++r) {
+        for(int c=0;c<cols;++c)
+            cout << board[cols*r + c] << (c + 1 < cols ? " | " : " ");
+        cout << endl;
+    }
+    int next = (u->p == 0) ? 1 : 3 - u->p;
+    if(u->status == 0 && next != u->you)
+        cout << "Your partner is playing now... " << endl;
+}
+
 int main(int argc, char** argv) {
 
-    if(argc != 3) {
-        cout << "Usage : ./gameclient [SERVER IP ADDRESS] [SERVER PORT NO]";
+    if(argc < 3 || argc > 9) {
+        cout << USAGE;
         exit(-1);
     }
+    // the player name, -c, -w GAMEID and -v M,N,K may follow the server's address and port
+    const char* name = "";
+    bool compact = false;
+    uint32_t watchid = 0;                                   // id of the game to watch. 0 -> play
+    int variant = 0;                                        // board variant to play on. 0 -> 3x3
+    for(int i=3;i<argc;++i) {
+        if(strcmp(argv[i],"-c") == 0)
+            compact = true;
+        else if(strcmp(argv[i],"-w") == 0 && i + 1 < argc)
+            watchid = strtoul(argv[++i],NULL,10);
+        else if(strcmp(argv[i],"-v") == 0 && i + 1 < argc) {
+            if((variant = variantof(argv[++i])) < 0) {
+                cout << "Unknown board. The boards are:";
+                for(int v=0;v<NVARIANTS;++v)
+                    cout << " " << variants[v].name;
+                cout << endl;
+                exit(-1);
+            }
+            rows = variants[variant].m; cols = variants[variant].n;
+        }
+        else
+            name = argv[i];
+    }
 
     struct sockaddr_in servaddr;                            // internet address of server 
     memset(&servaddr,0,sizeof servaddr);                    // zero out servaddr
@@ -57,41 +186,72 @@ int main(int argc, char** argv) {
         perror("ERROR: server connection failed"); exit(-1);
     }
 
+    // ask for the framed protocol. the flags and the variant come after the name and a NUL. the game to watch goes
+    // in the header
+    char hello[MAXPAYLOAD];
+    int hellolen = snprintf(hello,sizeof hello,"%s",name);
+    if(compact || watchid != 0 || variant != 0) {
+        hello[hellolen++] = '\0';
+        hello[hellolen++] = (compact ? HELLO_COMPACT : 0) | (watchid != 0 ? HELLO_WATCH : 0);
+        if(variant != 0)
+            hello[hellolen++] = variant;
+    }
+    sendframe(sockfd,T_HELLO,hello,hellolen,watchid);
+
     char code;                                  // code of recved data
-    char recvbuffer[BUFLEN];                    // buffer for storing recved data
+    char text[MAXPAYLOAD + 1];                  // text of recved msg
+    bool framed;                                // true iff the recved msg came as a frame
     char sendbuffer[BUFLEN];                    // buffer for storing data to send
     string replay;                              // response to replay request
     fd_set rfds;                                // set of file descriptors to monitor for possible read() using select function
     int maxfd = max(sockfd,STDINFD) + 1;        // the range of fds that must be monitored = max{rfds} + 1
     while(1) {
-        // recv server msg. first 4 bytes contain a code in the form 
-        // "@i@ " where i is in {0,1,2,3}
-        recv(sockfd,recvbuffer,BUFLEN,0);       
-        code = recvbuffer[1];                   // get server msg's code
+        // recv server msg and get its code. a closed connection ends the session
+        if(!nextmsg(sockfd,&code,text,&framed))
+            break;
 
-        // code = 0 -> Respond to KEEP_ALIVE msg by sending ackbuffer to server immediately
+        // code = 0 -> Respond to KEEP_ALIVE msg by sending an ack to server immediately
         if(code == '0') {
-            send(sockfd,ackbuffer,BUFLEN,0);
+            if(framed)
+                sendframe(sockfd,T_ACK,"",0);
+            else
+                sendall(sockfd,ackbuffer,BUFLEN);
         }
         // code = 1 -> Output server msg without the code
         else if(code == '1') {
-            cout << recvbuffer+4 << endl;
+            cout << text << endl;
+        }
+        // code = 7 -> (compact only) apply the move to the board and print it
+        else if(code == '0' + T_MOVE) {
+            onupdate((const MOVEUPDATE*)text);
         }
-        // code = 2 -> Output server msg and accept a line of input and send it to the server
+        // code = 2 -> Output server msg and accept a line of input and send it to the server.
+        // a move prompt has no text in compact mode
         else if(code == '2') {
-            cout << recvbuffer+4 << endl;
+            cout << (text[0] == '\0' ? "Enter (ROW, COL) for placing your mark: " : text) << endl;
+            // msgs that are already recved are handled before reading the player's input
+            if(msgsize() > 0)
+                continue;
             FD_ZERO(&rfds);                         // reset rfds
             FD_SET(sockfd,&rfds);                   // set the bits corr. to sockfd and STDINFD in rfds
             FD_SET(STDINFD,&rfds);
             select(maxfd,&rfds,NULL,NULL,NULL);     // block till data can be read from stdinfd or sockfd
             // if data is not there in sockfd, then we have data at stdin. We can read the player's response and send it to the server
             if(!FD_ISSET(sockfd,&rfds)) {
+                memset(sendbuffer,0,BUFLEN);
                 cin.getline(sendbuffer,BUFLEN);
-                send(sockfd,sendbuffer,BUFLEN,0);
+                if(framed && strcmp(sendbuffer,"/stats") == 0)
+                    sendframe(sockfd,T_QUERY,"",0);
+                else if(framed && strcmp(sendbuffer,"/top") == 0)
+                    sendframe(sockfd,T_QUERY,QUERYTOP,strlen(QUERYTOP));
+                else if(framed)
+                    sendframe(sockfd,T_INPUT,sendbuffer,strlen(sendbuffer));
+                else
+                    sendall(sockfd,sendbuffer,BUFLEN);
             }
         }
         // code = 3 -> close the socket and finish execution
-        else {
+        else if(code == '3') {
             break;
         }
     }
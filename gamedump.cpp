@@ -0,0 +1,102 @@
+/*
+    gamedump.cpp = Tool for reading the game history kept by the TicTacToe server (see gamestore.h)
+    Author = Vikram, CS19B021
+    Compilation CMD = g++ gamedump.cpp -o gamedump --std=c++17
+    Usage = ./gamedump [HISTORY DIR] list
+            ./gamedump [HISTORY DIR] dump [SEGMENT NUM]
+            ./gamedump [HISTORY DIR] game [GAME ID]
+            ./gamedump [HISTORY DIR] player [PLAYER ID]
+    Purpose = Lists the segments of a history directory, prints a whole segment or looks up a game or all the
+              games of a player through the sidecar indexes. Games are printed as the [NEW ENTRY] blocks of LOGFILE
+*/
+#include <bits/stdc++.h>
+#include "gamestore.h"
+#define HISTDIR argv[1]             // history directory
+#define CMD argv[2]                 // what to do
+using namespace std;
+
+// function to print all the records of segment segno. returns the num of records printed
+int dumpsegment(const string& dir, int segno) {
+    MAPPED m = mapfile(segpath(dir,segno,".dat"));
+    LOGREC rec;
+    string out;
+    int count = 0;
+    size_t pos = 0;
+    while(pos < m.size) {
+        int size = decoderec(m.data + pos,min(m.size - pos,(size_t)STOREMAXREC + 8),&rec);
+        if(size == 0) {
+            fprintf(stderr,"ERROR - bad record at offset %zu of segment %d\n",pos,segno);
+            break;
+        }
+        formatrec(&rec,out);
+        pos += size;
+        ++count;
+        if(out.size() > (1 << 20)) {
+            fwrite(out.data(),1,out.size(),stdout);
+            out.clear();
+        }
+    }
+    fwrite(out.data(),1,out.size(),stdout);
+    unmapfile(m);
+    return count;
+}
+
+int main(int argc, char** argv) {
+
+    if(argc < 3 || (strcmp(CMD,"list") != 0 && argc != 4)) {
+        cout << "Usage: ./gamedump [HISTORY DIR] list|dump [SEGMENT NUM]|game [GAME ID]|player [PLAYER ID]" << endl;
+        exit(-1);
+    }
+    string dir = HISTDIR;
+    vector<int> segs = listsegments(dir);
+
+    // list -> print every segment with its size and whether its indexes are sealed
+    if(strcmp(CMD,"list") == 0) {
+        for(int segno : segs) {
+            struct stat st;
+            stat(segpath(dir,segno,".dat").c_str(),&st);
+            bool sealed = access(segpath(dir,segno,".gidx").c_str(),F_OK) == 0;
+            printf("segment %d: %ld bytes, %s\n",segno,(long)st.st_size,sealed ? "sealed" : "open");
+        }
+        return 0;
+    }
+
+    // dump -> print every game of a segment
+    if(strcmp(CMD,"dump") == 0) {
+        int segno = atoi(argv[3]);
+        if(find(segs.begin(),segs.end(),segno) == segs.end()) {
+            cout << "No segment " << segno << " in " << dir << endl;
+            exit(-1);
+        }
+        dumpsegment(dir,segno);
+        return 0;
+    }
+
+    // game or player -> look up the matching records in the index of every segment and print them
+    const char* suffix;
+    if(strcmp(CMD,"game") == 0)
+        suffix = ".gidx";
+    else if(strcmp(CMD,"player") == 0)
+        suffix = ".pidx";
+    else {
+        cout << "Unknown command " << CMD << endl;
+        exit(-1);
+    }
+    uint32_t key = strtoul(argv[3],NULL,10);
+    auto start = chrono::steady_clock::now();
+    string out;
+    int found = 0;
+    for(int segno : segs) {
+        for(uint32_t off : lookupsegment(dir,segno,suffix,key)) {
+            LOGREC rec;
+            if(readrecord(dir,segno,off,&rec)) {
+                formatrec(&rec,out);
+                ++found;
+            }
+        }
+    }
+    double ms = chrono::duration<double,milli>(chrono::steady_clock::now() - start).count();
+    fwrite(out.data(),1,out.size(),stdout);
+    fprintf(stderr,"%d game(s) found in %.3f ms\n",found,ms);
+    return 0;
+}
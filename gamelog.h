@@ -0,0 +1,207 @@
+/*
+    gamelog.h = Asynchronous logger of finished games for the TicTacToe server
+    Author = Vikram, CS19B021
+    Purpose = Game threads and event loops hand a compact LOGREC of every finished game to a lock-free bounded queue.
+              A writer thread formats the records into the usual [NEW ENTRY] blocks and appends them to the log file
+              in large batches (group commit). A batch is written once it is big enough or once the flush interval
+              has passed, optionally followed by an fsync(). If the queue is full, the record is dropped and counted.
+              If a history directory is open (see gamestore.h), every record is also added to it with the same batch.
+*/
+#ifndef GAMELOG_H
+#define GAMELOG_H
+#include <bits/stdc++.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "gamestore.h"
+#define LOGQUEUELEN 65536                                               // num of records the queue can hold. must be a power of 2
+#define LOGBATCH (1 << 20)                                              // num of bytes after which a batch is written without waiting
+
+// structure to represent a slot of the queue. seq tells whether the slot is free for the producer
+// with ticket seq or holds the record for the consumer with ticket seq - 1
+struct LOGSLOT {
+    std::atomic<size_t> seq;
+    LOGREC rec;
+};
+
+// structure to represent the logger. the queue is a bounded multi-producer ring where producers claim tickets
+// with a CAS on head and the single writer thread consumes slots in order
+struct LOGGER {
+    LOGSLOT* slots;                                                     // ring of LOGQUEUELEN slots
+    alignas(64) std::atomic<size_t> head;                               // ticket of the next record to be queued
+    alignas(64) std::atomic<size_t> tail;                               // ticket of the next record to be written
+    alignas(64) std::atomic<uint64_t> drops;                            // num of records dropped since the queue was full
+    std::atomic<uint64_t> written;                                      // num of records written to the log file
+    std::atomic<bool> stopping;                                         // true iff the writer must write everything queued and exit
+    std::atomic<bool> draining;                                         // true iff the writer must write every batch at once (see logdrain())
+    std::atomic<size_t> committed;                                      // all records with tickets below it are written
+    std::mutex idlelock;                                                // guards the sleep of the writer thread
+    std::condition_variable idle;                                       // wakes the writer thread up early
+    int fd;                                                             // fd of the log file
+    int flushms;                                                        // max time (in ms) a record waits in a partial batch
+    bool dosync;                                                        // true iff every written batch is fsync()ed
+};
+
+LOGGER gamelog;
+
+// function to pack a finished game into rec. moves holds the moves of the game in order, each with 1-indexed r and c
+template<typename MOVES>
+inline void packlog(LOGREC* rec, uint32_t gameid, uint32_t pid1, uint32_t pid2, int64_t starttime, int64_t endtime,
+                    int cause, int winner, int variant, const MOVES& moves) {
+    rec->gameid = gameid;
+    rec->pid1 = pid1; rec->pid2 = pid2;
+    rec->starttime = starttime; rec->endtime = endtime;
+    rec->cause = cause;
+    rec->winner = winner;
+    rec->variant = variant;
+    rec->nmoves = moves.size();
+    for(int i=0;i<rec->nmoves;++i) {
+        rec->moves[i] = (moves[i].r << 4) | moves[i].c;
+    }
+}
+
+// function to queue rec for the writer thread. never blocks. returns false if the queue is full and rec was dropped
+inline bool logpush(const LOGREC* rec) {
+    size_t pos = gamelog.head.load(std::memory_order_relaxed);
+    LOGSLOT* slot;
+    while(1) {
+        slot = &gamelog.slots[pos & (LOGQUEUELEN - 1)];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        long diff = (long)seq - (long)pos;
+        if(diff == 0) {
+            if(gamelog.head.compare_exchange_weak(pos,pos + 1,std::memory_order_relaxed))
+                break;
+        }
+        else if(diff < 0) {
+            gamelog.drops.fetch_add(1,std::memory_order_relaxed);
+            return false;
+        }
+        else {
+            pos = gamelog.head.load(std::memory_order_relaxed);
+        }
+    }
+    slot->rec = *rec;
+    slot->seq.store(pos + 1,std::memory_order_release);
+    return true;
+}
+
+// function to take the next queued record into rec. only the writer thread calls it. returns false if the queue is empty
+inline bool logpop(LOGREC* rec) {
+    size_t pos = gamelog.tail.load(std::memory_order_relaxed);
+    LOGSLOT* slot = &gamelog.slots[pos & (LOGQUEUELEN - 1)];
+    if(slot->seq.load(std::memory_order_acquire) != pos + 1)
+        return false;
+    *rec = slot->rec;
+    slot->seq.store(pos + LOGQUEUELEN,std::memory_order_release);
+    gamelog.tail.store(pos + 1,std::memory_order_relaxed);
+    return true;
+}
+
+// function to return the num of records waiting in the queue
+inline size_t logdepth() {
+    return gamelog.head.load(std::memory_order_relaxed) - gamelog.tail.load(std::memory_order_relaxed);
+}
+
+// function to write the whole batch to the log file (and fsync it if asked to)
+inline void writebatch(std::string& batch) {
+    size_t done = 0;
+    while(done < batch.size()) {
+        ssize_t ret = write(gamelog.fd,batch.data() + done,batch.size() - done);
+        if(ret < 0) {
+            if(errno == EINTR)
+                continue;
+            perror("ERROR - log write failed.");
+            break;
+        }
+        done += ret;
+    }
+    if(gamelog.dosync)
+        fdatasync(gamelog.fd);
+    batch.clear();
+    storeflush(gamelog.dosync);
+}
+
+// function executed by the writer thread. it formats queued records into a batch and writes the batch once it
+// has LOGBATCH bytes or its oldest record has waited for flushms. when the queue is empty, it sleeps till the
+// batch is due
+inline void logwriter() {
+    std::string batch;
+    batch.reserve(LOGBATCH + 4096);
+    LOGREC rec;
+    uint64_t reporteddrops = 0;
+    auto due = std::chrono::steady_clock::now();
+    while(1) {
+        bool stopping = gamelog.stopping.load();
+        int n = 0;
+        while(batch.size() < LOGBATCH && logpop(&rec)) {
+            if(batch.empty())
+                due = std::chrono::steady_clock::now() + std::chrono::milliseconds(gamelog.flushms);
+            formatrec(&rec,batch);
+            if(!gamestore.dir.empty())
+                storeappend(&rec);
+            ++n;
+        }
+        gamelog.written += n;
+        if(!batch.empty() && (batch.size() >= LOGBATCH || stopping || gamelog.draining.load() || std::chrono::steady_clock::now() >= due)) {
+            writebatch(batch);
+        }
+        if(batch.empty())
+            gamelog.committed.store(gamelog.tail.load(std::memory_order_relaxed));
+        // report newly dropped records
+        uint64_t drops = gamelog.drops.load();
+        if(drops != reporteddrops) {
+            fprintf(stderr,"WARNING - log queue full. %lu game records dropped so far\n",(unsigned long)drops);
+            reporteddrops = drops;
+        }
+        if(stopping && logdepth() == 0 && batch.empty()) {
+            fsync(gamelog.fd);
+            exit(0);
+        }
+        if(n == 0) {
+            // nothing to do till the batch is due or new records arrive
+            std::unique_lock<std::mutex> guard(gamelog.idlelock);
+            gamelog.idle.wait_for(guard,std::chrono::milliseconds(std::max(1,std::min(gamelog.flushms,10))),
+                                  []{ return gamelog.draining.load(); });
+        }
+    }
+}
+
+// function to open the log file at path for appending and start the writer thread. a batch waits at most
+// flushms ms before it is written and dosync = true makes every written batch durable with fdatasync()
+inline void loginit(const char* path, int flushms, bool dosync) {
+    gamelog.slots = new LOGSLOT[LOGQUEUELEN];
+    for(size_t i=0;i<LOGQUEUELEN;++i)
+        gamelog.slots[i].seq.store(i);
+    gamelog.head = 0; gamelog.tail = 0;
+    gamelog.drops = 0; gamelog.written = 0;
+    gamelog.stopping = false;
+    gamelog.draining = false;
+    gamelog.committed = 0;
+    gamelog.flushms = flushms;
+    gamelog.dosync = dosync;
+    if((gamelog.fd = open(path,O_WRONLY|O_CREAT|O_APPEND,0644)) == -1) {
+        perror("ERROR - log file open failed"); exit(-1);
+    }
+    std::thread writer(logwriter);
+    writer.detach();
+}
+
+// function to make the writer thread write everything queued so far and exit the process
+inline void logstop() {
+    gamelog.stopping = true;
+}
+
+// function to wait till the writer thread has written every record queued so far, without waiting for the flush
+// interval. the threads that log games must be stopped, else their records may be left out
+inline void logdrain() {
+    size_t upto = gamelog.head.load();
+    {
+        std::lock_guard<std::mutex> guard(gamelog.idlelock);
+        gamelog.draining = true;
+    }
+    gamelog.idle.notify_one();
+    while(gamelog.committed.load() < upto)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    gamelog.draining = false;
+}
+
+#endif
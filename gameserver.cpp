@@ -2,477 +2,3064 @@
     gameserver.cpp = Code for Problem 1(TicTacToe) server side
     Author = Vikram, CS19B021
     Compilation CMD = g++ gameserver.cpp -o gameserver --std=c++17 -pthread
-    Usage = ./gameserver [PORT TO RUN SERVER ON]
-    Purpose = Server code for problem 1 
+    Usage = ./gameserver [PORT TO RUN SERVER ON] [-e NUM OF EVENT LOOPS] [-m MAX PLAYERS] [-g LOG FLUSH INTERVAL MS] [-y] [-H HISTORY DIR] [-b BOT WAIT MS] [-d BOT LEVEL]
+                    [-a NUM OF LOBBIES] [-p] [-M ADMIN PORT] [-q WAITING ROOM SIZE] [-u UPGRADE SOCKET] [-R CAPTURE FILE] [-T]
+    Purpose = Server code for problem 1
+    Protocol = Clients that send a T_HELLO frame (see protocol.h) right after connecting are served with the framed
+               protocol. Others get the legacy BUFLEN byte "@i@ data" msgs. A framed client may ask for a session that
+               plays many games on its connection (HELLO_MUX). Each of those games is played by a seat (see MUXCONN).
 */
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <bits/stdc++.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <unistd.h>
 #include <sys/time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/resource.h>
+#include <fcntl.h>
 #include <poll.h>
-#define nloop3(i,j) for(int i=0;i<3;++i) for(int j=0;j<3;++j)
+#include <signal.h>
+#include "timerwheel.h"
+#include "protocol.h"
+#include "gamelog.h"
+#include "boardtable.h"
+#include "mnkboard.h"
+#include "matchmaker.h"
+#include "metrics.h"
+#include "fanout.h"
+#include "leaderboard.h"
+#include "handoff.h"
+#include "capture.h"
+#include "trace.h"
 #define MYPORT argv[1]                                                  // server port number
-#define BACKLOG 10                                                      // max backlog of pending connects for listen()
+#define BACKLOG 4096                                                    // max backlog of pending connects for listen() (of every lobby)
 #define BUFLEN 100                                                      // size of buffers used for sending and recving data
 #define MOVETIMEOUT 15                                                  // timeout for making a move = 15 s
 #define ACKTIMEOUT 2                                                    // timeout for getting a response to KEEP_ALIVE msg
+#define IDLETIMEOUT 5                                                   // time (in s) a connection may be silent before it is sent a KEEP_ALIVE msg
+#define KEEPIDLE 10                                                     // time (in s) a connection may be idle before the kernel sends TCP keepalive probes
+#define KEEPINTVL 2                                                     // time (in s) between TCP keepalive probes
+#define KEEPCNT 3                                                       // num of unanswered TCP keepalive probes after which the kernel drops the connection
+#define USERTIMEOUT 10000                                               // time (in ms) sent data may stay unacked before the kernel drops the connection
 #define CHTIMEOUT 30                                                    // timeout for making a choice for the REPLAY question
 #define LOGFILE "log_file.txt"                                          // name of log file
-#define MAX_PLAYERS 10                                                  // max number of players who may play at any time. may be increased 
+#define MAX_PLAYERS 10                                                  // default max number of players who may play at any time. may be changed with -m
+#define ROOMSIZE 20                                                     // default max number of players who may wait for a free slot. may be changed with -q
+#define ROOMNOTIFY 1000                                                 // time (in ms) between updates of the positions of the players in a waiting room
+#define MAXEVENTS 256                                                   // max number of events fetched by one epoll_wait() call
+#define INBUFLEN 256                                                    // size of the buffer of recved but unhandled bytes of a connection
+#define HELLOTIMEOUT 100                                                // time (in ms) a new client gets for asking for the framed protocol
+#define LOGFLUSHMS 10                                                   // default max time (in ms) a finished game waits before it is written to LOGFILE
+#define BOTPID 0                                                        // player id of the server's bot. real players get ids from 1
+#define BOTLEVEL 100                                                    // default % of the bot's moves that are perfect. may be changed with -d
+#define GAMESHARDS 16                                                   // num of shards of the directory of live games
+#define ADMINREQLEN 4096                                                // max size of a request to the admin port
+#define MUXBUFLEN 16384                                                 // size of the buffer of recved but unhandled bytes of a multiplexed connection
+#define MUXGONE -1                                                      // type of a MUXINPUT that ends the game of its seat as a disconnect
+#define MOVEPROMPT "Enter (ROW, COL) for placing your mark: "           // text of a move prompt
+#define REPLAYPROMPT "Do you want to replay(YES|NO)?"                   // text of the REPLAY question
+#define USAGE "Usage: ./gameserver [PORT TO RUN SERVER ON] [-e NUM OF EVENT LOOPS] [-m MAX PLAYERS] [-g LOG FLUSH INTERVAL MS] [-y] [-H HISTORY DIR] [-b BOT WAIT MS] [-d BOT LEVEL] [-a NUM OF LOBBIES] [-p] [-M ADMIN PORT] [-q WAITING ROOM SIZE] [-u UPGRADE SOCKET] [-R CAPTURE FILE] [-T]"
 using namespace std;
 
-int sockfd;                                                             // fd for the server's socket
-atomic_int activeplayers;                                               // num of active players
+atomic_int maxplayers(MAX_PLAYERS);                                     // max number of players who may play (or watch) at any time
+atomic_int activeplayers;                                               // num of players who hold one of the maxplayers slots
+atomic_int roomsize(ROOMSIZE);                                          // max number of players who may wait for a free slot
+atomic_int roomcount;                                                   // num of players waiting for a free slot
 atomic_uint pidcounter;                                                 // counter for assigning player ids. will be incremented by 1 after a id is assigned
 atomic_uint gidcounter;                                                 // counter for assigning game ids. will be incremented by 1 after a id is assigned
-mutex logfile_mutex;                                                    // mutex for ensuring log file is not updated by threads simultaneously
+atomic<uint64_t> seatcounter;                                           // counter for assigning keys to the seats of multiplexed connections
 const char ackbuffer[BUFLEN] = "I_AM_ALIVE";                            // expected reply from a client for a KEEP_ALIVE msg
+int botwait = 0;                                                        // time (in ms) a player waits for a partner before the bot plays him. 0 -> no bot
+int botlevel = BOTLEVEL;                                                // % of the bot's moves that are perfect. the others are random
 
 // structure to represent a move in the game. p = 1 (player 1 with sym 'X') or 2 (player 2 with sym 'O'),
-// r = row index in the game array, c = col index in the game array. r, c both are in {0,1,2}.
+// r = row index in the game board, c = col index in the game board. r, c both are in {0,1,2}.
 struct GMOVE {
     int p, r, c;
     GMOVE(int x, int y, int z) {
-        p = x; r = y; c = z; 
+        p = x; r = y; c = z;
     }
 };
 
+// states of a game. a game is always waiting for something - a move from the player whose turn it is or
+// the replay choices of both players. GS_FINISHED means the game is over and its connections may be closed.
+// the liveness of the players is checked on the side (see checklive()), so it never holds up a game
+enum GSTATE { GS_AWAITMOVE, GS_AWAITREPLAY, GS_FINISHED };
+
+// protocols spoken by a client. PROTO_UNKNOWN -> the client hasn't been heard from yet
+enum PROTO { PROTO_UNKNOWN, PROTO_LEGACY, PROTO_FRAMED };
+
+// structure to represent the connection of a player. inbuf collects recved bytes till a whole msg (BUFLEN bytes
+// for legacy clients, a whole frame for the others) is available. outbuf holds the unsent tail of msgs that
+// a send() couldn't write completely.
+struct CONN {
+    int fd;                                                             // connection fd
+    uint pid;                                                           // id of the player
+    int p;                                                              // player number of this connection in its game (1 or 2)
+    struct GAME* game;                                                  // game played on this connection. NULL -> not in a game yet
+    struct EVLOOP* loop;                                                // event loop watching the (non-blocking) fd. NULL -> fd is blocking
+    PROTO proto;                                                        // protocol spoken by the client
+    char inbuf[INBUFLEN];                                               // recved but unhandled bytes
+    int inlen;                                                          // num of bytes in inbuf
+    string outbuf;                                                      // pending bytes to send
+    bool outwatched;                                                    // true iff EPOLLOUT is asked for
+    bool corked;                                                        // true iff msgs are only queued in outbuf till uncorkgame()
+    bool compact;                                                       // true iff the client asked for T_MOVE frames (HELLO_COMPACT)
+    bool spectator;                                                     // true iff this is the connection of a SPECTATOR
+    bool slot;                                                          // true iff the connection holds one of the maxplayers slots
+    bool inroom;                                                        // true iff the player waits in the waiting room of its lobby
+    int roompos;                                                        // position in the waiting room the player was last told
+    int ackwait;                                                        // num of KEEP_ALIVE msgs that haven't been acked yet
+    long long heardus;                                                  // time (in us) anything was last recved from the client
+    long long pingus;                                                   // time (in us) the last KEEP_ALIVE msg was sent
+    int choice;                                                         // choice for the REPLAY question. 0 - no choice yet, 1 - YES, 2 - anything else
+    TIMER timer;                                                        // timer of the connection while it is in the lobby
+    bool bot;                                                           // true iff this is the server's bot. the bot has no fd and answers through botreply()
+    char name[MAXNAME+1];                                               // name of the player from its T_HELLO frame. "" -> no name
+    MMENTRY mm;                                                         // entry of the player in the matchmaker. mm.rating is the player's rating
+    bool muxed;                                                         // true iff this is the connection of a MUXCONN
+    struct MUXCONN* mux;                                                // multiplexed connection the player (a seat) plays on. NULL -> the player has its own fd
+    uint32_t tag;                                                       // (seats only) the client's id for the seat's game
+    uint64_t seatkey;                                                   // (seats only) key of the seat in the seats of its game's event loop
+    uint32_t capid;                                                     // id of the connection in the capture file (see capture.h). 0 -> not captured
+    uint32_t prompts;                                                   // num of prompts sent to the client. seats count in MUXCONN::tagprompts
+};
+
 // structure to represent a game with all the associated data and metadata
 struct GAME {
     uint pid1, pid2;                                                    // ids of player 1 and player 2 resp.
-    int fd1, fd2;                                                       // connection fds of player 1 and player 2 resp.
+    CONN conn[2];                                                       // connections of player 1 and player 2 resp.
     int turn;                                                           // turn = "whose has to make the move now?". turn = 1 or 2
-    char array[3][3];                                                   // array for playing the game by placing 'X's and 'O's
+    uint16_t board;                                                     // index of the game board in boardtable (see boardtable.h)
+    int variant;                                                        // board variant of the game (see mnkboard.h). 0 -> the 3x3 board in board
+    void* mnk;                                                          // MNKBOARD of the variant if it isn't 0. NULL otherwise
+    uint8_t status;                                                     // status of the board (see BOARDINFO::status)
     vector<GMOVE> moveSeq;                                              // sequence of moves made in the game so far
     int cause;                                                          // cause for completion. cause = 1 - win , 2 - draw, 3 - timeout, 4 - disconnection
     int winner;                                                         // winner of the game. winner = 1 (player 1) or 2 (player 2)
     time_t starttime, endtime;                                          // start time and end time resp.
     uint gameid;                                                        // id of the game
+    GSTATE state;                                                       // what the game is waiting for
+    bool logged;                                                        // true iff the current game has been logged already
+    long long deadline;                                                 // time (in ms) at which the current wait times out. 0 -> no timeout
+    long long wakeup;                                                   // time (in ms) of the next timeout or liveness check. 0 -> none
+    long long promptus;                                                 // time (in us) the last move prompt was sent
+    struct EVLOOP* loop;                                                // event loop owning the game. NULL -> a thread plays the game
+    TIMER timer;                                                        // timer of the game in its event loop's wheel
+    vector<struct SPECTATOR*> specs;                                    // spectators of the game (event loop mode only)
+    bool fanned;                                                        // true iff updates have been queued for the spectators since the last flush
+    bool resumed;                                                       // true iff the game was handed over by an older server and goes on where it was
+};
+
+// structure to represent a spectator of a game. it is a connection of the game's event loop that gets the updates
+// of the game through a FANQUEUE (see fanout.h). msgs from a spectator are ignored
+struct SPECTATOR : CONN {
+    uint watchid;                                                       // id of the game the spectator asked for
+    size_t pos;                                                         // index of the spectator in game->specs
+    FANQUEUE queue;                                                     // updates yet to be sent
+};
+
+// structure to represent a game of a multiplexed connection, its seat. conn is the seat's player while it waits in
+// the lobby of the connection. once its game is started, loop is the game's event loop. left -> the seat's game is
+// to end as a disconnect as soon as it starts, since the seat left or lost its connection on its way to the game
+struct MUXSEAT {
+    CONN* conn;                                                         // player of the seat in the lobby. NULL -> handed over to a game
+    struct EVLOOP* loop;                                                // event loop of the seat's game. NULL -> no game yet
+    uint64_t key;                                                       // key of the seat in loop->seats
+    bool left;                                                          // true iff the game must end as soon as it starts
+};
+
+// structure to represent a msg of a multiplexed connection for the game of one of its seats. the lobby of the
+// connection reads it and hands it over to the event loop of the game
+struct MUXINPUT {
+    uint64_t key;                                                       // key of the seat in the seats of the loop
+    int type;                                                           // frame type or MUXGONE
+    char msg[BUFLEN+1];
+};
+
+// structure to represent a connection that plays many games at once (HELLO_MUX). it stays in its lobby for its
+// whole life: the lobby reads it, checks its liveness and hands the msgs for its games over to their event
+// loops. each game has a seat, a player of its own (own player id, slot and rating) without a fd. the event loops
+// of the seats' games and the lobby all send on the connection, so its outbuf is guarded by lock
+struct MUXCONN : CONN {
+    mutex lock;                                                         // guards the fields below and outbuf, outwatched and fd
+    bool closed;                                                        // true iff the connection is gone. its fd is closed then
+    unordered_map<uint32_t,MUXSEAT> seats;                              // open games of the connection by the client's id for them
+    int refs;                                                           // 1 from the lobby till the connection is gone + 1 per seat
+    char buf[MUXBUFLEN];                                                // (lobby only) recved but unhandled bytes
+    int buflen;                                                         // (lobby only) num of bytes in buf
+    unordered_map<uint32_t,uint32_t> tagprompts;                        // num of prompts sent by the client's id for the game. kept while capturing
+    int capped;                                                         // (lobby only) num of bytes at the start of buf that are captured already
+};
+
+// structure to represent an event loop. every event loop thread owns the connections of its games through
+// an epoll instance and keeps the pending timeouts of its games in a timing wheel. lobbies are event loops
+// too. a lobby owns its own listening socket and the connections it accepts till they are moved into games.
+struct EVLOOP {
+    int epfd;                                                           // epoll fd
+    int evfd;                                                           // eventfd used to wake up the loop when new games or matches are handed over
+    mutex newgames_mutex;                                               // mutex for newgames and matched
+    vector<GAME*> newgames;                                             // games handed over by the lobbies but not started yet
+    TIMERWHEEL wheel;                                                   // timers of the games (or lobby connections) owned by the loop
+    vector<SPECTATOR*> newspecs;                                        // spectators handed over by the lobbies but not watching yet
+    unordered_map<uint,GAME*> games;                                    // live games owned by the loop by game id
+    vector<MUXINPUT> muxinputs;                                         // msgs for the seats of multiplexed connections handed over by the lobbies
+    unordered_map<uint64_t,CONN*> seats;                                // seats of multiplexed connections in the loop's games by key
+    int listenfd;                                                       // (lobbies only) listening socket
+    vector<CONN*> matched;                                              // (lobbies only) pairs of a waiting player of this lobby and its match from another lobby
+    deque<CONN*> room;                                                  // (lobbies only) waiting room. players waiting for a free slot in order of arrival
+    atomic_int roomlen;                                                 // (lobbies only) size of room. read by the threads that free slots
+    TIMER roomtimer;                                                    // (lobbies only) timer for telling the players in room their positions
+    int sparefd;                                                        // (lobbies only) fd given up to turn away a connection when the server is out of fds
+    vector<vector<MUXINPUT>> muxout;                                    // (lobbies only) msgs read from multiplexed connections but not handed over yet, by event loop
+    vector<MUXCONN*> deadmux;                                           // (lobbies only) multiplexed connections that were dropped in the current batch
+    vector<CONN*> gone;                                                 // connections moved into games (lobbies) or dropped spectators (event loops).
+                                                                        // freed after the current batch of events
+};
+
+// structure to represent a shard of the directory of live games. it tells the lobbies which event loop owns
+// the game a spectator wants to watch
+struct GAMESHARD {
+    mutex lock;
+    unordered_map<uint,EVLOOP*> loops;
 };
 
-// function for logging a game in LOGFILE.
+GAMESHARD gamedir[GAMESHARDS];
+
+int numloops = 0;                                                       // num of event loops. 0 -> one thread per game
+EVLOOP* loops;                                                          // array of numloops event loops
+int numlobbies = 1;                                                     // num of lobbies. every lobby accepts and pairs players in its own thread
+EVLOOP* lobbies;                                                        // array of numlobbies lobbies. lobby 0 runs in the main thread
+bool pinthreads = false;                                                // true iff lobby and event loop threads are pinned to cores
+int sigfd;                                                              // signalfd for SIGUSR1 and SIGUSR2. read by lobby 0
+int adminport = 0;                                                      // port of the admin socket. 0 -> none
+int adminfd = -1;                                                       // admin socket
+const char* upgradepath = NULL;                                         // path of the Unix socket a new server takes over through. NULL -> none
+int upgradefd = -1;                                                     // Unix socket listening at upgradepath
+atomic_int upgradestage;                                                // 0 -> serving, 1 -> the lobbies stop for a handoff, 2 -> the event loops stop too
+mutex parklock;                                                         // guards parked
+condition_variable parkcv;                                              // signalled when a thread stops or the handoff is over
+int parked = 0;                                                         // num of lobby and event loop threads stopped for a handoff
+
+// function to get the current time in ms from a monotonic clock. used for timeouts
+long long nowms() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// function to get the current time in us from a monotonic clock. used for latency metrics
+long long nowus() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// function for logging a game in LOGFILE. the game is packed into a LOGREC and handed over to the writer
+// thread of gamelog.h, which writes it in the usual format. the calling thread never waits for the file
 void logger(GAME* game) {
-    logfile_mutex.lock();                                               // get mutex lock to prevent other threads from entering
-    ofstream fout;                                                      // ofstream object to write to LOGFILE                                     
-    time_t duration = game->endtime - game->starttime;                  // duration of game
-    fout.open(LOGFILE,std::ios_base::app);                              // open LOGFILE in append mode
-    fout << "_______________________________________________________________";
-    fout << "_______________________________________________________________" << endl << "[NEW ENTRY]\n";
-    // write game id, player ids, start time, end time and duration to LOGFILE
-    fout << "Game ID = " << game->gameid << endl;
-    fout << "Player 1 ID = " << game->pid1 << endl;
-    fout << "Player 2 ID = " << game->pid2 << endl;
-    fout << "Start Time = " << ctime(&game->starttime);
-    fout << "End Time = " << ctime(&game->endtime);
-    fout << "Duration = " << duration/60 << " m " << duration % 60 << " s" << endl;
-    // write the move sequence to LOGFILE
-    fout << "Moves Made = <";
-    int count = game->moveSeq.size();
-    int i = 0;
-    for(auto& m : game->moveSeq) {
-        fout << "(PLR" << m.p << "," << m.r << "," << m.c << ")";
-        ++i;
-        if(i != count)
-            fout << ", ";
-    }
-    fout << ">" << endl;
-    // write game result to LOGFILE. game result depends on cause and winner
-    if(game->cause == 1) {
-        fout << "Result = Player " << game->winner << " won the game." << endl;
+    LOGREC rec;
+    packlog(&rec,game->gameid,game->pid1,game->pid2,game->starttime,game->endtime,game->cause,game->winner,game->variant,
+            game->moveSeq);
+    mcount(M_WINS + game->cause - 1);
+    trace(TR_LOGPUSH,TP_BEGIN,game->gameid);
+    auto start = chrono::steady_clock::now();
+    logpush(&rec);
+    mrecord(H_LOGPUSH,chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count());
+    trace(TR_LOGPUSH,TP_END,game->gameid);
+    // the game is over once it is logged. a replay is a new game
+    trace(TR_GAME,TP_ASYNCEND,game->gameid);
+}
+
+// function to add a finished game to the records of its players (see leaderboard.h) with their ratings after the
+// game. a timed out game is a timeout for the player with the turn. both players of a disconnected game get a disconnect
+void recordgame(GAME* game) {
+    STATPLAYER p[2];
+    for(int i=0;i<2;++i) {
+        CONN* conn = &game->conn[i];
+        p[i].name = conn->name;
+        p[i].pid = conn->bot ? BOTPID : conn->pid;
+        p[i].rating = conn->mm.rating;
+        if(game->cause == 1)
+            p[i].result = (game->winner == i + 1) ? SR_WIN : SR_LOSS;
+        else if(game->cause == 2)
+            p[i].result = SR_DRAW;
+        else if(game->cause == 3)
+            p[i].result = (game->turn == i + 1) ? SR_TIMEOUT : SR_OPPTIMEOUT;
+        else
+            p[i].result = SR_DISCONNECT;
     }
-    else if(game->cause == 2) {
-        fout << "Result = The game was a draw." << endl;
+    statsrecord(p);
+}
+
+// function to take one of the maxplayers slots without a lock. returns false iff all of them are taken
+bool takeslot() {
+    int n = activeplayers.load();
+    while(n < maxplayers.load()) {
+        if(activeplayers.compare_exchange_weak(n,n + 1))
+            return true;
     }
-    else if(game->cause == 3) {
-        fout << "Result = The game was quitted due to inactivity." << endl;
+    return false;
+}
+
+// function to take a place in the waiting room without a lock. returns false iff the room is full
+bool enterroom() {
+    int n = roomcount.load();
+    while(n < roomsize.load()) {
+        if(roomcount.compare_exchange_weak(n,n + 1))
+            return true;
     }
-    else {
-        fout << "Result = The game was quitted due to disconnection." << endl;
+    return false;
+}
+
+// function to wake up the lobbies that have players in their waiting rooms, so that they admit them to free slots
+void wakerooms() {
+    uint64_t one = 1;
+    for(int i=0;i<numlobbies;++i) {
+        if(lobbies[i].roomlen.load() > 0)
+            write(lobbies[i].evfd,&one,sizeof one);
     }
-    // close the LOGFILE and release the mutex lock
-    fout.close();
-    logfile_mutex.unlock();
 }
 
-// function to wait for data to be recved at connfd with timeout = tmout seconds.
-// if timeout hasn't expired, data recved is put into buf.
-int polledrecv(int connfd,void* buf,int tmout) {
+// function to give up a slot. it goes to a player in a waiting room, if there is one
+void freeslot() {
+    --activeplayers;
+    if(roomcount.load() > 0)
+        wakerooms();
+}
+
+// function to handle SIGINT and SIGTERM. the writer thread writes the games logged so far and exits the server
+void onstop(int) {
+    logstop();
+}
 
-    // poll connfd for input data with a timeout as tmout * 1000 milliseconds
-    // poll returns <= 0 -> an error or poll has timed out
-    pollfd pollstruct = {.fd=connfd,.events=POLL_IN,.revents=0};
-    if(poll(&pollstruct,POLL_IN,tmout * 1000) <= 0) {
-        return -1;                                      // failed recv
+// function to (re)register conn's fd with the epoll instance of its loop.
+// EPOLLOUT is asked for only while there is something left in conn->outbuf
+void watchconn(CONN* conn, int op) {
+    conn->outwatched = !conn->outbuf.empty();
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP | (conn->outbuf.empty() ? 0 : (uint32_t)EPOLLOUT);
+    ev.data.ptr = conn;
+    if(epoll_ctl(conn->loop->epfd,op,conn->fd,&ev) == -1) {
+        perror("ERROR - epoll_ctl failed.");
     }
-    else {
-        // here, we fetch data from connfd and write into buf. also handle any errors
-        int ret = recv(connfd,buf,BUFLEN,0);
+}
+
+// function to send the iovcnt buffers of iov on the multiplexed connection mux without blocking. whatever the socket
+// doesn't take now is queued in mux->outbuf and sent by the lobby of mux. returns -1 iff mux is gone or the send failed
+int muxsend(MUXCONN* mux, iovec* iov, int iovcnt) {
+    lock_guard<mutex> guard(mux->lock);
+    if(mux->closed)
+        return -1;
+    ssize_t ret = 0;
+    if(mux->outbuf.empty()) {
+        msghdr mh;
+        memset(&mh,0,sizeof mh);
+        mh.msg_iov = iov; mh.msg_iovlen = iovcnt;
+        ret = sendmsg(mux->fd,&mh,MSG_NOSIGNAL|MSG_DONTWAIT);
+        if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            ret = 0;
         if(ret < 0) {
-            perror("ERROR - recv failed.");
+            mcount(M_SENDFAILS);
+            return -1;
         }
+    }
+    for(int i=0;i<iovcnt;++i) {
+        size_t skip = min((size_t)ret,iov[i].iov_len);
+        ret -= skip;
+        mux->outbuf.append((char*)iov[i].iov_base + skip,iov[i].iov_len - skip);
+    }
+    if(!mux->outbuf.empty() && !mux->outwatched)
+        watchconn(mux,EPOLL_CTL_MOD);
+    return 0;
+}
+
+// function to send a frame of the given type with text as payload on the multiplexed connection mux. tag is the
+// client's id for the game the frame belongs to (0 -> the connection itself)
+int muxframe(MUXCONN* mux, int type, uint32_t tag, const char* text) {
+    FRAMEHDR hdr;
+    makehdr(&hdr,type,tag,strlen(text));
+    iovec iov[2] = {{&hdr,sizeof hdr},{(void*)text,strlen(text)}};
+    return muxsend(mux,iov,2);
+}
+
+// function to drop a reference to mux. the last one frees it
+void unrefmux(MUXCONN* mux) {
+    mux->lock.lock();
+    bool last = (--mux->refs == 0);
+    mux->lock.unlock();
+    if(last)
+        delete mux;
+}
+
+// function to take the seat conn off the open games of its multiplexed connection, once its game is over. the
+// client may use the id of the game again as soon as it has got the T_GAMEOVER, so this is done before that is sent
+void unlistseat(CONN* conn) {
+    lock_guard<mutex> guard(conn->mux->lock);
+    auto it = conn->mux->seats.find(conn->tag);
+    if(it != conn->mux->seats.end() && it->second.key == conn->seatkey)
+        conn->mux->seats.erase(it);
+}
+
+// function to get the id of the game of conn for its trace events. 0 -> no game yet
+uint traceid(CONN* conn) {
+    return conn->game ? conn->game->gameid : 0;
+}
+
+// function to send as much of conn->outbuf as the socket accepts now. returns -1 iff the send failed
+int flushconn(CONN* conn) {
+    if(conn->mux != NULL) {
+        // a seat queues msgs only while its game is corked. they go out on its multiplexed connection
+        iovec iov = {(void*)conn->outbuf.data(),conn->outbuf.size()};
+        int ret = conn->outbuf.empty() ? 0 : muxsend(conn->mux,&iov,1);
+        conn->outbuf.clear();
         return ret;
     }
+    size_t sent = 0;
+    trace(TR_FLUSH,TP_BEGIN,traceid(conn));
+    while(sent < conn->outbuf.size()) {
+        int ret = send(conn->fd,conn->outbuf.data() + sent,conn->outbuf.size() - sent,MSG_NOSIGNAL|(conn->loop ? MSG_DONTWAIT : 0));
+        if(ret < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if(errno == EINTR)
+                continue;
+            mcount(M_SENDFAILS);
+            trace(TR_FLUSH,TP_END,traceid(conn));
+            return -1;
+        }
+        sent += ret;
+    }
+    trace(TR_FLUSH,TP_END,traceid(conn));
+    conn->outbuf.erase(0,sent);
+    if(conn->loop != NULL && conn->outwatched != !conn->outbuf.empty()) {
+        watchconn(conn,EPOLL_CTL_MOD);
+    }
+    return 0;
+}
+
+// function to send the iovcnt buffers of iov to conn with one syscall. msgs are never partially dropped:
+// whatever the socket doesn't take now is queued in conn->outbuf and sent later (in event loop mode)
+// or right away (in thread per game mode). a corked conn only queues. returns -1 iff the send failed
+int sendiov(CONN* conn, iovec* iov, int iovcnt) {
+    if(conn->mux != NULL && !conn->corked)
+        return muxsend(conn->mux,iov,iovcnt);
+    ssize_t ret = 0;
+    if(conn->outbuf.empty() && !conn->corked) {
+        msghdr mh;
+        memset(&mh,0,sizeof mh);
+        mh.msg_iov = iov; mh.msg_iovlen = iovcnt;
+        trace(TR_SEND,TP_BEGIN,traceid(conn));
+        ret = sendmsg(conn->fd,&mh,MSG_NOSIGNAL|(conn->loop ? MSG_DONTWAIT : 0));
+        trace(TR_SEND,TP_END,traceid(conn));
+        if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            ret = 0;
+        // catch failed send and display errno
+        if(ret < 0) {
+            perror("ERROR - send failed.");
+            mcount(M_SENDFAILS);
+            return -1;
+        }
+    }
+    // queue the part of the buffers that hasn't been sent
+    for(int i=0;i<iovcnt;++i) {
+        size_t skip = min((size_t)ret,iov[i].iov_len);
+        ret -= skip;
+        conn->outbuf.append((char*)iov[i].iov_base + skip,iov[i].iov_len - skip);
+    }
+    if(conn->outbuf.empty() || conn->corked)
+        return 0;
+    if(conn->loop != NULL) {
+        if(!conn->outwatched)
+            watchconn(conn,EPOLL_CTL_MOD);
+        return 0;
+    }
+    return flushconn(conn);
 }
 
-// send a message to connfd with code cd and data = dt
+// function to send a frame of the given type with the len bytes of data as payload to the framed client of conn.
+// the frames of a seat carry the client's id for its game instead of the game id
+int framesend(CONN* conn, int type, const void* data, int len) {
+    FRAMEHDR hdr;
+    makehdr(&hdr,type,conn->mux ? conn->tag : (conn->game ? conn->game->gameid : 0),len);
+    iovec iov[2] = {{&hdr,sizeof hdr},{(void*)data,(size_t)len}};
+    return sendiov(conn,iov,2);
+}
+
+// function to count a prompt sent to conn for the capture file. the event loops of many seats may prompt on one
+// multiplexed connection, so a seat counts under its lock and only while the traffic is captured
+void countprompt(CONN* conn) {
+    if(conn->mux == NULL) {
+        ++conn->prompts;
+    }
+    else if(capturing()) {
+        lock_guard<mutex> guard(conn->mux->lock);
+        ++conn->mux->tagprompts[conn->tag];
+    }
+}
+
+// send a message to conn with code cd and data = dt
 // code : 0 -> KEEP_ALIVE msg; 1 -> print data msg; 2 -> print data and send player response back msg;
 //        3 -> game over msg to make client process exit from its loop, close its connection fd and return
-int codesend(int connfd, int cd, string dt) {
-    string s = "@" + to_string(cd) + "@ " + dt;             // coded msg
-    char sendbuf[BUFLEN];                                   // buf containing data to send
-    strcpy(sendbuf,s.c_str());                              // fill buf with s
-    int ret = send(connfd,sendbuf,BUFLEN,MSG_NOSIGNAL);     // send the coded msg
-    // catch failed send and display errno
-    if(ret < 0) {
-        perror("ERROR - send failed.");
-        return ret;
+// framed clients get a FRAMEHDR and dt in one scatter-gather send. legacy clients get LEGACYLEN bytes "@cd@ dt".
+int codesend(CONN* conn, int cd, const char* dt) {
+    if(conn->bot)
+        return 0;                                           // the bot looks at the game itself
+    if(cd == 2)
+        countprompt(conn);
+    if(conn->proto == PROTO_FRAMED)
+        return framesend(conn,cd,dt,min(strlen(dt),(size_t)MAXPAYLOAD));
+    char sendbuf[LEGACYLEN];                                // buf containing the coded msg. dt is cut short if it doesn't fit
+    makelegacy(sendbuf,cd,dt);
+    iovec iov = {sendbuf,LEGACYLEN};
+    return sendiov(conn,&iov,1);
+}
+
+// function to recv the next bytes from conn into conn->inbuf without blocking.
+// returns 1 if bytes were recved, 0 if there were none and -1 if the connection is closed or broken
+int recvconn(CONN* conn) {
+    trace(TR_RECV,TP_BEGIN,traceid(conn));
+    int ret = recv(conn->fd,conn->inbuf + conn->inlen,INBUFLEN - conn->inlen,MSG_DONTWAIT);
+    trace(TR_RECV,TP_END,traceid(conn));
+    if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+        return 0;
+    if(ret <= 0) {
+        if(ret < 0)
+            perror("ERROR - recv failed.");
+        caprecord(conn->capid,CK_CLOSE,conn->prompts);
+        return -1;
     }
-    if(cd == 0) {
-        // for KEEP_ALIVE msg, expect a response within ACKTIMEOUT
-        // response should be "I_AM_ALIVE"
-        char recvbuf[BUFLEN];
-        if(polledrecv(connfd,recvbuf,ACKTIMEOUT) < 0 || strcmp(ackbuffer,recvbuf) != 0) {
+    caprecord(conn->capid,CK_DATA,conn->prompts,conn->inbuf + conn->inlen,ret);
+    conn->inlen += ret;
+    conn->heardus = nowus();
+    return 1;
+}
+
+// function to take the next whole msg out of conn->inbuf. its type is put in type and its data is put in msg
+// as a NUL terminated string (msg must have room for BUFLEN + 1 chars). legacy msgs always have type = T_INPUT.
+// returns 1 if a msg was taken, 0 if there is no whole msg yet and -1 if the client broke the protocol
+int takemsg(CONN* conn, int* type, char* msg) {
+    int size, len;
+    char* data;
+    if(conn->proto == PROTO_FRAMED) {
+        if((size = framesize(conn->inbuf,conn->inlen)) <= 0)
+            return size;
+        *type = (unsigned char)conn->inbuf[1];
+        data = conn->inbuf + sizeof(FRAMEHDR);
+        len = size - sizeof(FRAMEHDR);
+        if(len > BUFLEN)
             return -1;
-        }
     }
-    return ret;
+    else {
+        if(conn->inlen < BUFLEN)
+            return 0;
+        size = BUFLEN;
+        *type = T_INPUT;
+        data = conn->inbuf;
+        len = strnlen(data,BUFLEN);
+    }
+    memcpy(msg,data,len);
+    msg[len] = '\0';
+    conn->inlen -= size;
+    memmove(conn->inbuf,conn->inbuf + size,conn->inlen);
+    return 1;
 }
 
-// function to send KEEP_ALIVE msgs to both fd1 and fd2.
-// returns true iff both fd1 and fd2 are alive
-bool alive(int fd1,int fd2) {
-    int r1 = codesend(fd1,0,"ARE YOU ALIVE?");
-    int r2 = codesend(fd2,0,"ARE YOU ALIVE?");
-    return !(r1 < 0 || r2 < 0);
+// function to file the game of an event loop under newid instead of oldid (0 -> none) in the directory of live
+// games and in the games of its loop, so that spectators can find it
+void relistgame(GAME* game, uint oldid, uint newid) {
+    EVLOOP* loop = game->loop;
+    if(oldid != 0) {
+        loop->games.erase(oldid);
+        GAMESHARD* shard = &gamedir[oldid % GAMESHARDS];
+        lock_guard<mutex> guard(shard->lock);
+        shard->loops.erase(oldid);
+    }
+    if(newid != 0) {
+        loop->games[newid] = game;
+        GAMESHARD* shard = &gamedir[newid % GAMESHARDS];
+        lock_guard<mutex> guard(shard->lock);
+        shard->loops[newid] = loop;
+    }
 }
 
 // initialize a game by setting turn = player 1('X')'s turn,
-// assigning a new game id and setting all entries in game array as '_'.
-// '_' indicates an unfiiled position
+// assigning a new game id and making all positions of the game board unfilled.
 void initgame(struct GAME* game) {
+    mcount(M_GAMESSTARTED);
     game->turn = 1;
+    uint oldid = game->gameid;
     game->gameid = gidcounter++;
-    nloop3(a,b) {
-        game->array[a][b] = '_';
-    }
+    if(game->loop != NULL)
+        relistgame(game,oldid,game->gameid);
+    game->logged = false;
+    game->board = 0;
+    game->status = 0;
+    if(game->mnk != NULL)
+        variants[game->variant].init(game->mnk);
 }
 
-// function to return the game array as a string in human-friendly form
-string gamestring(char array[3][3]) {
-    string res("Game Status:-\n");
-    nloop3(a,b) {       
-        res += array[a][b];
-        res += " ";
-        if(b != 2)
-            res += "| ";
-        else
-            res += "\n";
-    }
+// function to return the game board in human-friendly form. the text of a board of another variant than 3x3 is
+// written to a buffer of the calling thread, which is overwritten by its next call
+inline const char* gamestring(GAME* game) {
+    if(game->mnk == NULL)
+        return boardtext.text[game->board];
+    static thread_local char text[MNKTEXTLEN];
+    variants[game->variant].text(game->mnk,text);
+    return text;
+}
+
+// function to make the move of player p at (r,c) on the board of game's variant. the results are those of makemove()
+int playmove(GAME* game, int p, int r, int c) {
+    int res = (game->mnk == NULL) ? makemove(&game->board,p,r,c) : variants[game->variant].play(game->mnk,p,r,c);
+    if(res >= 0)
+        game->status = res;
     return res;
 }
 
-// function to try placing symbol=sym at the position (r,c) in game_array=array
-// if (r,c) is not valid, -1 is returned.
-// else if (r,c) is already filled, -2 is returned.
-// otherwise, the move is made and a game over check is made.
-// if game is over, 1 is returned if 'X' won, 2 is returned if 'O' won and 3 is returned for a draw.
-// if game is not over, 0 is returned.
-int makemove(char array[3][3], char sym, int r, int c) {
+// function to tell whether conn owes its game no answer, i.e. its client isn't waiting for its user and can ack a
+// KEEP_ALIVE msg at once. only such connections are sent KEEP_ALIVE msgs
+bool idleconn(GAME* game, CONN* conn) {
+    if(conn->bot || conn->mux != NULL)
+        return false;                                               // the liveness of a seat is that of its multiplexed connection
+    if(game->state == GS_AWAITMOVE)
+        return conn->p != game->turn;
+    return game->state == GS_AWAITREPLAY && conn->choice != 0;
+}
 
-    // valid indices check
-    if(!(r>=0 && r<=2 && c>=0 && c<=2))
-        return -1;
-    // unfilled position check
-    if(array[r][c] != '_')
-        return -2;
-    // now, we place the sym at (r,c)
-    array[r][c] = sym;
-
-    // row win check
-    for(int a=0;a<3;++a)
-        if(array[a][0] != '_' && array[a][0] == array[a][1] && array[a][1] == array[a][2])
-            return array[a][0] == 'X' ? 1 : 2;
-    
-    // column win check
-    for(int a=0;a<3;++a)
-        if(array[0][a] != '_' && array[0][a] == array[1][a] && array[1][a] == array[2][a])
-            return array[0][a] == 'X' ? 1 : 2;
-    
-    // cross win check
-    if(array[0][0] != '_' && array[0][0] == array[1][1] && array[1][1] == array[2][2])
-        return array[0][0] == 'X' ? 1 : 2;
-    if(array[0][2] != '_' && array[0][2] == array[1][1] && array[1][1] == array[2][0])
-        return array[0][2] == 'X' ? 1 : 2;
-
-    // check for unfilled positions. if any exist, game is not over
-    nloop3(a,b) {
-        if(array[a][b] == '_') {
-            return 0;
-        }
+// function to get the time (in ms) at which the liveness of conn must be checked next. 0 -> never
+long long livecheck(GAME* game, CONN* conn) {
+    if(conn->ackwait > 0 && conn->heardus <= conn->pingus)
+        return conn->pingus / 1000 + ACKTIMEOUT * 1000LL;           // nothing heard since the last KEEP_ALIVE
+    if(idleconn(game,conn))
+        return conn->heardus / 1000 + IDLETIMEOUT * 1000LL;
+    return 0;
+}
+
+// function to set the timer of the game to the earlier of its deadline and the next liveness check of its
+// connections. the liveness checks only move forward when recved data makes them due later, so the timer may
+// go off early. checklive() then sets it again
+void armgame(GAME* game) {
+    long long wakeup = game->deadline;
+    for(int i=0;i<2 && game->state != GS_FINISHED;++i) {
+        long long t = livecheck(game,&game->conn[i]);
+        if(t != 0 && (wakeup == 0 || t < wakeup))
+            wakeup = t;
     }
-    return 3;                       // here, game is over and it is a draw.
+    game->wakeup = wakeup;
+    EVLOOP* loop = game->loop;
+    if(loop == NULL)
+        return;
+    if(wakeup == 0)
+        twcancel(&loop->wheel,&game->timer);
+    else
+        twadd(&loop->wheel,&game->timer,wakeup);
 }
 
-// most important function of the code. all threads execute this function after creation
-void playgame(struct GAME* game) {
+// function to make the game time out after tmout seconds from now. tmout = 0 removes the timeout
+void armtimer(GAME* game, int tmout) {
+    game->deadline = (tmout == 0) ? 0 : nowms() + tmout * 1000LL;
+    armgame(game);
+}
 
-    int r, c;                                   // r - row index, c - col index for a move
-    int moveres;                                // result of a move
-    bool redo;                                  // = true iff a move was invalid. the relevant player must try again 
-    char rbuffer[BUFLEN];                       // buffer to store recved data for a move
-    string msg, gamemsg;                        // msg - msg to send, gamemsg -  game status as a string
-    int movfd, nonmovfd;                        // movfd = conn fd of player who has to move and nonmovfd = conn fd of movfd-player's partner
-    char ch1[BUFLEN], ch2[BUFLEN];              // ch1 and ch2 store choices of player 1 and player 2 for the replay question
-    string ch1str, ch2str;                      // string eqvts of ch1 and ch2 buffers resp.
-    bool logged = false;                        // flag to indicate if a game has been logged already. useful for handling disconnects
-
-    // initialize the game with a new id, set game->turn = 1 and make the entire game array unfilled
-    initgame(game);
+// function to (re)register the fd of sp with the epoll instance of its loop. EPOLLOUT is asked for only while
+// updates wait in sp->queue
+void watchspec(SPECTATOR* sp, int op) {
+    bool wantout = !sp->queue.bufs.empty();
+    if(op == EPOLL_CTL_MOD && wantout == sp->outwatched)
+        return;
+    sp->outwatched = wantout;
+    epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP | (wantout ? (uint32_t)EPOLLOUT : 0);
+    ev.data.ptr = sp;
+    if(epoll_ctl(sp->loop->epfd,op,sp->fd,&ev) == -1) {
+        perror("ERROR - epoll_ctl failed.");
+    }
+}
 
-    // section to send player id, player symbol and game id msgs to both the players
-    msg = "Your partner's ID is "+to_string(game->pid2)+". Your symbol is 'X'.\nStarting the game with ID "+to_string(game->gameid)+" ...";
-    codesend(game->fd1,1,msg);
-    msg = "Connected to the game server. Your player ID is " + to_string(game->pid2) + ".\n";
-    codesend(game->fd2,1,msg);
-    msg = "Your partner's ID is "+to_string(game->pid1) + ". Your symbol is 'O'.\nStarting the game  with ID "+to_string(game->gameid)+" ...";
-    codesend(game->fd2,1,msg);
+// function to queue a frame of the given type with the payload text for sp only
+void specsend(SPECTATOR* sp, bool board, int type, const char* text) {
+    FANBUF* b = fanbuf(board,type,sp->watchid,text,strlen(text));
+    fanpush(&sp->queue,b);
+    fanrelease(b);
+}
 
-    // get starttime and clear the move sequence vector
-    game->starttime = time(NULL);
-    game->moveSeq.clear();
+// function to close the connection of sp and take it out of its game. events of sp may still be pending in the
+// current batch, so sp is freed only after it
+void dropspec(SPECTATOR* sp) {
+    vector<SPECTATOR*>& specs = sp->game->specs;
+    specs[sp->pos] = specs.back();
+    specs[sp->pos]->pos = sp->pos;
+    specs.pop_back();
+    fanclear(&sp->queue);
+    close(sp->fd);
+    sp->fd = -1;
+    freeslot();
+    sp->loop->gone.push_back(sp);
+}
 
-    while(1) {
-        // send game status messages to both the players
-        gamemsg = gamestring(game->array); codesend(game->fd1,1,gamemsg); codesend(game->fd2,1,gamemsg);
-        // find movfd and nonmovfd. tell non-move player that his partner is playing
-        nonmovfd = (game->turn == 1) ? game->fd2 : game->fd1;
-        movfd = (game->turn == 1) ? game->fd1 : game->fd2;
-        codesend(nonmovfd,1,"Your partner is playing now... ");
-        do {
-            // initially, we have no redo
-            redo = false;     
-            // if player 1 or player 2 is not alive, we have a disconnect and the game hasn't been logged
-            if(!alive(game->fd1,game->fd2)) {
-                logged = false; goto disconnect;
-            }
-            // prompt movfd for his move and wait for a response with timeout = MOVETIMEOUT
-            codesend(movfd,2,"Enter (ROW, COL) for placing your mark: ");
-            if (polledrecv(movfd,rbuffer,MOVETIMEOUT) < 0) {
-                // here, we have a timeout. so, send relevant msgs to both players, cause = 3 (inactivity),
-                // get endtime and jump to timed_out label
-                codesend(movfd,1,"You have run out of time.");
-                codesend(nonmovfd,1,"Your opponent has timed out.");
-                game->cause = 3;
-                game->endtime = time(NULL);
-                goto timed_out;
-            }
-            // get recved message and try to read integers r and c from it
-            string recvmsg((char*)rbuffer);
-            stringstream ss(recvmsg);
-            ss >> r >> c;
-            // if reading r and c has failed, we send a errmsg and ask the move player to try again
-            if(ss.fail()) {
-                redo = true;
-                string errmsg = "Invalid Move: Enter 2 valid indices in 3x3 array correctly. Try Again!!";
-                codesend(movfd,1,errmsg);
-                continue;
-            }
-            // try to fill (r,c) with movfd's symbol after converting them to 0-indexed form
-            moveres = makemove(game->array, game->turn == 1 ? 'X':'O', r-1, c-1);
-            if(moveres<0) {
-                // here, the move is invalid. we send a errmsg and ask the move player to try again
-                redo = true;
-                string errmsg;
-                if(moveres == -1)
-                    errmsg = "Invalid Move: Range Check failed. Enter indices in {1,2,3} only. Try Again!!"; 
-                else
-                    errmsg = "Invalid Move: Position Already filled. Try Again!!";
-                codesend(movfd,1,errmsg);
-            }
-        }while(redo);
-        // add the move to move sequence
-        game->moveSeq.push_back(GMOVE(game->turn,r,c));
+// function to send an update of the game to all of its spectators. the frame is encoded once and shared by
+// their queues. board = true -> the update is a board snapshot, which replaces an unsent older one
+void fanout(GAME* game, bool board, int type, const char* text) {
+    if(game->specs.empty())
+        return;
+    FANBUF* b = fanbuf(board,type,game->gameid,text,strlen(text));
+    for(SPECTATOR* sp : game->specs) {
+        fanpush(&sp->queue,b);
+    }
+    fanrelease(b);
+    game->fanned = true;
+}
 
-        if(moveres == 0) {  // here, the game is not over. so we switch turn and let the game continue
-            game->turn = 3 - game->turn;
+// function to send the updates queued for the spectators of the game. a spectator whose send failed or who is
+// more than FANMAXBYTES behind is dropped
+void flushspecs(GAME* game) {
+    game->fanned = false;
+    for(size_t i=0;i<game->specs.size();) {
+        SPECTATOR* sp = game->specs[i];
+        if(fanflush(sp->fd,&sp->queue) < 0) {
+            dropspec(sp);                                   // the last spectator is moved to i
+            continue;
         }
-        else {
-            // the game is over. So, we send game status msg to both players
-            gamemsg = gamestring(game->array); codesend(game->fd1,1,gamemsg); codesend(game->fd2,1,gamemsg);
+        if(sp->queue.bytes - sp->queue.off > FANMAXBYTES) {
+            mcount(M_SPECDROPS);
+            dropspec(sp);
+            continue;
+        }
+        watchspec(sp,EPOLL_CTL_MOD);
+        ++i;
+    }
+}
 
-            // if player 1 or player 2 is not alive, we have a disconnect and the game hasn't been logged
-            if(!alive(game->fd1,game->fd2)) {
-                logged = false; goto disconnect;
-            }
-            
-            // code to set cause and winner fields in the game. it also sets msg to an appropriate result msg
-            if(moveres == 1) {  
-                // player 1 won -> cause = 1, winner = 1
-                msg = "Player "+to_string(game->pid1)+" has won!!"; game->cause = 1; game->winner = 1;
-            }
-            else if(moveres == 2) { 
-                // player 2 won -> cause = 1, winner = 2
-                msg = "Player "+to_string(game->pid2)+" has won!!"; game->cause = 1; game->winner = 2;
-            }
-            else {
-                // game was a draw -> cause = 2
-                msg = "The game was a draw."; game->cause = 2;
-            }
-            // get endtime and send game result msgs to both players
-            game->endtime = time(NULL);
-            codesend(game->fd1,1,msg); codesend(game->fd2,1,msg);
-timed_out:
-            // log the game
-            logger(game);
-
-            // if player 1 or player 2 is not alive, we have a disconnect and the game has already been logged
-            if(!alive(game->fd1,game->fd2)) {
-                logged = true; goto disconnect;
-            }
+// function to handle an event of the connection of sp. msgs from a spectator are read and dropped
+void specevent(SPECTATOR* sp, uint32_t events) {
+    if((events & EPOLLOUT) && fanflush(sp->fd,&sp->queue) < 0) {
+        dropspec(sp);
+        return;
+    }
+    if(events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) {
+        char buf[INBUFLEN];
+        int ret;
+        while((ret = recv(sp->fd,buf,sizeof buf,MSG_DONTWAIT)) > 0)
+            caprecord(sp->capid,CK_DATA,sp->prompts,buf,ret);
+        if(ret == 0 || (ret < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+            caprecord(sp->capid,CK_CLOSE,sp->prompts);
+            dropspec(sp);
+            return;
+        }
+    }
+    watchspec(sp,EPOLL_CTL_MOD);
+}
 
-            // send replay msg to both the players
-            msg = "Do you want to replay(YES|NO)?"; codesend(game->fd1,2,msg); codesend(game->fd2,2,msg);
+// function to let sp watch the game it asked for, if that game is still live in loop. sp first gets who plays
+// the game and the current board. otherwise, it is told so and closed
+void attachspec(EVLOOP* loop, SPECTATOR* sp) {
+    sp->loop = loop;
+    auto it = loop->games.find(sp->watchid);
+    char msg[BUFLEN];
+    if(it == loop->games.end() || it->second->state == GS_FINISHED) {
+        snprintf(msg,BUFLEN,"The game with ID %u is over.",sp->watchid);
+        specsend(sp,false,T_PRINT,msg);
+        specsend(sp,false,T_GAMEOVER,"");
+        fanflush(sp->fd,&sp->queue);
+        fanclear(&sp->queue);
+        close(sp->fd);
+        freeslot();
+        delete sp;
+        return;
+    }
+    GAME* game = it->second;
+    sp->game = game;
+    sp->pos = game->specs.size();
+    game->specs.push_back(sp);
+    mcount(M_SPECJOINS);
+    snprintf(msg,BUFLEN,"Watching the game with ID %u: player %u ('X') vs player %u ('O')",game->gameid,game->pid1,game->pid2);
+    specsend(sp,false,T_PRINT,msg);
+    specsend(sp,true,T_PRINT,gamestring(game));
+    watchspec(sp,EPOLL_CTL_ADD);
+    specevent(sp,EPOLLOUT);
+}
 
-            // wait for replay response from both players. if there is no response within CHTIMEOUT,
-            // it is assumed that we have a disconnect and the game has already been logged
-            if(polledrecv(game->fd1,ch1,CHTIMEOUT) < 0|| polledrecv(game->fd2,ch2,CHTIMEOUT) < 0) {
-                logged = true; goto disconnect;
-            }
+// the functions below make up the state machine of a game. each of them is called when something the
+// game was waiting for has happened, sends the msgs that the players must get next and then leaves the
+// game waiting for the next thing. both the thread per game mode and the event loop mode drive games
+// through these functions, so the rules and the log are the same in both modes.
 
-            ch1str = ch1; ch2str = ch2;
-            // start a new game iff both players respond "YES"
-            if(ch1str == "YES" && ch2str == "YES") {
-                // initialize the game with a new id, set game->turn = 1 and make the entire game array unfilled
-                initgame(game);
-                // send game id msg to both players
-                string idmsg = "Starting a new game with ID "+to_string(game->gameid)+" ...";
-                codesend(game->fd1,1,idmsg); codesend(game->fd2,1,idmsg);
-                // get starttime and clear the move sequence vector
-                game->starttime = time(NULL);
-                game->moveSeq.clear();
-            }
-            else {
-                // send no replay msg to both players and goto finish for terminating this thread
-                string endmsg = "No Replay... Session Over";
-                codesend(game->fd1,1,endmsg); codesend(game->fd2,1,endmsg);
-                goto finish;
-            }
-        }
+// function to finish the game. it sends the connection termination(code - 3 msg) to both players
+// in order to make them finish execution. the connections are closed by whoever drives the game
+void finishgame(GAME* game) {
+    for(int i=0;i<2;++i) {
+        if(game->conn[i].mux != NULL)
+            unlistseat(&game->conn[i]);
     }
+    codesend(&game->conn[0],3,""); codesend(&game->conn[1],3,"");
+    fanout(game,false,T_GAMEOVER,"");
+    game->state = GS_FINISHED;
+    armtimer(game,0);
+}
 
-disconnect:
+// function to handle a disconnected player (unanswered KEEP_ALIVE, closed connection, failed send or no REPLAY choice)
+void disconnectgame(GAME* game) {
     // send disconnect msg to both players( only the connected player will recv it)
-    codesend(game->fd1,1,"Sorry, Your partner disconnected! "); codesend(game->fd2,1,"Sorry, Your partner disconnected! ");
-    if(!logged) {
+    codesend(&game->conn[0],1,"Sorry, Your partner disconnected! "); codesend(&game->conn[1],1,"Sorry, Your partner disconnected! ");
+    fanout(game,false,T_PRINT,"A player disconnected.");
+    if(game->state == GS_AWAITMOVE)
+        trace(TR_WAITMOVE,TP_ASYNCEND,game->gameid);
+    if(!game->logged) {
         // if the game hasn't been logged, set cause = 4(disconnection), get endtime and log the game
         game->cause = 4;
         game->endtime = time(NULL);
         logger(game);
+        recordgame(game);
+        game->logged = true;
     }
+    finishgame(game);
+}
 
-finish:
-    // send connection termination(code - 3 msg) to both players in order to make them finish execution
-    codesend(game->fd1,3,""); codesend(game->fd2,3,"");
-    // close the conn fds of both players, update activeplayers and free the heap memory of game
-    close(game->fd1); close(game->fd2);
-    activeplayers -= 2;
-    delete game;
+// function to check the liveness of the players of the game. a player is alive as long as anything is heard from
+// it. a player who owes no answer and has been silent for IDLETIMEOUT s is sent a KEEP_ALIVE msg. if nothing
+// is heard from it within ACKTIMEOUT s after that, we have a disconnect. dead peers that were asked for a move or
+// a choice are caught by the kernel (see tunesocket()) or by the timeout of the question
+void checklive(GAME* game) {
+    long long now = nowus();
+    uint gameid = game->gameid;
+    trace(TR_CHECKLIVE,TP_BEGIN,gameid);
+    for(int i=0;i<2;++i) {
+        CONN* conn = &game->conn[i];
+        if(conn->ackwait > 0 && conn->heardus <= conn->pingus) {
+            if(now >= conn->pingus + ACKTIMEOUT * 1000000LL) {
+                disconnectgame(game);
+                trace(TR_CHECKLIVE,TP_END,gameid);
+                return;
+            }
+        }
+        else if(idleconn(game,conn) && now >= conn->heardus + IDLETIMEOUT * 1000000LL) {
+            conn->pingus = now;
+            ++conn->ackwait;
+            trace(TR_KEEPALIVE,TP_INSTANT,gameid);
+            if(codesend(conn,0,"ARE YOU ALIVE?") < 0) {
+                disconnectgame(game);
+                trace(TR_CHECKLIVE,TP_END,gameid);
+                return;
+            }
+        }
+    }
+    armgame(game);
+    trace(TR_CHECKLIVE,TP_END,gameid);
 }
 
-// function to accept a new player connection, assign the player 
-// an id and return the pair (connection fd, player id)
-// returns (-1,0) if accept() fails
-pair<int,uint> acceptplayers() {
-    int connfd;
-    if((connfd = accept(sockfd,NULL,NULL)) == -1) {
-        printf("ERROR: accept connection failed\n");
-        return pair<int,uint>(-1,0);                    // failed accept
+// function to make every msg to the players of the game wait in their outbufs till uncorkgame(). the drivers of
+// a game cork it while it handles an event, so all the msgs of a turn go to a player with one send()
+void corkgame(GAME* game) {
+    game->conn[0].corked = game->conn[1].corked = true;
+}
+
+// function to send the msgs queued since corkgame()
+void uncorkgame(GAME* game) {
+    for(int i=0;i<2;++i) {
+        CONN* conn = &game->conn[i];
+        conn->corked = false;
+        if(conn->bot || conn->outbuf.empty())
+            continue;
+        if(flushconn(conn) < 0 && game->state != GS_FINISHED)
+            disconnectgame(game);
     }
-    ++activeplayers;                                    // update num of active players
-    uint playerid = pidcounter++;                       // assign id
-    return pair<int,uint> {connfd,playerid};
+    if(game->fanned)
+        flushspecs(game);
 }
 
-int main(int argc, char** argv) {
+void botreply(GAME* game);
 
-    if(argc != 2) {
-        cout << "Usage: ./gameserver [PORT TO RUN SERVER ON]";
-        exit(-1);
+void promptmove(GAME* game);
+
+// function to send the game board to both players and the spectators. compact clients get a T_MOVE frame with
+// the last move (or a new game) and keep the board themselves. the others get the game status text
+void sendboard(GAME* game) {
+    const char* gamemsg = gamestring(game);
+    fanout(game,true,T_PRINT,gamemsg);
+    for(int i=0;i<2;++i) {
+        CONN* conn = &game->conn[i];
+        if(!conn->compact) {
+            codesend(conn,1,gamemsg);
+            continue;
+        }
+        MOVEUPDATE u = {0,0,0,game->status,(uint8_t)conn->p};
+        if(!game->moveSeq.empty()) {
+            const GMOVE& m = game->moveSeq.back();
+            u.p = m.p; u.r = m.r; u.c = m.c;
+        }
+        framesend(conn,T_MOVE,&u,sizeof u);
     }
+}
 
-    struct sockaddr_in servaddr;                        // internet address of server 
-    memset(&servaddr,0,sizeof servaddr);                // zero out servaddr
-    servaddr.sin_family = AF_INET;                      // use IPv4 address family
-    servaddr.sin_port = htons((short)atoi(MYPORT));     // set server's port number
-    servaddr.sin_addr.s_addr = INADDR_ANY;              // use the ip address of the current machine
+// function to start a turn. it sends game status messages to both the players, tells the non-move
+// player that his partner is playing (compact clients work that out themselves) and prompts the
+// move player for his move
+void beginturn(GAME* game) {
+    sendboard(game);
+    CONN* other = &game->conn[2 - game->turn];
+    if(!other->compact)
+        codesend(other,1,"Your partner is playing now... ");
+    promptmove(game);
+}
 
-    // socket creation with domain as IPv4 family, type as STREAM socket and protocol as 
-    // 0 (choose any protocol that supports SOCK_STREAM type)
-    if((sockfd = socket(AF_INET,SOCK_STREAM,0)) == -1) {
-        perror("ERROR - socket creation failed"); exit(-1);
+// function to start a game with a new id and send player id, player symbol and game id msgs to both the players
+void startgame(GAME* game) {
+    // initialize the game with a new id, set game->turn = 1 and make the entire game board unfilled
+    initgame(game);
+    trace(TR_GAME,TP_ASYNCBEGIN,game->gameid);
+
+    char msg[BUFLEN];
+    snprintf(msg,BUFLEN,"Your partner's ID is %u. Your symbol is 'X'.\nStarting the game with ID %u ...",game->pid2,game->gameid);
+    codesend(&game->conn[0],1,msg);
+    snprintf(msg,BUFLEN,"Connected to the game server. Your player ID is %u.\n",game->pid2);
+    codesend(&game->conn[1],1,msg);
+    snprintf(msg,BUFLEN,"Your partner's ID is %u. Your symbol is 'O'.\nStarting the game  with ID %u ...",game->pid1,game->gameid);
+    codesend(&game->conn[1],1,msg);
+    if(game->variant != 0) {
+        const VARIANT* v = &variants[game->variant];
+        snprintf(msg,BUFLEN,"The board has %d rows and %d cols. %d in a row wins.",v->m,v->n,v->k);
+        codesend(&game->conn[0],1,msg); codesend(&game->conn[1],1,msg);
     }
 
-    // change the socket to allow reuse of ip address and the port number
-    int yes = 1;
-    if(setsockopt(sockfd,SOL_SOCKET,SO_REUSEADDR|SO_REUSEPORT,&yes,sizeof yes) == -1) {
-        perror("ERROR - socket reuse failed"); exit(-1);
+    // get starttime and clear the move sequence vector
+    game->starttime = time(NULL);
+    game->moveSeq.clear();
+    beginturn(game);
+}
+
+void askreplay(GAME* game);
+
+// function to log a completed game and ask both players the REPLAY question
+void loggame(GAME* game) {
+    logger(game);
+    recordgame(game);
+    game->logged = true;
+    askreplay(game);
+}
+
+// function to handle a player who didn't make a move within MOVETIMEOUT. relevant msgs are sent to
+// both players and the game is logged with cause = 3 (inactivity)
+void movetimeout(GAME* game) {
+    trace(TR_WAITMOVE,TP_ASYNCEND,game->gameid);
+    codesend(&game->conn[game->turn - 1],1,"You have run out of time.");
+    codesend(&game->conn[2 - game->turn],1,"Your opponent has timed out.");
+    char msg[BUFLEN];
+    snprintf(msg,BUFLEN,"Player %u has run out of time.",game->turn == 1 ? game->pid1 : game->pid2);
+    fanout(game,false,T_PRINT,msg);
+    game->cause = 3;
+    game->endtime = time(NULL);
+    loggame(game);
+}
+
+// function to handle the timer of the game. it is either the expiry of the current wait or a liveness check
+void gametimeout(GAME* game) {
+    if(game->deadline == 0 || nowms() < game->deadline) {
+        checklive(game);
+        return;
+    }
+    game->deadline = 0;
+    if(game->state == GS_AWAITMOVE) {
+        movetimeout(game);
+    }
+    else {
+        // a missing REPLAY choice means that we have a disconnect
+        disconnectgame(game);
     }
+}
 
-    // bind the socket to servaddr
-    if(bind(sockfd, (struct sockaddr*)&servaddr, sizeof servaddr) != 0) {
-        perror("ERROR - binding of socket failed"); exit(-1);
+// function to update the ratings of both players after a won or drawn game. the ratings of named players are
+// remembered for their next games
+void rategame(GAME* game) {
+    CONN* c1 = &game->conn[0];
+    CONN* c2 = &game->conn[1];
+    double score = (game->cause == 2) ? 0.5 : (game->winner == 1 ? 1.0 : 0.0);
+    int r1 = c1->mm.rating, r2 = c2->mm.rating;
+    eloupdate(&c1->mm.rating,&c2->mm.rating,score);
+    c1->mm.rating = addrating(c1->name,r1,c1->mm.rating - r1);
+    c2->mm.rating = addrating(c2->name,r2,c2->mm.rating - r2);
+}
+
+// function to send the game result msgs to both players of a completed game and log it
+void sendresult(GAME* game) {
+    char msg[BUFLEN];
+    if(game->cause == 1) {
+        snprintf(msg,BUFLEN,"Player %u has won!!",game->winner == 1 ? game->pid1 : game->pid2);
+    }
+    else {
+        snprintf(msg,BUFLEN,"The game was a draw.");
     }
+    // get endtime and send game result msgs to both players
+    game->endtime = time(NULL);
+    codesend(&game->conn[0],1,msg); codesend(&game->conn[1],1,msg);
+    fanout(game,false,T_PRINT,msg);
+    rategame(game);
+    loggame(game);
+}
 
-    // listen for incoming connect requests
-    if(listen(sockfd,BACKLOG) != 0) {
-        perror("ERROR - listen failed"); exit(-1);
+// function to prompt the player with the turn for his move and wait for a response with timeout = MOVETIMEOUT.
+// compact clients print the prompt text themselves
+void promptmove(GAME* game) {
+    CONN* movconn = &game->conn[game->turn - 1];
+    if(codesend(movconn,2,movconn->compact ? "" : MOVEPROMPT) < 0) {
+        disconnectgame(game); return;
+    }
+    game->promptus = nowus();
+    game->state = GS_AWAITMOVE;
+    trace(TR_WAITMOVE,TP_ASYNCBEGIN,game->gameid);
+    armtimer(game,MOVETIMEOUT);
+    botreply(game);
+}
+
+// function to handle a move msg from the player with the turn
+void onmove(GAME* game, char* rbuffer) {
+    int r, c;                                   // r - row index, c - col index for a move
+    CONN* movconn = &game->conn[game->turn - 1];
+    armtimer(game,0);
+    if(!movconn->bot)
+        mrecord(H_MOVE,nowus() - game->promptus);
+
+    // try to read integers r and c from the recved message.
+    // if reading r and c has failed, we send a errmsg and ask the move player to try again
+    const VARIANT* v = &variants[game->variant];
+    char errmsg[BUFLEN];
+    if(!parsemove(rbuffer,&r,&c)) {
+        snprintf(errmsg,BUFLEN,"Invalid Move: Enter 2 valid indices in %dx%d array correctly. Try Again!!",v->m,v->n);
+        codesend(movconn,1,errmsg);
+        mcount(M_INVALIDMOVES);
+        promptmove(game);
+        return;
+    }
+    // try to fill (r,c) with movfd's symbol after converting them to 0-indexed form
+    int moveres = playmove(game, game->turn, r-1, c-1);
+    if(moveres < 0) {
+        // here, the move is invalid. we send a errmsg and ask the move player to try again
+        if(moveres == -1 && game->variant == 0)
+            codesend(movconn,1,"Invalid Move: Range Check failed. Enter indices in {1,2,3} only. Try Again!!");
+        else if(moveres == -1) {
+            snprintf(errmsg,BUFLEN,"Invalid Move: Range Check failed. Enter ROW in 1-%d and COL in 1-%d only. Try Again!!",v->m,v->n);
+            codesend(movconn,1,errmsg);
+        }
+        else
+            codesend(movconn,1,"Invalid Move: Position Already filled. Try Again!!");
+        mcount(M_INVALIDMOVES);
+        promptmove(game);
+        return;
+    }
+    // add the move to move sequence
+    mcount(M_MOVES);
+    game->moveSeq.push_back(GMOVE(game->turn,r,c));
+
+    if(moveres == 0) {  // here, the game is not over. so we switch turn and let the game continue
+        game->turn = 3 - game->turn;
+        beginturn(game);
+        return;
+    }
+    // set cause and winner fields in the game. player 1 or 2 won -> cause = 1, winner = moveres.
+    // game was a draw -> cause = 2
+    if(moveres == 3) {
+        game->cause = 2;
     }
     else {
-        cout << "Game server started. Waiting for players ... " << endl;
+        game->cause = 1; game->winner = moveres;
     }
+    // the game is over. So, we send game status msg and the result to both players
+    sendboard(game);
+    sendresult(game);
+}
 
-    // create an empty LOGFILE
-    ofstream f; f.open(LOGFILE); f.close();
+// function to send the REPLAY question to both players and wait for their choices. both players
+// make their choices at the same time and both choices must arrive within CHTIMEOUT seconds
+void askreplay(GAME* game) {
+    int r1 = codesend(&game->conn[0],2,REPLAYPROMPT);
+    int r2 = codesend(&game->conn[1],2,REPLAYPROMPT);
+    if(r1 < 0 || r2 < 0) {
+        disconnectgame(game); return;
+    }
+    game->conn[0].choice = game->conn[1].choice = 0;
+    game->state = GS_AWAITREPLAY;
+    armtimer(game,CHTIMEOUT);
+    botreply(game);
+}
 
-    // initialize the global atomic variables appropriately. Both game and player ids start with 1 
-    // and there are no active players initially
-    pidcounter = 1; gidcounter = 1;
-    activeplayers = 0;
+// function to handle the REPLAY choice of the player of conn
+void onchoice(GAME* game, CONN* conn, char* ch) {
+    conn->choice = (strcmp(ch,"YES") == 0) ? 1 : 2;
+    if(game->conn[0].choice == 0 || game->conn[1].choice == 0) {
+        armgame(game);                                      // conn owes no answer now. so, its liveness is checked
+        return;
+    }
+    armtimer(game,0);
+    // start a new game iff both players respond "YES"
+    if(game->conn[0].choice == 1 && game->conn[1].choice == 1) {
+        // initialize the game with a new id, set game->turn = 1 and make the entire game board unfilled
+        initgame(game);
+        // send game id msg to both players
+        char idmsg[BUFLEN];
+        snprintf(idmsg,BUFLEN,"Starting a new game with ID %u ...",game->gameid);
+        codesend(&game->conn[0],1,idmsg); codesend(&game->conn[1],1,idmsg);
+        fanout(game,false,T_PRINT,idmsg);
+        // get starttime and clear the move sequence vector
+        game->starttime = time(NULL);
+        game->moveSeq.clear();
+        beginturn(game);
+    }
+    else {
+        // send no replay msg to both players and finish the game
+        const char* endmsg = "No Replay... Session Over";
+        codesend(&game->conn[0],1,endmsg); codesend(&game->conn[1],1,endmsg);
+        fanout(game,false,T_PRINT,endmsg);
+        finishgame(game);
+    }
+}
 
-    struct GAME* game;                  // pointer to a newly allocated game
-    bool waiting = false;               // true iff there is a player waiting for a partner
-    int waitfd;                         // waiting player's connection fd
-    uint waitpid;                       // waiting player's id
-    while(1) {
-        // accept more players only when activeplayers < MAX_PLAYERS
-        if(activeplayers.load() < MAX_PLAYERS) {
-            pair<int,uint> p = acceptplayers();
-            // catch failed accept
-            if(p.first == -1)
-                continue;
-            if(waiting) {
-                // here, we can start a new game with the waiting player as player 1 and the
-                // newly accepted player as player 2
-                game = new GAME();                                      // alloc a new game
-                game->fd1 = waitfd; game->fd2 = p.first;                // set conn fds for the new game
-                game->pid1 = waitpid; game->pid2 = p.second;            // set player ids for the new game
-                // create a thread that will execute playgame function with argument as game and detach the thread for independent execution
-                thread newth(playgame,game);
-                newth.detach();
-                waiting = false;                                        // there is no one waiting now
-            }
-            else {
-                // here, the new player has to wait for a partner. so, update waiting, waitconnfd and waitingpid
-                waiting = true;
-                waitfd = p.first;
-                waitpid = p.second;
-                // send a "connected and waiting" msg to the waiting player.
-                string msg = "Connected to the game server. Your player ID is " + to_string(waitpid) + ". Waiting for a partner to join...";
-                codesend(waitfd,1,msg);
-            }
+// function to answer a T_QUERY from conn with the leaderboard or the player's own record. the prompt the player
+// still owes an answer to is sent again after the answer. the timeout of the prompt stays as it was
+void onquery(GAME* game, CONN* conn, const char* query) {
+    mcount(M_QUERIES);
+    string text;
+    PLAYERREC rec;
+    if(strcmp(query,QUERYTOP) == 0) {
+        leaderboardtext(text);
+    }
+    else if(statsof(conn->name,conn->pid,&rec)) {
+        char msg[BUFLEN*2];
+        snprintf(msg,sizeof msg,"Your record: %u games, %u wins, %u losses, %u draws, %u timeouts, %u disconnects. Rating: %d",
+                 rec.games,rec.wins,rec.losses,rec.draws,rec.timeouts,rec.disconnects,conn->mm.rating);
+        text = msg;
+    }
+    else {
+        text = "You haven't finished a game yet. Rating: " + to_string(conn->mm.rating);
+    }
+    codesend(conn,1,text.c_str());
+    if(game->state == GS_AWAITMOVE && conn->p == game->turn)
+        codesend(conn,2,conn->compact ? "" : MOVEPROMPT);
+    else if(game->state == GS_AWAITREPLAY && conn->choice == 0)
+        codesend(conn,2,REPLAYPROMPT);
+}
+
+// function to handle a complete msg of the given type recved from conn based on what its game is waiting for.
+// msgs that the game isn't waiting for are dropped
+void onmessage(CONN* conn, int type, char* msg) {
+    GAME* game = conn->game;
+    // an ack of a KEEP_ALIVE msg is a T_ACK frame (framed clients) or "I_AM_ALIVE" (legacy clients). it only
+    // proves that the client is alive, like everything recved from it (see recvconn())
+    if(type == T_ACK || (conn->proto == PROTO_LEGACY && conn->ackwait > 0 && strcmp(ackbuffer,msg) == 0)) {
+        if(conn->ackwait > 0) {
+            --conn->ackwait;
+            mrecord(H_HEARTBEAT,nowus() - conn->pingus);
+            trace(TR_ACK,TP_INSTANT,game->gameid);
         }
     }
-    return 0;
-}
\ No newline at end of file
+    else if(type == T_QUERY) {
+        onquery(game,conn,msg);
+    }
+    else if(type != T_INPUT) {
+        return;
+    }
+    else if(game->state == GS_AWAITMOVE && conn->p == game->turn) {
+        // the move ends the wait. the span of the move holds the whole turn it starts (the bot's reply too)
+        uint gameid = game->gameid;
+        trace(TR_WAITMOVE,TP_ASYNCEND,gameid);
+        trace(TR_MOVE,TP_BEGIN,gameid);
+        onmove(game,msg);
+        trace(TR_MOVE,TP_END,gameid);
+    }
+    else if(game->state == GS_AWAITREPLAY && conn->choice == 0) {
+        onchoice(game,conn,msg);
+    }
+}
+
+// function to pick the move of the bot (player p) in game. with probability botlevel% the move is one of the best moves
+// of playtable, otherwise it is any unfilled position. on the boards of other variants, the better move is a win, a
+// block or a move next to a filled cell (see mnkpick()). returns the cell (nr + c on a board of n cols) of the move
+int botmove(GAME* game, int p) {
+    static thread_local mt19937 rng(random_device{}());
+    bool smart = (int)(rng() % 100) < botlevel;
+    if(game->mnk != NULL)
+        return variants[game->variant].pick(game->mnk,p,smart,rng());
+    uint16_t board = game->board;
+    uint16_t moves = smart ? playtable.info[board].best : boardtable.info[board].unfilled;
+    for(int pick = rng() % __builtin_popcount(moves);pick > 0;--pick)
+        moves &= moves - 1;                                 // drop the lowest possible move
+    return __builtin_ctz(moves);
+}
+
+// function to let the bot answer whatever its game is waiting for from it. the bot is always player 2. its
+// answers go through onmessage() like the msgs of a client, so bot games follow the same rules. the bot
+// always wants a replay
+void botreply(GAME* game) {
+    CONN* bot = &game->conn[1];
+    if(!bot->bot)
+        return;
+    char msg[BUFLEN+1];
+    if(game->state == GS_AWAITMOVE && game->turn == bot->p) {
+        int n = variants[game->variant].n;
+        int cell = botmove(game,bot->p);
+        snprintf(msg,sizeof msg,"%d %d",cell/n + 1,cell%n + 1);
+        onmessage(bot,T_INPUT,msg);
+    }
+    else if(game->state == GS_AWAITREPLAY && bot->choice == 0) {
+        strcpy(msg,"YES");
+        onmessage(bot,T_INPUT,msg);
+    }
+}
+
+// function to handle every complete msg in conn->inbuf and then read all the data available at conn without
+// blocking and handle every complete msg in it. a closed connection, a recv error or a broken protocol is
+// handled as a disconnect
+void readconn(CONN* conn) {
+    if(conn->bot || conn->mux != NULL)
+        return;                                         // the lobby of a seat's multiplexed connection reads it
+    GAME* game = conn->game;
+    char msg[BUFLEN+1];
+    int type, ret = 1;
+    while(game->state != GS_FINISHED && ret > 0) {
+        int got;
+        while((got = takemsg(conn,&type,msg)) > 0 && game->state != GS_FINISHED) {
+            onmessage(conn,type,msg);
+        }
+        if(game->state == GS_FINISHED)
+            return;
+        if(got < 0 || (ret = recvconn(conn)) < 0) {
+            armtimer(game,0);
+            disconnectgame(game);
+            return;
+        }
+    }
+}
+
+// function to close the connections of a finished game and of its spectators, update activeplayers and free the
+// heap memory of game. a seat gives up its reference to its multiplexed connection instead of closing a fd
+void freegame(GAME* game) {
+    for(int i=0;i<2;++i) {
+        if(game->conn[i].bot)
+            continue;
+        flushconn(&game->conn[i]);
+        if(game->conn[i].mux != NULL) {
+            game->loop->seats.erase(game->conn[i].seatkey);
+            unrefmux(game->conn[i].mux);
+        }
+        else {
+            close(game->conn[i].fd);
+        }
+        freeslot();
+        if(game->conn[i].name[0] == '\0')
+            statsforget(game->conn[i].pid);                             // the record of an anonymous player ends with its session
+    }
+    for(SPECTATOR* sp : game->specs) {
+        fanflush(sp->fd,&sp->queue);
+        fanclear(&sp->queue);
+        close(sp->fd);
+        freeslot();
+        delete sp;
+    }
+    if(game->loop != NULL)
+        relistgame(game,game->gameid,0);
+    mcount(M_SESSIONSFREED);
+    delete[] (char*)game->mnk;
+    delete game;
+}
+
+// function executed by the thread of a game in the thread per game mode. it waits for msgs from both
+// players and for the timeout of the game and feeds them to the game's state machine till the game finishes
+void playgame(struct GAME* game) {
+    tracethread("game thread");
+    corkgame(game);
+    startgame(game);
+    // msgs that came along with the protocol negotiation haven't been handled yet
+    for(int i=0;i<2 && game->state != GS_FINISHED;++i) {
+        readconn(&game->conn[i]);
+    }
+    uncorkgame(game);
+    while(game->state != GS_FINISHED) {
+        pollfd pfds[2];
+        for(int i=0;i<2;++i) {
+            pfds[i] = {.fd=game->conn[i].fd,.events=POLLIN,.revents=0};
+        }
+        int tmout = (game->wakeup == 0) ? -1 : (int)max(0LL,game->wakeup - nowms());
+        trace(TR_POLL,TP_BEGIN,game->gameid);
+        if(poll(pfds,2,tmout) < 0 && errno != EINTR) {
+            perror("ERROR - poll failed.");
+        }
+        trace(TR_POLL,TP_END,game->gameid);
+        corkgame(game);
+        for(int i=0;i<2 && game->state != GS_FINISHED;++i) {
+            if(pfds[i].revents != 0)
+                readconn(&game->conn[i]);
+        }
+        if(game->state != GS_FINISHED && game->wakeup != 0 && nowms() >= game->wakeup) {
+            gametimeout(game);
+        }
+        uncorkgame(game);
+    }
+    freegame(game);
+}
+
+// function to go on with a game handed over by an older server (see takeover()). its timer is armed again, the msgs the
+// old server couldn't send yet go out and the msgs that came in meanwhile are handled
+void resumegame(GAME* game) {
+    game->resumed = false;
+    relistgame(game,0,game->gameid);
+    corkgame(game);
+    armgame(game);
+    for(int j=0;j<2 && game->state != GS_FINISHED;++j) {
+        readconn(&game->conn[j]);
+    }
+    uncorkgame(game);
+}
+
+// function to take what the lobbies have handed over to loop: new games, spectators and msgs for seats. the connections
+// of the games are registered and the games are started (or resumed). the msgs come last, since they may be for the
+// seats of the new games. games that finish here are added to finished
+void takehandovers(EVLOOP* loop, vector<GAME*>& finished, vector<MUXINPUT>& inputs) {
+    uint64_t cnt;
+    read(loop->evfd,&cnt,sizeof cnt);
+    vector<GAME*> games;
+    vector<SPECTATOR*> specs;
+    loop->newgames_mutex.lock();
+    games.swap(loop->newgames);
+    specs.swap(loop->newspecs);
+    inputs.swap(loop->muxinputs);
+    loop->newgames_mutex.unlock();
+    for(GAME* game : games) {
+        for(int j=0;j<2;++j) {
+            if(game->conn[j].mux != NULL)
+                loop->seats[game->conn[j].seatkey] = &game->conn[j];
+            else if(!game->conn[j].bot)
+                watchconn(&game->conn[j],EPOLL_CTL_ADD);
+        }
+        if(game->resumed) {
+            resumegame(game);
+        }
+        else {
+            corkgame(game);
+            startgame(game);
+            for(int j=0;j<2 && game->state != GS_FINISHED;++j) {
+                readconn(&game->conn[j]);
+            }
+            uncorkgame(game);
+        }
+        if(game->state == GS_FINISHED)
+            finished.push_back(game);
+    }
+    for(SPECTATOR* sp : specs) {
+        attachspec(loop,sp);
+    }
+    for(MUXINPUT& in : inputs) {
+        auto it = loop->seats.find(in.key);
+        if(it == loop->seats.end())
+            continue;                       // the game of the seat is over
+        GAME* game = it->second->game;
+        if(game->state == GS_FINISHED)
+            continue;
+        corkgame(game);
+        if(in.type == MUXGONE)
+            disconnectgame(game);
+        else
+            onmessage(it->second,in.type,in.msg);
+        uncorkgame(game);
+        if(game->state == GS_FINISHED)
+            finished.push_back(game);
+    }
+    inputs.clear();
+}
+
+// function to stop the calling lobby or event loop thread for a handoff to a new server (see handoff()). it comes
+// back only if the new server hasn't taken over
+void parkthread() {
+    unique_lock<mutex> guard(parklock);
+    ++parked;
+    parkcv.notify_all();
+    parkcv.wait(guard,[]{ return upgradestage.load() == 0; });
+    --parked;
+    parkcv.notify_all();
+}
+
+// function executed by an event loop thread. it waits on the epoll instance of the loop for msgs from the
+// players of all the games owned by the loop and fires the timeouts of those games when they expire
+void runloop(EVLOOP* loop) {
+    tracethread("loop " + to_string(loop - loops));
+    epoll_event evs[MAXEVENTS];
+    vector<GAME*> finished;                     // games that finished while handling the current batch of events
+    vector<MUXINPUT> inputs;
+    while(1) {
+        if(upgradestage.load() == 2) {
+            // the lobbies have stopped. whatever they handed over before is taken, so that it goes to the new server
+            takehandovers(loop,finished,inputs);
+            for(GAME* game : finished) {
+                freegame(game);
+            }
+            finished.clear();
+            parkthread();
+        }
+        int tmout = twtimeout(&loop->wheel,nowms());
+        int n = epoll_wait(loop->epfd,evs,MAXEVENTS,tmout);
+        if(n < 0 && errno != EINTR) {
+            perror("ERROR - epoll_wait failed.");
+        }
+        for(int i=0;i<n;++i) {
+            if(evs[i].data.ptr == NULL) {
+                takehandovers(loop,finished,inputs);
+                continue;
+            }
+            CONN* conn = (CONN*)evs[i].data.ptr;
+            if(conn->spectator) {
+                if(conn->fd != -1)
+                    specevent(static_cast<SPECTATOR*>(conn),evs[i].events);
+                continue;
+            }
+            GAME* game = conn->game;
+            if(game->state == GS_FINISHED)
+                continue;
+            corkgame(game);
+            if((evs[i].events & EPOLLOUT) && flushconn(conn) < 0) {
+                disconnectgame(game);
+            }
+            else if(evs[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) {
+                readconn(conn);
+            }
+            uncorkgame(game);
+            if(game->state == GS_FINISHED)
+                finished.push_back(game);
+        }
+        // fire all the expired timeouts
+        long long now = nowms();
+        TIMER* timer;
+        while((timer = twexpired(&loop->wheel,now)) != NULL) {
+            GAME* game = (GAME*)timer->data;
+            corkgame(game);
+            gametimeout(game);
+            uncorkgame(game);
+            if(game->state == GS_FINISHED)
+                finished.push_back(game);
+        }
+        for(GAME* game : finished) {
+            freegame(game);
+        }
+        finished.clear();
+        for(CONN* conn : loop->gone) {
+            delete static_cast<SPECTATOR*>(conn);
+        }
+        loop->gone.clear();
+    }
+}
+
+// function to pin the thread th to cpu num (modulo the num of cpus) if threads are to be pinned
+void pinthread(pthread_t th, int num) {
+    if(!pinthreads)
+        return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(num % thread::hardware_concurrency(),&set);
+    if(pthread_setaffinity_np(th,sizeof set,&set) != 0) {
+        printf("ERROR: pinning a thread to cpu %u failed\n",num % thread::hardware_concurrency());
+    }
+}
+
+// function to create an event loop with no fds in it
+void initloop(EVLOOP* loop) {
+    twinit(&loop->wheel,nowms());
+    if((loop->epfd = epoll_create1(0)) == -1 || (loop->evfd = eventfd(0,EFD_NONBLOCK)) == -1) {
+        perror("ERROR - event loop creation failed"); exit(-1);
+    }
+}
+
+// function to raise the limit on open fds as far as allowed, since every player needs a fd
+void raisefdlimit() {
+    rlimit lim;
+    if(getrlimit(RLIMIT_NOFILE,&lim) == 0) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE,&lim);
+    }
+}
+
+// function to create numloops event loops and a thread for each of them
+void startloops() {
+    raisefdlimit();
+    loops = new EVLOOP[numloops]();
+    for(int i=0;i<numloops;++i) {
+        EVLOOP* loop = &loops[i];
+        initloop(loop);
+        epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        epoll_ctl(loop->epfd,EPOLL_CTL_ADD,loop->evfd,&ev);
+        thread newth(runloop,loop);
+        pinthread(newth.native_handle(),i);
+        newth.detach();
+    }
+}
+
+// function to start a game between the players of the connections c1 and c2 of lobby. the connections are moved
+// into the game and the game is either played by a new thread or handed over to one of the event loops.
+// events of c1 and c2 may still be pending in the lobby, so they are freed only after the current batch
+void newgame(EVLOOP* lobby, CONN* c1, CONN* c2) {
+    static atomic_uint nextloop;                                // event loop that gets the next game
+    GAME* game = new GAME();                                    // alloc a new game
+    game->pid1 = c1->pid; game->pid2 = c2->pid;                 // set player ids for the new game
+    game->conn[0] = *c1; game->conn[1] = *c2;                   // set conns for the new game
+    c1->fd = c2->fd = -1;
+    lobby->gone.push_back(c1); lobby->gone.push_back(c2);
+    game->variant = c1->mm.variant;                             // matched players want the same variant
+    const VARIANT* v = &variants[game->variant];
+    if(game->variant != 0)
+        game->mnk = new char[v->size];
+    game->moveSeq.reserve(v->m * v->n);                         // so that no move of any game allocates
+    game->timer.data = game;
+    mcount(M_SESSIONS);
+    for(int i=0;i<2;++i) {
+        if(!game->conn[i].bot)
+            mrecord(H_MATCHWAIT,(nowms() - game->conn[i].mm.since) * 1000);
+    }
+    EVLOOP* loop = (numloops == 0) ? NULL : &loops[nextloop++ % numloops];
+    game->loop = loop;
+    for(int i=0;i<2;++i) {
+        game->conn[i].p = i + 1;
+        game->conn[i].game = game;
+        game->conn[i].loop = loop;
+        game->conn[i].heardus = nowus();                        // silence in the lobby doesn't count
+    }
+    if(loop == NULL) {
+        // make the conn fds blocking again and create a thread that will execute playgame function with
+        // argument as game and detach the thread for independent execution
+        for(int i=0;i<2;++i) {
+            if(!game->conn[i].bot)
+                fcntl(game->conn[i].fd,F_SETFL,fcntl(game->conn[i].fd,F_GETFL) & ~O_NONBLOCK);
+        }
+        thread newth(playgame,game);
+        newth.detach();
+        return;
+    }
+    // a seat of a multiplexed connection is told the loop of its game. if it has left or lost its connection on its
+    // way here, the game ends as a disconnect as soon as it starts
+    bool left[2] = {false,false};
+    for(int i=0;i<2;++i) {
+        CONN* conn = &game->conn[i];
+        if(conn->mux == NULL)
+            continue;
+        lock_guard<mutex> guard(conn->mux->lock);
+        auto it = conn->mux->seats.find(conn->tag);
+        if(it == conn->mux->seats.end() || it->second.left || conn->mux->closed) {
+            left[i] = true;
+        }
+        if(it != conn->mux->seats.end()) {
+            it->second.conn = NULL;
+            it->second.loop = loop;
+        }
+    }
+    // hand the game over to the next event loop
+    loop->newgames_mutex.lock();
+    loop->newgames.push_back(game);
+    for(int i=0;i<2;++i) {
+        if(left[i])
+            loop->muxinputs.push_back({game->conn[i].seatkey,MUXGONE,""});
+    }
+    loop->newgames_mutex.unlock();
+    uint64_t one = 1;
+    write(loop->evfd,&one,sizeof one);
+}
+
+// function to make the kernel drop a connection whose peer is gone: an idle connection is probed with TCP keepalives
+// after KEEPIDLE s and sent data may stay unacked for at most USERTIMEOUT ms. either way, the next recv fails
+// and the player is disconnected. so, even a player who has been asked for a move is found dead early.
+// Nagle's algorithm is turned off since every step of a game already goes out as one send (see corkgame())
+void tunesocket(int fd) {
+    int yes = 1, idle = KEEPIDLE, intvl = KEEPINTVL, cnt = KEEPCNT, usertmout = USERTIMEOUT;
+    if(setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&yes,sizeof yes) == -1) {
+        perror("ERROR - setting TCP_NODELAY failed.");
+    }
+    if(setsockopt(fd,SOL_SOCKET,SO_KEEPALIVE,&yes,sizeof yes) == -1 || setsockopt(fd,IPPROTO_TCP,TCP_KEEPIDLE,&idle,sizeof idle) == -1 ||
+       setsockopt(fd,IPPROTO_TCP,TCP_KEEPINTVL,&intvl,sizeof intvl) == -1 || setsockopt(fd,IPPROTO_TCP,TCP_KEEPCNT,&cnt,sizeof cnt) == -1 ||
+       setsockopt(fd,IPPROTO_TCP,TCP_USER_TIMEOUT,&usertmout,sizeof usertmout) == -1) {
+        perror("ERROR - setting TCP keepalive failed.");
+    }
+}
+
+// function to turn away the next pending connection of lobby when the server is out of fds. the lobby's spare fd
+// is given up for it. returns false iff no connection could be turned away
+bool shedconn(EVLOOP* lobby) {
+    close(lobby->sparefd);
+    int connfd = accept(lobby->listenfd,NULL,NULL);
+    if(connfd != -1) {
+        mcount(M_REJECTS);
+        close(connfd);
+    }
+    lobby->sparefd = open("/dev/null",O_RDONLY);
+    return connfd != -1;
+}
+
+// function to accept all the pending player connections of lobby, assign each player an id and keep the connection
+// in the lobby till we know which protocol the client speaks. only then it is admitted (see admitplayer()), so
+// no connection is left in the listen queue while the server is full
+void acceptplayers(EVLOOP* lobby) {
+    while(1) {
+        int connfd;
+        if((connfd = accept4(lobby->listenfd,NULL,NULL,SOCK_NONBLOCK)) == -1) {
+            if((errno == EMFILE || errno == ENFILE) && shedconn(lobby))
+                continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                printf("ERROR: accept connection failed\n");
+            return;                                     // failed accept or no more pending connections
+        }
+        mcount(M_ACCEPTS);
+        tunesocket(connfd);
+        CONN* conn = new CONN();
+        conn->fd = connfd;
+        conn->pid = pidcounter++;                       // assign id
+        conn->loop = lobby;
+        conn->timer.data = conn;
+        conn->capid = capnewconn();
+        caprecord(conn->capid,CK_OPEN,0);
+        watchconn(conn,EPOLL_CTL_ADD);
+        twadd(&lobby->wheel,&conn->timer,nowms() + HELLOTIMEOUT);
+    }
+}
+
+// function to take a connection out of its lobby
+void leavelobby(CONN* conn) {
+    twcancel(&conn->loop->wheel,&conn->timer);
+    if(conn->fd != -1)
+        epoll_ctl(conn->loop->epfd,EPOLL_CTL_DEL,conn->fd,NULL);
+    conn->loop = NULL;
+}
+
+// function to start a game between the waiting player other (player 1) and conn (player 2), a connection of lobby.
+// if other waits in another lobby, that lobby owns its events and timer. so, both are handed over to it
+void startmatch(EVLOOP* lobby, CONN* other, CONN* conn) {
+    leavelobby(conn);
+    EVLOOP* owner = other->loop;
+    if(owner == lobby) {
+        leavelobby(other);
+        newgame(lobby,other,conn);
+        return;
+    }
+    owner->newgames_mutex.lock();
+    owner->matched.push_back(other); owner->matched.push_back(conn);
+    owner->newgames_mutex.unlock();
+    uint64_t one = 1;
+    write(owner->evfd,&one,sizeof one);
+}
+
+// function to make conn wait for its next match attempt. it waits MMRETRY ms or till it is due to get the bot
+void armwait(CONN* conn, long long now) {
+    long long next = now + MMRETRY;
+    if(botwait > 0)
+        next = min(next,conn->mm.since + botwait);
+    twadd(&conn->loop->wheel,&conn->timer,next);
+}
+
+// function to pair a player whose protocol is known. if the matchmaker has a waiting player with a close rating,
+// a new game is started with the waiting player as player 1 and this player as player 2. otherwise, this player
+// waits in the matchmaker. the lobby watches a waiting player only for a disconnect (a seat through its multiplexed connection).
+// told -> the player has been told that it waits already (by the server that handed it over, see takeover())
+void pairplayer(CONN* conn, bool told = false) {
+    twcancel(&conn->loop->wheel,&conn->timer);
+    conn->mm.rating = ratingof(conn->name);
+    conn->mm.data = conn;
+    conn->mm.owner = conn->mux;                                 // the seats of a session don't play each other
+    long long now = nowms();
+    MMENTRY* m = mmenqueue(&conn->mm,now);
+    if(m != NULL) {
+        startmatch(conn->loop,(CONN*)m->data,conn);
+        return;
+    }
+    if(conn->mux == NULL) {
+        epoll_event ev;
+        ev.events = EPOLLRDHUP;
+        ev.data.ptr = conn;
+        epoll_ctl(conn->loop->epfd,EPOLL_CTL_MOD,conn->fd,&ev);
+    }
+    // send a "connected and waiting" msg to the waiting player.
+    if(!told) {
+        char msg[BUFLEN];
+        snprintf(msg,BUFLEN,"Connected to the game server. Your player ID is %u. Waiting for a partner to join...",conn->pid);
+        codesend(conn,1,msg);
+    }
+    armwait(conn,now);
+}
+
+// function to start a game between the waiting player of conn and the bot, once the player has waited for botwait ms
+void pairbot(CONN* conn) {
+    CONN* bot = new CONN();
+    bot->fd = -1;
+    bot->pid = BOTPID;
+    bot->proto = PROTO_FRAMED;
+    bot->bot = true;
+    bot->mm.rating = ELOSTART;
+    bot->mm.variant = conn->mm.variant;
+    codesend(conn,1,"No partner has joined. You will play against the server's bot.");
+    EVLOOP* lobby = conn->loop;
+    leavelobby(conn);
+    newgame(lobby,conn,bot);
+}
+
+// function to handle the timer of a waiting player. the player gets the bot as partner once it has waited for
+// botwait ms. otherwise, it tries to get matched again with a match window that has grown with its wait
+void retrywait(CONN* conn) {
+    long long now = nowms();
+    if(botwait > 0 && now - conn->mm.since >= botwait) {
+        if(mmleave(&conn->mm))
+            pairbot(conn);
+        return;
+    }
+    MMENTRY* m = mmretry(&conn->mm,now);
+    if(m != NULL) {
+        startmatch(conn->loop,(CONN*)m->data,conn);
+    }
+    else if(conn->mm.state == MM_WAITING) {
+        armwait(conn,now);
+    }
+}
+
+// function to close a connection that leaves the lobby without a game
+void droplobbyconn(CONN* conn) {
+    twcancel(&conn->loop->wheel,&conn->timer);
+    close(conn->fd);
+    if(conn->slot)
+        freeslot();
+    delete conn;
+}
+
+// function to turn away a client whose protocol is known, since the server and its waiting room are full
+void rejectbusy(CONN* conn) {
+    mcount(M_REJECTS);
+    codesend(conn,1,BUSYTEXT); codesend(conn,3,"");
+    droplobbyconn(conn);
+}
+
+// function to tell the player of conn its position pos in the waiting room, if that has changed
+void tellroompos(CONN* conn, int pos) {
+    if(conn->roompos == pos)
+        return;
+    conn->roompos = pos;
+    char msg[BUFLEN];
+    snprintf(msg,BUFLEN,ROOMTEXT "%d.",pos);
+    codesend(conn,1,msg);
+}
+
+// function to admit the players in the waiting room of lobby to the free slots in order of arrival. the players
+// left in the room are told their positions every ROOMNOTIFY ms
+void serveroom(EVLOOP* lobby) {
+    while(!lobby->room.empty() && takeslot()) {
+        CONN* conn = lobby->room.front();
+        lobby->room.pop_front();
+        --lobby->roomlen; --roomcount;
+        conn->inroom = false;
+        conn->slot = true;
+        pairplayer(conn);
+    }
+    if(lobby->room.empty())
+        twcancel(&lobby->wheel,&lobby->roomtimer);
+    else if(lobby->roomtimer.prev == NULL)
+        twadd(&lobby->wheel,&lobby->roomtimer,nowms() + ROOMNOTIFY);
+}
+
+// function to handle the timer of the waiting room of lobby
+void notifyroom(EVLOOP* lobby) {
+    int pos = 0;
+    for(CONN* conn : lobby->room)
+        tellroompos(conn,++pos);
+    serveroom(lobby);
+}
+
+// function to take a player who has disconnected out of the waiting room of its lobby and close its connection
+void leaveroom(CONN* conn) {
+    EVLOOP* lobby = conn->loop;
+    lobby->room.erase(find(lobby->room.begin(),lobby->room.end(),conn));
+    --lobby->roomlen; --roomcount;
+    droplobbyconn(conn);
+}
+
+// function to admit a player whose protocol is known. it takes a free slot and is paired, unless others wait
+// for slots already. then it waits in the waiting room of its lobby, if the room has space, or is turned away
+// at once. the decision takes no lock
+void admitplayer(CONN* conn) {
+    if(roomcount.load() == 0 && takeslot()) {
+        conn->slot = true;
+        pairplayer(conn);
+        return;
+    }
+    if(!enterroom()) {
+        rejectbusy(conn);
+        return;
+    }
+    mcount(M_QUEUED);
+    EVLOOP* lobby = conn->loop;
+    twcancel(&lobby->wheel,&conn->timer);
+    conn->inroom = true;
+    lobby->room.push_back(conn);
+    ++lobby->roomlen;
+    // a waiting player is watched only for a disconnect
+    epoll_event ev;
+    ev.events = EPOLLRDHUP;
+    ev.data.ptr = conn;
+    epoll_ctl(lobby->epfd,EPOLL_CTL_MOD,conn->fd,&ev);
+    tellroompos(conn,lobby->room.size());
+    serveroom(lobby);                                   // a slot may have been freed before roomlen was raised
+}
+
+// function to hand the connection of a spectator over to the event loop that owns the game it wants to watch
+void watchgame(CONN* conn, uint gameid) {
+    EVLOOP* owner = NULL;
+    if(gameid != 0) {
+        GAMESHARD* shard = &gamedir[gameid % GAMESHARDS];
+        lock_guard<mutex> guard(shard->lock);
+        auto it = shard->loops.find(gameid);
+        if(it != shard->loops.end())
+            owner = it->second;
+    }
+    if(owner == NULL) {
+        char msg[BUFLEN];
+        snprintf(msg,BUFLEN,"There is no live game with ID %u.%s",gameid,numloops == 0 ? " Games can be watched only with -e." : "");
+        codesend(conn,1,msg); codesend(conn,3,"");
+        droplobbyconn(conn);
+        return;
+    }
+    EVLOOP* lobby = conn->loop;
+    leavelobby(conn);
+    SPECTATOR* sp = new SPECTATOR();
+    static_cast<CONN&>(*sp) = *conn;
+    sp->spectator = true;
+    sp->watchid = gameid;
+    conn->fd = -1;
+    lobby->gone.push_back(conn);
+    owner->newgames_mutex.lock();
+    owner->newspecs.push_back(sp);
+    owner->newgames_mutex.unlock();
+    uint64_t one = 1;
+    write(owner->evfd,&one,sizeof one);
+}
+
+// function to queue the msg of the given type for the seat with the given key, whose game is played by loop. lobby
+// hands the msgs it has read over to the event loops after each batch of events (see handoverseats())
+void postseat(EVLOOP* lobby, EVLOOP* loop, uint64_t key, int type, const char* msg) {
+    vector<MUXINPUT>& out = lobby->muxout[loop - loops];
+    out.push_back({key,type,""});
+    strcpy(out.back().msg,msg);
+}
+
+// function to hand the msgs for seats that lobby has read over to the event loops of their games, with one wakeup per loop
+void handoverseats(EVLOOP* lobby) {
+    for(int i=0;i<numloops;++i) {
+        vector<MUXINPUT>& out = lobby->muxout[i];
+        if(out.empty())
+            continue;
+        EVLOOP* loop = &loops[i];
+        loop->newgames_mutex.lock();
+        loop->muxinputs.insert(loop->muxinputs.end(),out.begin(),out.end());
+        loop->newgames_mutex.unlock();
+        out.clear();
+        uint64_t one = 1;
+        write(loop->evfd,&one,sizeof one);
+    }
+}
+
+// function to close a seat that leaves the lobby of its multiplexed connection without a game. it has been taken
+// off the seats of the connection already
+void dropseat(CONN* conn) {
+    MUXCONN* mux = conn->mux;
+    twcancel(&conn->loop->wheel,&conn->timer);
+    freeslot();
+    delete conn;
+    unrefmux(mux);
+}
+
+// function to set the timer of the multiplexed connection mux to its next liveness check
+void armmux(MUXCONN* mux) {
+    long long t;
+    if(mux->ackwait > 0 && mux->heardus <= mux->pingus)
+        t = mux->pingus / 1000 + ACKTIMEOUT * 1000LL;               // nothing heard since the last KEEP_ALIVE
+    else
+        t = mux->heardus / 1000 + IDLETIMEOUT * 1000LL;
+    twadd(&mux->loop->wheel,&mux->timer,t);
+}
+
+// function to drop the multiplexed connection mux, which is closed or broken or hasn't acked a KEEP_ALIVE msg. the
+// games of its seats end as disconnects. seats that wait for a partner leave the matchmaker, unless they have just
+// been matched. then their games end as soon as they start. mux is freed once its games are gone
+void dropmux(MUXCONN* mux) {
+    EVLOOP* lobby = mux->loop;
+    twcancel(&lobby->wheel,&mux->timer);
+    vector<CONN*> waiting;
+    mux->lock.lock();
+    mux->closed = true;
+    close(mux->fd);
+    mux->fd = -1;
+    for(auto it = mux->seats.begin();it != mux->seats.end();) {
+        MUXSEAT& seat = it->second;
+        if(seat.loop != NULL) {
+            postseat(lobby,seat.loop,seat.key,MUXGONE,"");
+        }
+        else if(mmleave(&seat.conn->mm)) {
+            waiting.push_back(seat.conn);
+            it = mux->seats.erase(it);
+            continue;
+        }
+        else {
+            seat.left = true;
+        }
+        ++it;
+    }
+    mux->lock.unlock();
+    matchmaker.left += waiting.size();
+    for(CONN* conn : waiting)
+        dropseat(conn);
+    lobby->deadmux.push_back(mux);                      // events of this batch may still refer to mux
+}
+
+// function to open a seat on the multiplexed connection mux for a new game with the client's id tag. the payload
+// may have the variant the seat wants, else it wants the one of T_HELLO. the seat is a player of its own, admitted
+// and paired like a new player. only it never waits in the waiting room: it is turned away if it can't get a slot
+void joinseat(MUXCONN* mux, uint32_t tag, const char* payload, int len) {
+    bool inuse;
+    mux->lock.lock();
+    inuse = (tag == 0 || mux->seats.count(tag) != 0);
+    mux->lock.unlock();
+    if(inuse) {
+        char msg[BUFLEN];
+        snprintf(msg,BUFLEN,"Can't join a game with ID %u. It is 0 or in use by another of your games.",tag);
+        muxframe(mux,T_PRINT,0,msg);
+        return;
+    }
+    if(roomcount.load() > 0 || !takeslot()) {
+        mcount(M_REJECTS);
+        muxframe(mux,T_PRINT,tag,BUSYTEXT); muxframe(mux,T_GAMEOVER,tag,"");
+        return;
+    }
+    mcount(M_MUXJOINS);
+    CONN* conn = new CONN();
+    conn->fd = -1;
+    conn->pid = pidcounter++;
+    conn->loop = mux->loop;
+    conn->proto = PROTO_FRAMED;
+    conn->compact = mux->compact;
+    conn->slot = true;
+    conn->timer.data = conn;
+    strcpy(conn->name,mux->name);
+    int variant = (len > 0) ? (uint8_t)payload[0] : mux->mm.variant;
+    conn->mm.variant = (variant < NVARIANTS) ? variant : 0;
+    conn->mux = mux;
+    conn->tag = tag;
+    conn->seatkey = ++seatcounter;
+    mux->lock.lock();
+    mux->seats[tag] = {conn,NULL,conn->seatkey,false};
+    ++mux->refs;
+    mux->lock.unlock();
+    pairplayer(conn);
+}
+
+// function to handle a frame with the client's id tag from the multiplexed connection mux. msgs for a game that has
+// started are queued for its event loop, where T_LEAVE ends it as a disconnect. a seat that waits for a partner only
+// listens to T_LEAVE. frames for games that are over are dropped
+void onmuxframe(MUXCONN* mux, int type, uint32_t tag, const char* msg, int len) {
+    if(type == T_ACK) {
+        if(mux->ackwait > 0) {
+            --mux->ackwait;
+            mrecord(H_HEARTBEAT,nowus() - mux->pingus);
+        }
+        return;
+    }
+    if(type == T_JOIN) {
+        joinseat(mux,tag,msg,len);
+        return;
+    }
+    if(type != T_INPUT && type != T_QUERY && type != T_LEAVE)
+        return;
+    CONN* conn;
+    {
+        lock_guard<mutex> guard(mux->lock);
+        auto it = mux->seats.find(tag);
+        if(it == mux->seats.end())
+            return;
+        MUXSEAT& seat = it->second;
+        if(seat.loop != NULL) {
+            postseat(mux->loop,seat.loop,seat.key,(type == T_LEAVE) ? MUXGONE : type,msg);
+            return;
+        }
+        if(type != T_LEAVE)
+            return;
+        if(!mmleave(&seat.conn->mm)) {
+            seat.left = true;                           // matched already. its game ends as soon as it starts
+            return;
+        }
+        conn = seat.conn;
+        mux->seats.erase(it);
+    }
+    ++matchmaker.left;
+    codesend(conn,3,"");
+    dropseat(conn);
+}
+
+// function to add the whole frame of size bytes at data, recved from the multiplexed connection mux, to the capture
+// file. the games of a session are prompted in any order, so a frame is recorded by itself with the num of prompts
+// sent for its game. bytes that came with the T_HELLO were recorded before the connection was multiplexed
+void muxcapture(MUXCONN* mux, const FRAMEHDR* hdr, const char* data, int size) {
+    int skip = min(mux->capped,size);
+    mux->capped -= skip;
+    if(skip == size)
+        return;
+    mux->lock.lock();
+    uint32_t prompts = mux->tagprompts[ntohl(hdr->gameid)];
+    mux->lock.unlock();
+    caprecord(mux->capid,CK_DATA,prompts,data + skip,size - skip);
+}
+
+// function to handle every whole frame in the buffer of the multiplexed connection mux. returns false iff a frame is broken
+bool muxframes(MUXCONN* mux) {
+    int size, off = 0;
+    while((size = framesize(mux->buf + off,mux->buflen - off)) > 0) {
+        FRAMEHDR hdr;
+        memcpy(&hdr,mux->buf + off,sizeof hdr);
+        if(mux->capid != 0)
+            muxcapture(mux,&hdr,mux->buf + off,size);
+        int len = size - sizeof(FRAMEHDR);
+        if(len > BUFLEN)
+            return false;
+        char msg[BUFLEN+1];
+        memcpy(msg,mux->buf + off + sizeof(FRAMEHDR),len);
+        msg[len] = '\0';
+        off += size;
+        onmuxframe(mux,hdr.type,ntohl(hdr.gameid),msg,len);
+    }
+    mux->buflen -= off;
+    memmove(mux->buf,mux->buf + off,mux->buflen);
+    return size == 0;
+}
+
+// function to read all the data available at the multiplexed connection mux without blocking and handle every whole
+// frame in it. a closed connection, a recv error or a broken frame drops the connection with all its games
+void muxread(MUXCONN* mux) {
+    while(1) {
+        int ret = recv(mux->fd,mux->buf + mux->buflen,MUXBUFLEN - mux->buflen,MSG_DONTWAIT);
+        if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR))
+            return;
+        if(ret <= 0) {
+            caprecord(mux->capid,CK_CLOSE,0);
+            dropmux(mux);
+            return;
+        }
+        mux->buflen += ret;
+        mux->heardus = nowus();
+        if(!muxframes(mux)) {
+            dropmux(mux);
+            return;
+        }
+    }
+}
+
+// function to handle the timer of the multiplexed connection mux. it is checked for liveness like the players of a
+// game (see checklive()), but once for all its games, and it owes an ack at any time
+void livemux(MUXCONN* mux) {
+    long long now = nowus();
+    if(mux->ackwait > 0 && mux->heardus <= mux->pingus) {
+        if(now >= mux->pingus + ACKTIMEOUT * 1000000LL) {
+            dropmux(mux);
+            return;
+        }
+    }
+    else if(now >= mux->heardus + IDLETIMEOUT * 1000000LL) {
+        mux->pingus = now;
+        ++mux->ackwait;
+        if(muxframe(mux,T_KEEPALIVE,0,"ARE YOU ALIVE?") < 0) {
+            dropmux(mux);
+            return;
+        }
+    }
+    armmux(mux);
+}
+
+// function to handle an event of the multiplexed connection mux in its lobby
+void muxevent(MUXCONN* mux, uint32_t events) {
+    if(events & EPOLLOUT) {
+        mux->lock.lock();
+        int ret = flushconn(mux);
+        mux->lock.unlock();
+        if(ret < 0) {
+            dropmux(mux);
+            return;
+        }
+    }
+    if(events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+        muxread(mux);
+}
+
+// function to turn conn, whose client has asked for HELLO_MUX, into a multiplexed connection. it stays in its lobby.
+// the frames that came along with the T_HELLO are handled at once
+void startmux(CONN* conn) {
+    EVLOOP* lobby = conn->loop;
+    twcancel(&lobby->wheel,&conn->timer);
+    MUXCONN* mux = new MUXCONN();
+    static_cast<CONN&>(*mux) = *conn;
+    mux->muxed = true;
+    mux->refs = 1;
+    mux->timer.data = static_cast<CONN*>(mux);
+    memcpy(mux->buf,conn->inbuf,conn->inlen);
+    mux->buflen = conn->inlen;
+    mux->capped = conn->inlen;
+    mux->inlen = 0;
+    conn->fd = -1;
+    lobby->gone.push_back(conn);
+    mcount(M_MUXCONNS);
+    watchconn(mux,EPOLL_CTL_MOD);
+    muxframe(mux,T_PRINT,0,"Connected to the game server. Join games with T_JOIN.");
+    armmux(mux);
+    if(!muxframes(mux))
+        dropmux(mux);
+}
+
+// function to handle data from a connection in the lobby. a client that asks for the framed protocol sends a
+// T_HELLO frame first. its payload is the name of the player (may be empty) and maybe HELLO_* flags.
+// a spectator is handed over to the game it wants to watch and a multiplexed connection stays in the lobby for good.
+// data that doesn't start like a frame comes from a legacy client
+void lobbyread(CONN* conn) {
+    if(recvconn(conn) < 0) {
+        droplobbyconn(conn);
+        return;
+    }
+    if(conn->inlen == 0)
+        return;
+    if((unsigned char)conn->inbuf[0] == FRAMEMARK) {
+        int size = framesize(conn->inbuf,conn->inlen);
+        if(size == 0)
+            return;                                     // rest of the T_HELLO frame is yet to come
+        if(size < 0 || conn->inbuf[1] != T_HELLO) {
+            droplobbyconn(conn);
+            return;
+        }
+        // the name may be followed by a NUL and a byte of HELLO_* flags
+        const char* payload = conn->inbuf + sizeof(FRAMEHDR);
+        int paylen = size - sizeof(FRAMEHDR);
+        int namelen = strnlen(payload,paylen);
+        int len = min(namelen,MAXNAME);
+        memcpy(conn->name,payload,len);
+        conn->name[len] = '\0';
+        int flags = (namelen + 1 < paylen) ? payload[namelen + 1] : 0;
+        conn->compact = flags & HELLO_COMPACT;
+        int variant = (namelen + 2 < paylen) ? (uint8_t)payload[namelen + 2] : 0;
+        conn->mm.variant = (variant < NVARIANTS) ? variant : 0;         // an unknown variant gets the 3x3 board
+        if(flags & HELLO_WATCH) {
+            // like a seat, a spectator doesn't wait in the room. it is turned away while players wait there,
+            // so that it can't take the slot they wait for
+            if(roomcount.load() > 0 || !takeslot()) {
+                rejectbusy(conn);
+                return;
+            }
+            conn->slot = true;
+            FRAMEHDR hdr;
+            memcpy(&hdr,conn->inbuf,sizeof hdr);
+            watchgame(conn,ntohl(hdr.gameid));
+            return;
+        }
+        conn->inlen -= size;
+        memmove(conn->inbuf,conn->inbuf + size,conn->inlen);
+        conn->proto = PROTO_FRAMED;
+        if(flags & HELLO_MUX) {
+            if(numloops == 0) {
+                codesend(conn,1,"Games can be multiplexed only with -e."); codesend(conn,3,"");
+                droplobbyconn(conn);
+                return;
+            }
+            startmux(conn);
+            return;
+        }
+    }
+    else {
+        conn->proto = PROTO_LEGACY;
+    }
+    admitplayer(conn);
+}
+
+// function to write the trace events of all threads to trace-<PID>-<N>.json, where N counts the dumps. the lobby
+// starts it in a thread of its own on SIGUSR2, so that players aren't kept waiting while the rings are formatted
+void writetrace() {
+    static atomic_int dumps;
+    string out, path = "trace-" + to_string(getpid()) + "-" + to_string(++dumps) + ".json";
+    size_t n = tracedump(out,0);
+    ofstream f(path);
+    f << out;
+    f.close();
+    if(!f)
+        cout << "ERROR: the trace couldn't be written to " << path << "." << endl;
+    else
+        cout << "Wrote " << n << " trace events to " << path << "." << endl;
+}
+
+// function executed by the thread of a lobby (the main thread for lobby 0). it accepts new players on the
+// lobby's listening socket, finds out which protocol they speak and pairs them up for games
+void runlobby(EVLOOP* lobby) {
+    tracethread("lobby " + to_string(lobby - lobbies));
+    epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    epoll_ctl(lobby->epfd,EPOLL_CTL_ADD,lobby->listenfd,&ev);
+    ev.data.ptr = lobby;
+    epoll_ctl(lobby->epfd,EPOLL_CTL_ADD,lobby->evfd,&ev);
+    // SIGUSR1 (blocked in every thread) asks for a report of the matchmaker and SIGUSR2 for a dump of the trace
+    if(lobby == &lobbies[0]) {
+        ev.data.ptr = &sigfd;
+        epoll_ctl(lobby->epfd,EPOLL_CTL_ADD,sigfd,&ev);
+    }
+    epoll_event evs[MAXEVENTS];
+    vector<CONN*> matched;
+    lobby->muxout.resize(numloops);
+    while(1) {
+        if(upgradestage.load() != 0)
+            parkthread();                               // a new server takes over (see handoff())
+        int n = epoll_wait(lobby->epfd,evs,MAXEVENTS,twtimeout(&lobby->wheel,nowms()));
+        if(n < 0 && errno != EINTR) {
+            perror("ERROR - epoll_wait failed.");
+        }
+        for(int i=0;i<n;++i) {
+            if(evs[i].data.ptr == NULL) {
+                acceptplayers(lobby);
+                continue;
+            }
+            if(evs[i].data.ptr == lobby) {
+                // other lobbies have matched players waiting in this lobby. start their games
+                uint64_t cnt;
+                read(lobby->evfd,&cnt,sizeof cnt);
+                lobby->newgames_mutex.lock();
+                matched.swap(lobby->matched);
+                lobby->newgames_mutex.unlock();
+                for(size_t j=0;j<matched.size();j+=2) {
+                    leavelobby(matched[j]);
+                    newgame(lobby,matched[j],matched[j+1]);
+                }
+                matched.clear();
+                // or slots have been freed for the players in the waiting room
+                serveroom(lobby);
+                continue;
+            }
+            if(evs[i].data.ptr == &sigfd) {
+                signalfd_siginfo si;
+                while(read(sigfd,&si,sizeof si) > 0) {
+                    if(si.ssi_signo == SIGUSR1) {
+                        mmreport(stdout);
+                    }
+                    else {
+                        thread newth(writetrace);
+                        newth.detach();
+                    }
+                }
+                continue;
+            }
+            CONN* conn = (CONN*)evs[i].data.ptr;
+            if(conn->fd == -1)
+                continue;                               // moved into a game by an earlier event of this batch
+            if(conn->muxed) {
+                muxevent(static_cast<MUXCONN*>(conn),evs[i].events);
+            }
+            else if(conn->inroom) {
+                leaveroom(conn);                        // a player in the waiting room has disconnected
+            }
+            else if(conn->mm.state == MM_WAITING) {
+                // a waiting player has disconnected. it leaves the queue unless it has just been matched
+                if(mmleave(&conn->mm)) {
+                    ++matchmaker.left;
+                    droplobbyconn(conn);
+                }
+            }
+            else if(conn->mm.state == MM_IDLE) {
+                lobbyread(conn);
+            }
+        }
+        // clients that haven't asked for the framed protocol within HELLOTIMEOUT are legacy clients.
+        // the other timers in the lobby are those of the waiting players, of the waiting room and of the multiplexed connections
+        TIMER* timer;
+        while((timer = twexpired(&lobby->wheel,nowms())) != NULL) {
+            if(timer == &lobby->roomtimer) {
+                notifyroom(lobby);
+                continue;
+            }
+            CONN* conn = (CONN*)timer->data;
+            if(conn->muxed) {
+                livemux(static_cast<MUXCONN*>(conn));
+                continue;
+            }
+            if(conn->proto != PROTO_UNKNOWN) {
+                retrywait(conn);
+                continue;
+            }
+            conn->proto = PROTO_LEGACY;
+            admitplayer(conn);
+        }
+        handoverseats(lobby);
+        for(CONN* conn : lobby->gone) {
+            delete conn;
+        }
+        lobby->gone.clear();
+        for(MUXCONN* mux : lobby->deadmux) {
+            unrefmux(mux);
+        }
+        lobby->deadmux.clear();
+    }
+}
+
+// function to create a listening socket for servaddr. every lobby has its own socket on the same port and
+// the kernel spreads new connections over them (SO_REUSEPORT)
+int listensocket(sockaddr_in* servaddr) {
+    int fd;
+    // socket creation with domain as IPv4 family, type as STREAM socket and protocol as
+    // 0 (choose any protocol that supports SOCK_STREAM type). accept() on it never blocks
+    if((fd = socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK,0)) == -1) {
+        perror("ERROR - socket creation failed"); exit(-1);
+    }
+
+    // change the socket to allow reuse of ip address and the port number
+    int yes = 1;
+    if(setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&yes,sizeof yes) == -1 || setsockopt(fd,SOL_SOCKET,SO_REUSEPORT,&yes,sizeof yes) == -1) {
+        perror("ERROR - socket reuse failed"); exit(-1);
+    }
+
+    // bind the socket to servaddr
+    if(bind(fd, (struct sockaddr*)servaddr, sizeof *servaddr) != 0) {
+        perror("ERROR - binding of socket failed"); exit(-1);
+    }
+
+    // listen for incoming connect requests
+    if(listen(fd,BACKLOG) != 0) {
+        perror("ERROR - listen failed"); exit(-1);
+    }
+    return fd;
+}
+
+// function executed by the admin thread. every connection to the admin socket fd gets the merged metrics of all
+// threads (see metrics.h) in the Prometheus text format as a HTTP response, unless it asks for /limits or
+// /leaderboard, and is closed.
+// the admin thread is the only one that merges the metrics, so scrapes never slow down the games
+void runadmin(int fd) {
+    char req[ADMINREQLEN];
+    while(1) {
+        int connfd;
+        if((connfd = accept(fd,NULL,NULL)) == -1) {
+            if(errno != EINTR)
+                perror("ERROR - admin accept failed.");
+            continue;
+        }
+        // read the request head (if any) within a second, so that a silent client can't hold the thread
+        timeval tv = {1,0};
+        setsockopt(connfd,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof tv);
+        int len = 0, ret;
+        while(len < ADMINREQLEN - 1 && (ret = recv(connfd,req + len,ADMINREQLEN - 1 - len,0)) > 0) {
+            len += ret;
+            req[len] = '\0';
+            if(strstr(req,"\r\n\r\n") != NULL || strstr(req,"\n\n") != NULL)
+                break;
+        }
+        string body;
+        const char* type = "text/plain; version=0.0.4";
+        if(strncmp(req,"GET /limits",11) == 0) {
+            // GET /limits?players=N&room=M changes the max num of players and the size of the waiting room. the
+            // limits in force are sent back
+            string target(req + 4,strcspn(req + 4," \r\n"));
+            size_t at;
+            if((at = target.find("players=")) != string::npos)
+                maxplayers = max(2,atoi(target.c_str() + at + 8));
+            if((at = target.find("room=")) != string::npos)
+                roomsize = max(0,atoi(target.c_str() + at + 5));
+            wakerooms();                                // raised limits admit players from the waiting rooms
+            body = "players " + to_string(maxplayers.load()) + "\nroom " + to_string(roomsize.load()) + "\n";
+        }
+        else if(strncmp(req,"GET /leaderboard",16) == 0) {
+            leaderboardtext(body);
+            body += "\n";
+        }
+        else if(strncmp(req,"GET /trace",10) == 0) {
+            // GET /trace?on=1 (or 0) turns tracing on (or off). else the trace is sent as JSON for chrome://tracing or
+            // ui.perfetto.dev. GET /trace?game=ID sends only the events of the game ID
+            string target(req + 4,strcspn(req + 4," \r\n"));
+            size_t at;
+            if((at = target.find("on=")) != string::npos) {
+                traceon = atoi(target.c_str() + at + 3) != 0;
+                body = string("tracing ") + (traceon ? "on" : "off") + "\n";
+            }
+            else {
+                uint gameid = 0;
+                if((at = target.find("game=")) != string::npos)
+                    gameid = strtoul(target.c_str() + at + 5,NULL,10);
+                tracedump(body,gameid);
+                type = "application/json";
+            }
+        }
+        else {
+            metricstext(body,{
+                {"tictactoe_active_players","gauge","Players and spectators that hold a slot.",(double)activeplayers.load()},
+                {"tictactoe_max_players","gauge","Max num of players and spectators that may hold a slot.",(double)maxplayers.load()},
+                {"tictactoe_waiting_room_players","gauge","Players waiting for a free slot.",(double)roomcount.load()},
+                {"tictactoe_waiting_room_size","gauge","Max num of players that may wait for a free slot.",(double)roomsize.load()},
+                {"tictactoe_matchmaker_depth","gauge","Players waiting in the matchmaker.",(double)matchmaker.depth.load()},
+                {"tictactoe_matchmaker_matches_total","counter","Matches made by the matchmaker.",(double)matchmaker.matches.load()},
+                {"tictactoe_matchmaker_left_total","counter","Players who left the matchmaker unmatched.",(double)matchmaker.left.load()},
+                {"tictactoe_log_queue_depth","gauge","Finished games waiting for the log writer.",(double)logdepth()},
+                {"tictactoe_log_drops_total","counter","Finished games dropped since the log queue was full.",(double)gamelog.drops.load()},
+                {"tictactoe_log_written_total","counter","Finished games written to the log file.",(double)gamelog.written.load()}
+            });
+        }
+        string resp = "HTTP/1.0 200 OK\r\nContent-Type: " + string(type) + "\r\nContent-Length: " + to_string(body.size()) +
+                      "\r\nConnection: close\r\n\r\n" + body;
+        size_t sent = 0;
+        while(sent < resp.size() && (ret = send(connfd,resp.data() + sent,resp.size() - sent,MSG_NOSIGNAL)) > 0)
+            sent += ret;
+        close(connfd);
+    }
+}
+
+// function to create the admin socket on port of the loopback address and start the admin thread for it.
+// fd -> the admin socket on port handed over by an older server. -1 -> a new one is created
+void startadmin(int port, int fd) {
+    sockaddr_in addr;
+    memset(&addr,0,sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((short)port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int yes = 1;
+    if(fd == -1 && ((fd = socket(AF_INET,SOCK_STREAM,0)) == -1 || setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&yes,sizeof yes) == -1 ||
+       bind(fd,(sockaddr*)&addr,sizeof addr) != 0 || listen(fd,16) != 0)) {
+        perror("ERROR - admin socket creation failed"); exit(-1);
+    }
+    adminfd = fd;
+    thread newth(runadmin,fd);
+    newth.detach();
+}
+
+// the functions below hand a running server over to a new server process (-u). the new server connects to the upgrade
+// socket of the old one, which stops its threads, packs its state and sends it with every fd it refers to (see
+// handoff.h). games go on in the new server where they were. only the metrics start from 0 again
+
+// kinds of the connections of a lobby in a snapshot. LK_HELLO -> the protocol of the client isn't known yet,
+// LK_WAITING -> the player waits for a partner, LK_ROOM -> the player waits in the waiting room
+enum LOBBYKIND { LK_HELLO, LK_WAITING, LK_ROOM };
+
+// structure to represent the state read from the snapshot of an older server, before the new server puts it to work
+struct TAKEOVER {
+    vector<MUXCONN*> muxes;                                             // multiplexed connections by their index in the snapshot
+    vector<CONN*> hello, waiting, room;                                 // connections of the lobbies by kind (room in order of arrival)
+    vector<CONN*> matched;                                              // matched pairs of players on their way to a game
+    vector<GAME*> games;
+    vector<SPECTATOR*> specs;
+};
+
+// function to add the fields of conn that outlive a handoff to the snapshot. the multiplexed connection of a seat is
+// given by its index in muxids
+void packconn(HOPACKER* pk, CONN* conn, unordered_map<MUXCONN*,int>& muxids) {
+    hoputfd(pk,(conn->mux != NULL || conn->bot) ? -1 : conn->fd);
+    hoput(pk,conn->pid); hoput(pk,conn->p); hoput(pk,(int)conn->proto);
+    hoputstr(pk,conn->inbuf,conn->inlen);
+    hoputstr(pk,conn->outbuf.data(),conn->outbuf.size());
+    hoput(pk,conn->compact); hoput(pk,conn->slot); hoput(pk,conn->roompos);
+    hoput(pk,conn->ackwait); hoput(pk,conn->heardus); hoput(pk,conn->pingus);
+    hoput(pk,conn->choice); hoput(pk,conn->bot);
+    hoputstr(pk,conn->name,strlen(conn->name));
+    hoput(pk,conn->mm.rating); hoput(pk,conn->mm.variant); hoput(pk,conn->mm.since);
+    hoput(pk,conn->mux != NULL ? muxids[conn->mux] : -1);
+    hoput(pk,conn->tag); hoput(pk,conn->seatkey);
+}
+
+// function to read the fields of a connection written by packconn() into conn. a connection that held a slot takes it
+// again. a seat is counted as a reference to its multiplexed connection. returns false if the fields are broken
+bool unpackconn(HOREADER* rd, CONN* conn, TAKEOVER* to) {
+    int proto, muxid;
+    conn->fd = hogetfd(rd);
+    hoget(rd,&conn->pid); hoget(rd,&conn->p); hoget(rd,&proto);
+    conn->proto = (PROTO)proto;
+    conn->inlen = hogetstr(rd,conn->inbuf,INBUFLEN);
+    hogetstr(rd,&conn->outbuf);
+    hoget(rd,&conn->compact); hoget(rd,&conn->slot); hoget(rd,&conn->roompos);
+    hoget(rd,&conn->ackwait); hoget(rd,&conn->heardus); hoget(rd,&conn->pingus);
+    hoget(rd,&conn->choice); hoget(rd,&conn->bot);
+    conn->name[hogetstr(rd,conn->name,MAXNAME)] = '\0';
+    hoget(rd,&conn->mm.rating); hoget(rd,&conn->mm.variant); hoget(rd,&conn->mm.since);
+    hoget(rd,&muxid);
+    hoget(rd,&conn->tag); hoget(rd,&conn->seatkey);
+    conn->timer.data = conn;
+    if(rd->bad || proto < PROTO_UNKNOWN || proto > PROTO_FRAMED || conn->mm.variant < 0 || conn->mm.variant >= NVARIANTS ||
+       muxid < -1 || muxid >= (int)to->muxes.size())
+        return false;
+    if(muxid != -1) {
+        conn->mux = to->muxes[muxid];
+        ++conn->mux->refs;
+    }
+    if(conn->slot)
+        ++activeplayers;
+    return true;
+}
+
+// function to add a game of the event loop with index loopidx to the snapshot with its players and spectators
+void packgame(HOPACKER* pk, GAME* game, int loopidx, unordered_map<MUXCONN*,int>& muxids) {
+    hoput(pk,loopidx);
+    hoput(pk,game->pid1); hoput(pk,game->pid2);
+    hoput(pk,game->turn); hoput(pk,game->variant);
+    hoput(pk,game->cause); hoput(pk,game->winner);
+    hoput(pk,game->starttime); hoput(pk,game->endtime);
+    hoput(pk,game->gameid); hoput(pk,(int)game->state); hoput(pk,game->logged);
+    hoput(pk,game->deadline); hoput(pk,game->promptus);
+    hoput(pk,(uint32_t)game->moveSeq.size());
+    for(const GMOVE& m : game->moveSeq) {
+        hoput(pk,(int8_t)m.p); hoput(pk,(int8_t)m.r); hoput(pk,(int8_t)m.c);
+    }
+    packconn(pk,&game->conn[0],muxids); packconn(pk,&game->conn[1],muxids);
+    hoput(pk,(uint32_t)game->specs.size());
+    for(SPECTATOR* sp : game->specs)
+        packconn(pk,sp,muxids);
+}
+
+// function to read a game written by packgame() into a new GAME of to. the board is rebuilt by playing the moves of the
+// game again, so it doesn't depend on how this build keeps boards. the spectators watch the game again once it is
+// resumed in its event loop. returns false if the game is broken
+bool unpackgame(HOREADER* rd, TAKEOVER* to) {
+    GAME* game = new GAME();
+    to->games.push_back(game);
+    int loopidx, state;
+    uint32_t nmoves;
+    hoget(rd,&loopidx);
+    hoget(rd,&game->pid1); hoget(rd,&game->pid2);
+    hoget(rd,&game->turn); hoget(rd,&game->variant);
+    hoget(rd,&game->cause); hoget(rd,&game->winner);
+    hoget(rd,&game->starttime); hoget(rd,&game->endtime);
+    hoget(rd,&game->gameid); hoget(rd,&state); hoget(rd,&game->logged);
+    hoget(rd,&game->deadline); hoget(rd,&game->promptus);
+    hoget(rd,&nmoves);
+    if(rd->bad || loopidx < 0 || game->variant < 0 || game->variant >= NVARIANTS || nmoves > MNKMAXCELLS ||
+       (state != GS_AWAITMOVE && state != GS_AWAITREPLAY) || (game->turn != 1 && game->turn != 2))
+        return false;
+    game->state = (GSTATE)state;
+    game->loop = &loops[loopidx % numloops];
+    game->timer.data = game;
+    game->resumed = true;
+    const VARIANT* v = &variants[game->variant];
+    if(game->variant != 0) {
+        game->mnk = new char[v->size];
+        v->init(game->mnk);
+    }
+    game->moveSeq.reserve(v->m * v->n);
+    for(uint32_t i=0;i<nmoves;++i) {
+        int8_t p, r, c;
+        hoget(rd,&p); hoget(rd,&r); hoget(rd,&c);
+        if(rd->bad || (p != 1 && p != 2) || playmove(game,p,r-1,c-1) < 0)
+            return false;
+        game->moveSeq.push_back(GMOVE(p,r,c));
+    }
+    for(int i=0;i<2;++i) {
+        CONN* conn = &game->conn[i];
+        if(!unpackconn(rd,conn,to) || conn->p != i + 1 || (conn->fd == -1 && conn->mux == NULL && !conn->bot))
+            return false;
+        conn->game = game;
+        conn->loop = game->loop;
+        if(conn->mux != NULL) {
+            MUXSEAT& seat = conn->mux->seats[conn->tag];
+            seat.conn = NULL;
+            seat.loop = game->loop;
+            seat.key = conn->seatkey;
+        }
+    }
+    uint32_t nspecs;
+    hoget(rd,&nspecs);
+    for(uint32_t i=0;i<nspecs && !rd->bad;++i) {
+        SPECTATOR* sp = new SPECTATOR();
+        to->specs.push_back(sp);
+        if(!unpackconn(rd,sp,to) || sp->fd == -1)
+            return false;
+        sp->spectator = true;
+        sp->watchid = game->gameid;
+        sp->loop = game->loop;
+    }
+    return !rd->bad;
+}
+
+// function to pack the state of the stopped server into pk: the id counters, the sockets of the server, the ratings and
+// records of the players, the multiplexed connections, the connections of the lobbies, the matched pairs on their way
+// to a game and the games of the event loops. the lobbies' connections are found through the timers of their wheels
+void packserver(HOPACKER* pk) {
+    hoput(pk,pidcounter.load()); hoput(pk,gidcounter.load()); hoput(pk,seatcounter.load());
+    hoput(pk,numlobbies);
+    for(int i=0;i<numlobbies;++i)
+        hoputfd(pk,lobbies[i].listenfd);
+    hoputstr(pk,upgradepath,strlen(upgradepath));
+    hoputfd(pk,upgradefd);
+    hoput(pk,adminport);
+    hoputfd(pk,adminfd);
+
+    uint32_t n = 0;
+    for(RATINGSHARD& shard : ratingtable)
+        n += shard.ratings.size();
+    hoput(pk,n);
+    for(RATINGSHARD& shard : ratingtable) {
+        for(auto& it : shard.ratings) {
+            hoputstr(pk,it.first.data(),it.first.size());
+            hoput(pk,it.second);
+        }
+    }
+    n = 0;
+    for(STATSHARD& shard : statstable.shards)
+        n += shard.named.size() + shard.anon.size();
+    hoput(pk,n);
+    for(STATSHARD& shard : statstable.shards) {
+        for(auto& it : shard.named) {
+            hoputstr(pk,it.first.data(),it.first.size());
+            hoput(pk,(uint32_t)0); hoput(pk,it.second);
+        }
+        for(auto& it : shard.anon) {
+            hoputstr(pk,"",0);
+            hoput(pk,it.first); hoput(pk,it.second);
+        }
+    }
+
+    // find the connections of the lobbies and the multiplexed connections that they and the games play on
+    vector<pair<CONN*,int>> lobbyconns;                 // connection and kind
+    vector<CONN*> matched;
+    vector<MUXCONN*> muxes;
+    unordered_map<MUXCONN*,int> muxids;
+    auto addmux = [&](MUXCONN* mux) {
+        if(mux != NULL && muxids.emplace(mux,muxes.size()).second)
+            muxes.push_back(mux);
+    };
+    for(int i=0;i<numlobbies;++i) {
+        EVLOOP* lobby = &lobbies[i];
+        twforeach(&lobby->wheel,[&](TIMER* timer) {
+            if(timer == &lobby->roomtimer)
+                return;
+            CONN* conn = (CONN*)timer->data;
+            if(conn->muxed)
+                addmux(static_cast<MUXCONN*>(conn));
+            else if(conn->mm.state != MM_TAKEN)         // a taken player is in the matched pairs of a lobby
+                lobbyconns.push_back({conn,conn->proto == PROTO_UNKNOWN ? LK_HELLO : LK_WAITING});
+        });
+        for(CONN* conn : lobby->room)
+            lobbyconns.push_back({conn,LK_ROOM});
+        matched.insert(matched.end(),lobby->matched.begin(),lobby->matched.end());
+    }
+    for(auto& lc : lobbyconns)
+        addmux(lc.first->mux);
+    for(CONN* conn : matched)
+        addmux(conn->mux);
+    for(int i=0;i<numloops;++i) {
+        for(auto& it : loops[i].games)
+            for(int j=0;j<2;++j)
+                addmux(it.second->conn[j].mux);
+    }
+
+    hoput(pk,(uint32_t)muxes.size());
+    for(MUXCONN* mux : muxes) {
+        hoput(pk,(int)(mux->loop - lobbies));
+        packconn(pk,mux,muxids);
+        hoput(pk,mux->closed);
+        hoputstr(pk,mux->buf,mux->buflen);
+        hoput(pk,(uint32_t)mux->seats.size());
+        for(auto& it : mux->seats) {
+            hoput(pk,it.first); hoput(pk,it.second.key); hoput(pk,it.second.left);
+        }
+    }
+    hoput(pk,(uint32_t)lobbyconns.size());
+    for(auto& lc : lobbyconns) {
+        hoput(pk,(int)(lc.first->loop - lobbies)); hoput(pk,lc.second);
+        packconn(pk,lc.first,muxids);
+    }
+    hoput(pk,(uint32_t)matched.size());
+    for(CONN* conn : matched) {
+        hoput(pk,(int)(conn->loop != NULL ? conn->loop - lobbies : 0));
+        packconn(pk,conn,muxids);
+    }
+    n = 0;
+    for(int i=0;i<numloops;++i)
+        n += loops[i].games.size();
+    hoput(pk,n);
+    for(int i=0;i<numloops;++i) {
+        for(auto& it : loops[i].games)
+            packgame(pk,it.second,i,muxids);
+    }
+}
+
+// function to read everything after the sockets of the server from the snapshot of an older server into to. the
+// ratings and records of the players are put back at once. the connections aren't touched yet, so that the old server
+// can go on serving if the snapshot is broken. returns false then
+bool unpackstate(HOREADER* rd, TAKEOVER* to) {
+    uint32_t n;
+    hoget(rd,&n);
+    for(uint32_t i=0;i<n && !rd->bad;++i) {
+        char name[MAXNAME+1];
+        name[hogetstr(rd,name,MAXNAME)] = '\0';
+        int rating;
+        hoget(rd,&rating);
+        setrating(name,rating);
+    }
+    hoget(rd,&n);
+    for(uint32_t i=0;i<n && !rd->bad;++i) {
+        char name[MAXNAME+1];
+        name[hogetstr(rd,name,MAXNAME)] = '\0';
+        uint32_t pid;
+        PLAYERREC rec;
+        hoget(rd,&pid); hoget(rd,&rec);
+        statsload(name,pid,rec);
+    }
+    hoget(rd,&n);
+    for(uint32_t i=0;i<n && !rd->bad;++i) {
+        MUXCONN* mux = new MUXCONN();
+        to->muxes.push_back(mux);
+        int lobbyidx;
+        uint32_t nseats;
+        hoget(rd,&lobbyidx);
+        if(!unpackconn(rd,mux,to) || lobbyidx < 0)
+            return false;
+        hoget(rd,&mux->closed);
+        mux->buflen = hogetstr(rd,mux->buf,MUXBUFLEN);
+        mux->muxed = true;
+        mux->loop = &lobbies[lobbyidx % numlobbies];
+        mux->refs += mux->closed ? 0 : 1;               // the lobby's reference. the seats add theirs
+        hoget(rd,&nseats);
+        for(uint32_t j=0;j<nseats && !rd->bad;++j) {
+            uint32_t tag;
+            MUXSEAT seat = {NULL,NULL,0,false};
+            hoget(rd,&tag); hoget(rd,&seat.key); hoget(rd,&seat.left);
+            mux->seats[tag] = seat;
+        }
+        if(rd->bad || (mux->fd == -1) != mux->closed)
+            return false;
+    }
+    hoget(rd,&n);
+    for(uint32_t i=0;i<n && !rd->bad;++i) {
+        int lobbyidx, kind;
+        hoget(rd,&lobbyidx); hoget(rd,&kind);
+        CONN* conn = new CONN();
+        if(!unpackconn(rd,conn,to) || lobbyidx < 0 || kind < LK_HELLO || kind > LK_ROOM ||
+           (conn->fd == -1 && conn->mux == NULL)) {
+            delete conn;
+            return false;
+        }
+        conn->loop = (conn->mux != NULL) ? conn->mux->loop : &lobbies[lobbyidx % numlobbies];
+        if(conn->mux != NULL)
+            conn->mux->seats[conn->tag].conn = conn;
+        (kind == LK_HELLO ? to->hello : (kind == LK_WAITING ? to->waiting : to->room)).push_back(conn);
+    }
+    hoget(rd,&n);
+    for(uint32_t i=0;i<n && !rd->bad;++i) {
+        int lobbyidx;
+        hoget(rd,&lobbyidx);
+        CONN* conn = new CONN();
+        to->matched.push_back(conn);
+        if(!unpackconn(rd,conn,to) || lobbyidx < 0)
+            return false;
+        conn->loop = &lobbies[lobbyidx % numlobbies];
+        if(conn->mux != NULL)
+            conn->mux->seats[conn->tag].conn = conn;
+    }
+    if(n % 2 != 0)
+        return false;
+    hoget(rd,&n);
+    for(uint32_t i=0;i<n && !rd->bad;++i) {
+        if(!unpackgame(rd,to))
+            return false;
+    }
+    return !rd->bad && rd->off == rd->buf.size();
+}
+
+// function to put the state taken over from an older server to work. the connections of the lobbies are watched
+// again and the players go on waiting where they waited. matched pairs get their games and the games are handed over
+// to their event loops, which resume them
+void resumestate(TAKEOVER* to) {
+    long long now = nowms();
+    for(MUXCONN* mux : to->muxes) {
+        if(mux->closed)
+            continue;
+        watchconn(mux,EPOLL_CTL_ADD);
+        armmux(mux);
+    }
+    for(CONN* conn : to->hello) {
+        watchconn(conn,EPOLL_CTL_ADD);
+        twadd(&conn->loop->wheel,&conn->timer,now + HELLOTIMEOUT);
+    }
+    for(CONN* conn : to->room) {
+        EVLOOP* lobby = conn->loop;
+        conn->inroom = true;
+        lobby->room.push_back(conn);
+        ++lobby->roomlen; ++roomcount;
+        epoll_event ev;
+        ev.events = EPOLLRDHUP;
+        ev.data.ptr = conn;
+        epoll_ctl(lobby->epfd,EPOLL_CTL_ADD,conn->fd,&ev);
+    }
+    for(CONN* conn : to->waiting) {
+        if(conn->mux == NULL)
+            watchconn(conn,EPOLL_CTL_ADD);
+        pairplayer(conn,true);
+    }
+    for(size_t i=0;i<to->matched.size();i+=2) {
+        newgame(to->matched[i]->loop,to->matched[i],to->matched[i+1]);
+    }
+    for(GAME* game : to->games) {
+        EVLOOP* loop = game->loop;
+        loop->newgames_mutex.lock();
+        loop->newgames.push_back(game);
+        loop->newgames_mutex.unlock();
+    }
+    for(SPECTATOR* sp : to->specs) {
+        EVLOOP* loop = sp->loop;
+        loop->newgames_mutex.lock();
+        loop->newspecs.push_back(sp);
+        loop->newgames_mutex.unlock();
+    }
+    uint64_t one = 1;
+    for(int i=0;i<numloops;++i)
+        write(loops[i].evfd,&one,sizeof one);
+    for(int i=0;i<numlobbies;++i)
+        serveroom(&lobbies[i]);
+}
+
+// function to hand the server over to the new server connected on sock. first every lobby and then every event loop
+// stops at the top of its loop, so that no game is half way through a step and every match made has reached its
+// event loop. the log is written out and the state is sent. the process exits as soon as the new server acks.
+// otherwise, the threads go on as if nothing happened
+void handoff(int sock) {
+    long long start = nowus();
+    uint64_t one = 1;
+    {
+        unique_lock<mutex> guard(parklock);
+        upgradestage = 1;
+        for(int i=0;i<numlobbies;++i)
+            write(lobbies[i].evfd,&one,sizeof one);
+        parkcv.wait(guard,[]{ return parked == numlobbies; });
+        upgradestage = 2;
+        for(int i=0;i<numloops;++i)
+            write(loops[i].evfd,&one,sizeof one);
+        parkcv.wait(guard,[]{ return parked == numlobbies + numloops; });
+    }
+    logdrain();
+    HOPACKER pk;
+    packserver(&pk);
+    timeval tv = {HOTIMEOUT / 1000,(HOTIMEOUT % 1000) * 1000};
+    setsockopt(sock,SOL_SOCKET,SO_RCVTIMEO,&tv,sizeof tv);
+    char ack = 0;
+    if(hosend(sock,&pk) && recv(sock,&ack,1,0) == 1 && ack == HOACK) {
+        printf("Handed the server over to a new process (%zu bytes, %zu fds) in %lld us. Exiting.\n",pk.buf.size(),pk.fds.size(),nowus() - start);
+        fflush(stdout);
+        capflush();
+        _exit(0);
+    }
+    printf("ERROR: the new server didn't take over. Serving on.\n");
+    unique_lock<mutex> guard(parklock);
+    upgradestage = 0;
+    parkcv.notify_all();
+    parkcv.wait(guard,[]{ return parked == 0; });
+}
+
+// function executed by the upgrade thread. every connection to the upgrade socket fd is a new server that takes over
+// once it is ready to
+void runupgrade(int fd) {
+    while(1) {
+        int sock;
+        if((sock = accept(fd,NULL,NULL)) == -1) {
+            if(errno != EINTR)
+                perror("ERROR - upgrade accept failed.");
+            continue;
+        }
+        char ask;
+        if(recv(sock,&ask,1,0) == 1 && ask == HOASK)
+            handoff(sock);
+        close(sock);
+    }
+}
+
+int main(int argc, char** argv) {
+
+    if(argc < 2) {
+        cout << USAGE;
+        exit(-1);
+    }
+
+    // parse the options given after the port number. -e n -> play the games in n event loop threads
+    // instead of one thread per game. -m n -> allow at most n players at any time. -g n -> write logged
+    // games to LOGFILE at least every n ms. -y -> fsync LOGFILE after every write. -H dir -> also keep
+    // every game in the persistent history of dir (see gamestore.h). -b n -> a player who has waited n ms for a
+    // partner plays against the server's bot. -d n -> n% of the bot's moves are perfect. -a n -> accept and pair
+    // players in n lobby threads, each with its own listening socket. -p -> pin lobby and event loop threads to cores.
+    // -M n -> serve the metrics of the server on port n of the loopback address. -q n -> let at most n players wait
+    // for a free slot when the server is full. -u path -> take over from the server listening at the Unix socket path
+    // (if there is one) and let a newer server take over from this one through path later. -R file -> capture the
+    // traffic of the clients into file, to replay it later (see capture.h)
+    int opt;
+    int flushms = LOGFLUSHMS;
+    bool dosync = false;
+    const char* histdir = NULL;
+    const char* capfile = NULL;
+    while((opt = getopt(argc - 1,argv + 1,"e:m:g:yH:b:d:a:pM:q:u:R:T")) != -1) {
+        if(opt == 'e') {
+            numloops = max(1,atoi(optarg));
+        }
+        else if(opt == 'm') {
+            maxplayers = max(2,atoi(optarg));
+        }
+        else if(opt == 'g') {
+            flushms = max(0,atoi(optarg));
+        }
+        else if(opt == 'y') {
+            dosync = true;
+        }
+        else if(opt == 'H') {
+            histdir = optarg;
+        }
+        else if(opt == 'b') {
+            botwait = max(0,atoi(optarg));
+        }
+        else if(opt == 'd') {
+            botlevel = min(100,max(0,atoi(optarg)));
+        }
+        else if(opt == 'a') {
+            numlobbies = max(1,atoi(optarg));
+        }
+        else if(opt == 'p') {
+            pinthreads = true;
+        }
+        else if(opt == 'M') {
+            adminport = atoi(optarg);
+        }
+        else if(opt == 'q') {
+            roomsize = max(0,atoi(optarg));
+        }
+        else if(opt == 'u') {
+            upgradepath = optarg;
+        }
+        else if(opt == 'R') {
+            capfile = optarg;
+        }
+        else if(opt == 'T') {
+            traceon = true;
+        }
+        else {
+            cout << USAGE;
+            exit(-1);
+        }
+    }
+
+    struct sockaddr_in servaddr;                        // internet address of server
+    memset(&servaddr,0,sizeof servaddr);                // zero out servaddr
+    servaddr.sin_family = AF_INET;                      // use IPv4 address family
+    servaddr.sin_port = htons((short)atoi(MYPORT));     // set server's port number
+    servaddr.sin_addr.s_addr = INADDR_ANY;              // use the ip address of the current machine
+
+    // initialize the global atomic variables appropriately. Both game and player ids start with 1
+    // and there are no active players initially
+    pidcounter = 1; gidcounter = 1;
+    activeplayers = 0; roomcount = 0;
+
+    // with -u, a server that listens at upgradepath hands itself over. it keeps serving till this server is ready
+    if(upgradepath != NULL && numloops == 0) {
+        cout << "ERROR: a server can be handed over only in event loop mode (-e)." << endl;
+        exit(-1);
+    }
+    int hosock = (upgradepath != NULL) ? hoconnect(upgradepath) : -1;
+
+    // block SIGUSR1 and SIGUSR2 in every thread. the lobby takes them from a signalfd
+    sigset_t usr;
+    sigemptyset(&usr); sigaddset(&usr,SIGUSR1); sigaddset(&usr,SIGUSR2);
+    pthread_sigmask(SIG_BLOCK,&usr,NULL);
+    sigfd = signalfd(-1,&usr,SFD_NONBLOCK);
+
+    // create an empty LOGFILE (unless the games of the old server are logged in it) and start its writer thread. games
+    // logged before SIGINT or SIGTERM are still written. the history of the old server is opened once it has written it
+    if(hosock == -1) {
+        ofstream f; f.open(LOGFILE); f.close();
+        if(histdir != NULL)
+            storeopen(histdir);
+    }
+    loginit(LOGFILE,flushms,dosync);
+    signal(SIGINT,onstop); signal(SIGTERM,onstop);
+    if(capfile != NULL)
+        capopen(capfile);
+
+    // start the event loops if the games are to be played by them
+    if(numloops > 0) {
+        startloops();
+    }
+
+    // ask the old server to hand over. its id counters and sockets come first in its snapshot
+    HOREADER snap;
+    int oldlobbies = 0, oldadminport = 0, oldadminfd = -1;
+    vector<int> listenfds;
+    string oldpath;
+    long long takestart = nowus();
+    if(hosock != -1) {
+        char ask = HOASK;
+        if(!hosendall(hosock,&ask,1) || !horecv(hosock,&snap)) {
+            cout << "ERROR: the running server didn't hand over its state (is it a build with another snapshot format?)" << endl;
+            exit(-1);
+        }
+        uint pid, gid;
+        uint64_t seat;
+        hoget(&snap,&pid); hoget(&snap,&gid); hoget(&snap,&seat);
+        pidcounter = pid; gidcounter = gid; seatcounter = seat;
+        hoget(&snap,&oldlobbies);
+        for(int i=0;i<oldlobbies && !snap.bad;++i)
+            listenfds.push_back(hogetfd(&snap));
+        hogetstr(&snap,&oldpath);
+        upgradefd = hogetfd(&snap);
+        hoget(&snap,&oldadminport);
+        oldadminfd = hogetfd(&snap);
+        if(snap.bad) {
+            cout << "ERROR: the state of the running server is broken." << endl;
+            exit(-1);
+        }
+        numlobbies = max(numlobbies,oldlobbies);        // a listening socket of the old server is never closed with its pending connections
+    }
+
+    // create the lobbies with their listening sockets
+    lobbies = new EVLOOP[numlobbies]();
+    for(int i=0;i<numlobbies;++i) {
+        initloop(&lobbies[i]);
+        lobbies[i].listenfd = (i < (int)listenfds.size()) ? listenfds[i] : listensocket(&servaddr);
+        lobbies[i].sparefd = open("/dev/null",O_RDONLY);
+    }
+    cout << "Game server started. Waiting for players ... " << endl;
+
+    // read the rest of the state of the old server and ack it, which makes the old server exit. nothing has been
+    // sent to a client so far, so the old server can go on serving if the state is broken
+    TAKEOVER to;
+    if(hosock != -1) {
+        char ack = HOACK;
+        if(!unpackstate(&snap,&to) || !hosendall(hosock,&ack,1)) {
+            cout << "ERROR: taking over from the running server failed. It goes on serving." << endl;
+            exit(-1);
+        }
+        close(hosock);
+        if(histdir != NULL)
+            storeopen(histdir);
+    }
+
+    // serve the metrics on the admin port (after SIGUSR1 and SIGUSR2 have been blocked, so that the admin thread doesn't take them).
+    // the admin socket of the old server is kept if it is on the same port
+    if(oldadminfd != -1 && oldadminport != adminport) {
+        close(oldadminfd);
+        oldadminfd = -1;
+    }
+    if(adminport > 0) {
+        startadmin(adminport,oldadminfd);
+    }
+
+    // put the games and players of the old server to work and let a newer server take over later
+    if(hosock != -1) {
+        resumestate(&to);
+        printf("Took over %zu games, %zu waiting players and %zu multiplexed connections in %lld us.\n",to.games.size(),
+               to.waiting.size() + to.room.size() + to.matched.size(),to.muxes.size(),nowus() - takestart);
+        fflush(stdout);
+    }
+    if(upgradefd != -1 && oldpath != upgradepath) {
+        close(upgradefd);
+        upgradefd = -1;
+    }
+    if(upgradepath != NULL && upgradefd == -1 && (upgradefd = holisten(upgradepath)) == -1) {
+        perror("ERROR - upgrade socket creation failed"); exit(-1);
+    }
+    if(upgradefd != -1) {
+        thread newth(runupgrade,upgradefd);
+        newth.detach();
+    }
+
+    // accept and pair players till the server is killed. lobby 0 runs in the main thread
+    for(int i=1;i<numlobbies;++i) {
+        thread newth(runlobby,&lobbies[i]);
+        pinthread(newth.native_handle(),i);
+        newth.detach();
+    }
+    pinthread(pthread_self(),0);
+    runlobby(&lobbies[0]);
+    return 0;
+}
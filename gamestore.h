@@ -0,0 +1,378 @@
+/*
+    gamestore.h = Persistent, indexed history of finished games for the TicTacToe server
+    Author = Vikram, CS19B021
+    Purpose = Keeps every finished game as a compact binary record in size-rotated segment files of a history
+              directory, which (unlike LOGFILE) is never truncated. Every segment has two sidecar indexes that map
+              game ids and player ids to record offsets, so a game or a player's games can be found without a scan.
+    Layout = DIR/seg-N.dat holds the records of segment N, one after another. A record is its body len (varint)
+             and a body of varints gameid, pid1, pid2, starttime, duration, then a byte with cause (bits 0-2),
+             winner - 1 (bit 3) and num of moves (bits 4-7), then the moves, two per byte (cell (r-1)*3+(c-1) in
+             each nibble, low nibble first). A game on another board than 3x3 has 15 moves in the byte. Its moves
+             follow as its variant (see mnkboard.h), its num of moves (varint) and a byte (r << 4) | c per move. DIR/seg-N.gidx and DIR/seg-N.pidx are arrays of IDXENTRY sorted by
+             key. The segment being written has its unsorted indexes in DIR/seg-N.gidx.open and DIR/seg-N.pidx.open
+             and they are sorted into their final names when the segment is sealed.
+*/
+#ifndef GAMESTORE_H
+#define GAMESTORE_H
+#include <bits/stdc++.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include "mnkboard.h"
+#define LOGMAXMOVES MNKMAXCELLS                                         // max num of moves in a game
+#define STORESEGSIZE (64 << 20)                                         // size (in bytes) after which a segment is sealed
+#define STOREMAXREC 320                                                 // max size of an encoded record
+#define STOREWIDE 15                                                    // num of moves in the flags of a record of a game not on a 3x3 board
+
+// structure to represent a finished game in the log. moves are stored as (r << 4) | c with 1-indexed r and c.
+// player 1 always makes the first move and the players alternate, so the player of move i is i % 2 + 1
+struct LOGREC {
+    uint32_t gameid, pid1, pid2;                                        // ids of the game and its players
+    int64_t starttime, endtime;                                         // start time and end time resp.
+    uint8_t cause;                                                      // cause for completion, as in GAME
+    uint8_t winner;                                                     // winner of the game (1 or 2) if cause = 1
+    uint8_t variant;                                                    // board of the game (see mnkboard.h). 0 -> 3x3
+    uint8_t nmoves;                                                     // num of moves made
+    uint8_t moves[LOGMAXMOVES];                                         // moves made
+};
+
+// structure to represent an index entry. key is a game id or a player id and off is the offset of the record
+struct IDXENTRY {
+    uint32_t key;
+    uint32_t off;
+    bool operator<(const IDXENTRY& o) const {
+        return key != o.key ? key < o.key : off < o.off;
+    }
+};
+
+// structure to represent the segment being written
+struct GAMESTORE {
+    std::string dir;                                                    // history directory. empty -> no store
+    int segno;                                                          // num of the segment being written
+    int datfd, gidxfd, pidxfd;                                          // fds of its record file and its indexes
+    uint64_t segsize;                                                   // num of bytes written to its record file
+    std::string dat, gidx, pidx;                                        // bytes not written yet
+};
+
+GAMESTORE gamestore;
+
+// function to append rec to out as a [NEW ENTRY] block. the block is exactly what the server has always logged.
+// a game on another board than 3x3 has one more line with its board after the result
+inline void formatrec(const LOGREC* rec, std::string& out) {
+    char buf[4096], st[32], et[32];
+    time_t starttime = rec->starttime, endtime = rec->endtime;
+    time_t duration = endtime - starttime;                              // duration of game
+    ctime_r(&starttime,st); ctime_r(&endtime,et);
+    int len = snprintf(buf,sizeof buf,
+        "______________________________________________________________________________________________________________________________\n"
+        "[NEW ENTRY]\nGame ID = %u\nPlayer 1 ID = %u\nPlayer 2 ID = %u\nStart Time = %sEnd Time = %sDuration = %ld m %ld s\nMoves Made = <",
+        rec->gameid,rec->pid1,rec->pid2,st,et,(long)(duration/60),(long)(duration % 60));
+    // write the move sequence
+    for(int i=0;i<rec->nmoves;++i) {
+        len += snprintf(buf + len,sizeof buf - len,"(PLR%d,%d,%d)%s",i % 2 + 1,rec->moves[i] >> 4,rec->moves[i] & 15,
+                        (i + 1 != rec->nmoves) ? ", " : "");
+    }
+    out.append(buf,len);
+    // write game result. game result depends on cause and winner
+    if(rec->cause == 1) {
+        len = snprintf(buf,sizeof buf,">\nResult = Player %d won the game.\n",rec->winner);
+        out.append(buf,len);
+    }
+    else if(rec->cause == 2) {
+        out += ">\nResult = The game was a draw.\n";
+    }
+    else if(rec->cause == 3) {
+        out += ">\nResult = The game was quitted due to inactivity.\n";
+    }
+    else {
+        out += ">\nResult = The game was quitted due to disconnection.\n";
+    }
+    if(rec->variant != 0) {
+        const VARIANT* v = &variants[rec->variant];
+        len = snprintf(buf,sizeof buf,"Board = %dx%d, %d in a row\n",v->m,v->n,v->k);
+        out.append(buf,len);
+    }
+}
+
+// function to write val as a varint (7 bits per byte, low bits first) at out. returns the num of bytes written
+inline int putvarint(uint8_t* out, uint64_t val) {
+    int n = 0;
+    while(val >= 0x80) {
+        out[n++] = (val & 0x7F) | 0x80;
+        val >>= 7;
+    }
+    out[n++] = val;
+    return n;
+}
+
+// function to read a varint from the n bytes at in into val. returns the num of bytes read, or 0 if it is cut short
+inline int getvarint(const uint8_t* in, int n, uint64_t* val) {
+    *val = 0;
+    for(int i=0;i<n && i<10;++i) {
+        *val |= (uint64_t)(in[i] & 0x7F) << (7 * i);
+        if(!(in[i] & 0x80))
+            return i + 1;
+    }
+    return 0;
+}
+
+// function to encode rec as a record (len + body) at out. returns the size of the record
+inline int encoderec(const LOGREC* rec, uint8_t* out) {
+    uint8_t body[STOREMAXREC];
+    int n = 0;
+    n += putvarint(body + n,rec->gameid);
+    n += putvarint(body + n,rec->pid1);
+    n += putvarint(body + n,rec->pid2);
+    n += putvarint(body + n,rec->starttime);
+    n += putvarint(body + n,rec->endtime - rec->starttime);
+    if(rec->variant != 0) {
+        body[n++] = (rec->cause & 7) | ((rec->winner == 2) << 3) | (STOREWIDE << 4);
+        body[n++] = rec->variant;
+        n += putvarint(body + n,rec->nmoves);
+        memcpy(body + n,rec->moves,rec->nmoves);
+        n += rec->nmoves;
+        int len = putvarint(out,n);
+        memcpy(out + len,body,n);
+        return len + n;
+    }
+    body[n++] = (rec->cause & 7) | ((rec->winner == 2) << 3) | (rec->nmoves << 4);
+    for(int i=0;i<rec->nmoves;i+=2) {
+        int lo = ((rec->moves[i] >> 4) - 1) * 3 + (rec->moves[i] & 15) - 1;
+        int hi = (i + 1 < rec->nmoves) ? ((rec->moves[i+1] >> 4) - 1) * 3 + (rec->moves[i+1] & 15) - 1 : 0;
+        body[n++] = lo | (hi << 4);
+    }
+    int len = putvarint(out,n);
+    memcpy(out + len,body,n);
+    return len + n;
+}
+
+// function to decode the record at the n bytes at in into rec. returns the size of the record,
+// or 0 if the bytes don't hold a whole valid record
+inline int decoderec(const uint8_t* in, int n, LOGREC* rec) {
+    uint64_t len, val[5];
+    int pos = getvarint(in,n,&len);
+    if(pos == 0 || len > STOREMAXREC || pos + (int)len > n)
+        return 0;
+    int end = pos + len;
+    for(int i=0;i<5;++i) {
+        int got = getvarint(in + pos,end - pos,&val[i]);
+        if(got == 0)
+            return 0;
+        pos += got;
+    }
+    if(pos >= end)
+        return 0;
+    rec->gameid = val[0]; rec->pid1 = val[1]; rec->pid2 = val[2];
+    rec->starttime = val[3]; rec->endtime = val[3] + val[4];
+    uint8_t flags = in[pos++];
+    rec->cause = flags & 7;
+    rec->winner = (flags & 8) ? 2 : 1;
+    rec->nmoves = flags >> 4;
+    rec->variant = 0;
+    if(rec->nmoves == STOREWIDE) {
+        uint64_t nmoves;
+        int got = (pos < end) ? getvarint(in + pos + 1,end - pos - 1,&nmoves) : 0;
+        if(got == 0 || in[pos] == 0 || in[pos] >= NVARIANTS || nmoves > LOGMAXMOVES || pos + 1 + got + (int)nmoves > end)
+            return 0;
+        rec->variant = in[pos];
+        rec->nmoves = nmoves;
+        memcpy(rec->moves,in + pos + 1 + got,nmoves);
+        return end;
+    }
+    if(rec->nmoves > 9 || pos + (rec->nmoves + 1) / 2 > end)
+        return 0;
+    for(int i=0;i<rec->nmoves;++i) {
+        int cell = (in[pos + i/2] >> (4 * (i % 2))) & 15;
+        rec->moves[i] = ((cell / 3 + 1) << 4) | (cell % 3 + 1);
+    }
+    return end;
+}
+
+// function to return the path of a file of segment segno with the given suffix
+inline std::string segpath(const std::string& dir, int segno, const char* suffix) {
+    char name[64];
+    snprintf(name,sizeof name,"/seg-%06d%s",segno,suffix);
+    return dir + name;
+}
+
+// function to sort the unsorted index path + ".open" into path
+inline void sealindex(const std::string& path) {
+    std::string open = path + ".open";
+    std::ifstream fin(open,std::ios::binary);
+    if(!fin)
+        return;
+    std::vector<IDXENTRY> entries;
+    IDXENTRY e;
+    while(fin.read((char*)&e,sizeof e))
+        entries.push_back(e);
+    std::sort(entries.begin(),entries.end());
+    std::string tmp = path + ".tmp";
+    std::ofstream fout(tmp,std::ios::binary|std::ios::trunc);
+    fout.write((const char*)entries.data(),entries.size() * sizeof(IDXENTRY));
+    fout.close();
+    rename(tmp.c_str(),path.c_str());
+    unlink(open.c_str());
+}
+
+// function to return the nums of all the segments in dir in ascending order
+inline std::vector<int> listsegments(const std::string& dir) {
+    std::vector<int> segs;
+    DIR* d = opendir(dir.c_str());
+    if(d == NULL)
+        return segs;
+    dirent* ent;
+    while((ent = readdir(d)) != NULL) {
+        int segno;
+        char suffix[8];
+        if(sscanf(ent->d_name,"seg-%d.%4s",&segno,suffix) == 2 && strcmp(suffix,"dat") == 0)
+            segs.push_back(segno);
+    }
+    closedir(d);
+    std::sort(segs.begin(),segs.end());
+    return segs;
+}
+
+// function to start a new segment after the last one in the history directory
+inline void opensegment() {
+    gamestore.segno++;
+    gamestore.segsize = 0;
+    gamestore.datfd = open(segpath(gamestore.dir,gamestore.segno,".dat").c_str(),O_WRONLY|O_CREAT|O_APPEND,0644);
+    gamestore.gidxfd = open(segpath(gamestore.dir,gamestore.segno,".gidx.open").c_str(),O_WRONLY|O_CREAT|O_APPEND,0644);
+    gamestore.pidxfd = open(segpath(gamestore.dir,gamestore.segno,".pidx.open").c_str(),O_WRONLY|O_CREAT|O_APPEND,0644);
+    if(gamestore.datfd == -1 || gamestore.gidxfd == -1 || gamestore.pidxfd == -1) {
+        perror("ERROR - history segment creation failed"); exit(-1);
+    }
+}
+
+// function to open the history directory dir for writing. segments left unsealed by an earlier run
+// are sealed and the new records go to a new segment
+inline void storeopen(const char* dir) {
+    gamestore.dir = dir;
+    mkdir(dir,0755);
+    std::vector<int> segs = listsegments(gamestore.dir);
+    for(int segno : segs) {
+        sealindex(segpath(gamestore.dir,segno,".gidx"));
+        sealindex(segpath(gamestore.dir,segno,".pidx"));
+    }
+    gamestore.segno = segs.empty() ? 0 : segs.back();
+    opensegment();
+}
+
+// function to add rec to the buffers of the segment being written
+inline void storeappend(const LOGREC* rec) {
+    uint8_t buf[STOREMAXREC + 8];
+    uint32_t off = gamestore.segsize + gamestore.dat.size();
+    gamestore.dat.append((char*)buf,encoderec(rec,buf));
+    IDXENTRY e[2] = {{rec->pid1,off},{rec->pid2,off}};
+    IDXENTRY g = {rec->gameid,off};
+    gamestore.gidx.append((char*)&g,sizeof g);
+    gamestore.pidx.append((char*)e,sizeof e);
+}
+
+// function to write all the bytes of buf to fd
+inline void storewrite(int fd, std::string& buf) {
+    size_t done = 0;
+    while(done < buf.size()) {
+        ssize_t ret = write(fd,buf.data() + done,buf.size() - done);
+        if(ret < 0) {
+            if(errno == EINTR)
+                continue;
+            perror("ERROR - history write failed.");
+            break;
+        }
+        done += ret;
+    }
+    buf.clear();
+}
+
+// function to write the buffered records and index entries (and fsync them if dosync is true).
+// the segment is sealed and a new one is started once it reaches STORESEGSIZE
+inline void storeflush(bool dosync) {
+    if(gamestore.dir.empty() || gamestore.dat.empty())
+        return;
+    gamestore.segsize += gamestore.dat.size();
+    // records go first, so an index entry never points past the end of the record file
+    storewrite(gamestore.datfd,gamestore.dat);
+    if(dosync)
+        fdatasync(gamestore.datfd);
+    storewrite(gamestore.gidxfd,gamestore.gidx);
+    storewrite(gamestore.pidxfd,gamestore.pidx);
+    if(dosync) {
+        fdatasync(gamestore.gidxfd); fdatasync(gamestore.pidxfd);
+    }
+    if(gamestore.segsize >= STORESEGSIZE) {
+        close(gamestore.datfd); close(gamestore.gidxfd); close(gamestore.pidxfd);
+        sealindex(segpath(gamestore.dir,gamestore.segno,".gidx"));
+        sealindex(segpath(gamestore.dir,gamestore.segno,".pidx"));
+        opensegment();
+    }
+}
+
+// structure to represent a whole file mapped into memory for reading
+struct MAPPED {
+    const uint8_t* data;
+    size_t size;
+};
+
+// function to map the file at path. size = 0 if it doesn't exist or is empty
+inline MAPPED mapfile(const std::string& path) {
+    MAPPED m = {NULL,0};
+    int fd = open(path.c_str(),O_RDONLY);
+    struct stat st;
+    if(fd == -1)
+        return m;
+    if(fstat(fd,&st) == 0 && st.st_size > 0) {
+        void* p = mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+        if(p != MAP_FAILED) {
+            m.data = (const uint8_t*)p;
+            m.size = st.st_size;
+        }
+    }
+    close(fd);
+    return m;
+}
+
+inline void unmapfile(MAPPED m) {
+    if(m.size > 0)
+        munmap((void*)m.data,m.size);
+}
+
+// function to find the offsets of the records of segment segno whose key (game id or player id, as given by
+// the index suffix ".gidx" or ".pidx") is key. sealed indexes are binary searched and the index of the
+// segment being written is scanned
+inline std::vector<uint32_t> lookupsegment(const std::string& dir, int segno, const char* suffix, uint32_t key) {
+    std::vector<uint32_t> offs;
+    MAPPED m = mapfile(segpath(dir,segno,suffix));
+    bool sealed = (m.size > 0);
+    if(!sealed)
+        m = mapfile(segpath(dir,segno,suffix) + ".open");
+    const IDXENTRY* first = (const IDXENTRY*)m.data;
+    const IDXENTRY* last = first + m.size / sizeof(IDXENTRY);
+    if(sealed) {
+        IDXENTRY k = {key,0};
+        for(const IDXENTRY* e = std::lower_bound(first,last,k);e != last && e->key == key;++e)
+            offs.push_back(e->off);
+    }
+    else {
+        for(const IDXENTRY* e = first;e != last;++e)
+            if(e->key == key)
+                offs.push_back(e->off);
+    }
+    unmapfile(m);
+    return offs;
+}
+
+// function to read the record at offset off of segment segno into rec. returns false if there is none
+inline bool readrecord(const std::string& dir, int segno, uint32_t off, LOGREC* rec) {
+    uint8_t buf[STOREMAXREC + 8];
+    int fd = open(segpath(dir,segno,".dat").c_str(),O_RDONLY);
+    if(fd == -1)
+        return false;
+    int n = pread(fd,buf,sizeof buf,off);
+    close(fd);
+    return n > 0 && decoderec(buf,n,rec) > 0;
+}
+
+#endif
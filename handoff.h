@@ -0,0 +1,253 @@
+/*
+    handoff.h = Handoff of a running TicTacToe server to a new server process
+    Author = Vikram, CS19B021
+    Purpose = A new server process connects to the Unix socket of the running one, gets ready to serve and then asks
+              it to hand over. The old server stops its threads, packs its state into a snapshot (a string of fields
+              in a fixed order) and sends it together with every fd the snapshot refers to. The fds go as SCM_RIGHTS
+              ancillary data in batches of HOMAXFDS, and the snapshot refers to a fd by its index among them. The new
+              server rebuilds itself from the snapshot and acks. Only then does the old server exit. Without an ack
+              within HOTIMEOUT ms, the old server goes on serving as if nothing happened. HOPACKER writes the fields
+              of a snapshot and HOREADER reads them back. A reader that runs out of data is marked bad instead of
+              failing, so the snapshot can be checked once at the end.
+*/
+#ifndef HANDOFF_H
+#define HANDOFF_H
+#include <bits/stdc++.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <fcntl.h>
+#include <unistd.h>
+#define HOMAGIC 0x54545355                                              // first field of the header of a snapshot
+#define HOVERSION 1                                                     // version of the snapshot format. only equal versions hand over
+#define HOMAXFDS 250                                                    // max num of fds sent with one sendmsg()
+#define HOTIMEOUT 5000                                                  // time (in ms) the old server waits for the ack of the new one
+#define HOASK 'U'                                                       // byte the new server asks for the handoff with
+#define HOACK 'K'                                                       // byte the new server acks with
+
+// structure to represent the header of a snapshot on the socket
+struct HOHEADER {
+    uint32_t magic, version;
+    uint64_t len;                                                       // num of bytes of the snapshot
+    uint32_t nfds;                                                      // num of fds sent after it
+};
+
+// structure to represent a snapshot being written
+struct HOPACKER {
+    std::string buf;
+    std::vector<int> fds;                                               // fds to send, in the order of their indexes
+};
+
+// structure to represent a snapshot being read
+struct HOREADER {
+    std::string buf;
+    size_t off;                                                         // num of bytes read so far
+    std::vector<int> fds;                                               // recved fds by index
+    bool bad;                                                           // true iff a read went past the end or an index was out of range
+};
+
+// function to add the field v, a plain value, to the snapshot
+template<typename T>
+inline void hoput(HOPACKER* pk, const T& v) {
+    static_assert(std::is_trivially_copyable<T>::value, "only plain values can be packed");
+    pk->buf.append((const char*)&v,sizeof v);
+}
+
+// function to add len bytes of data to the snapshot
+inline void hoputstr(HOPACKER* pk, const char* data, size_t len) {
+    hoput(pk,(uint32_t)len);
+    pk->buf.append(data,len);
+}
+
+// function to add the fd to the fds to send and its index to the snapshot. fd = -1 -> no fd
+inline void hoputfd(HOPACKER* pk, int fd) {
+    int idx = -1;
+    if(fd != -1) {
+        idx = pk->fds.size();
+        pk->fds.push_back(fd);
+    }
+    hoput(pk,idx);
+}
+
+// function to read the next field of the snapshot into v. v is zeroed if the snapshot is short
+template<typename T>
+inline void hoget(HOREADER* rd, T* v) {
+    if(rd->off + sizeof *v > rd->buf.size()) {
+        memset((void*)v,0,sizeof *v);
+        rd->bad = true;
+        return;
+    }
+    memcpy((void*)v,rd->buf.data() + rd->off,sizeof *v);
+    rd->off += sizeof *v;
+}
+
+// function to read the next bytes field of the snapshot into out, which has room for max bytes. returns the num of
+// bytes read. a field longer than max makes the snapshot bad
+inline size_t hogetstr(HOREADER* rd, char* out, size_t max) {
+    uint32_t len;
+    hoget(rd,&len);
+    if(len > max || rd->off + len > rd->buf.size()) {
+        rd->bad = true;
+        return 0;
+    }
+    memcpy(out,rd->buf.data() + rd->off,len);
+    rd->off += len;
+    return len;
+}
+
+// function to read the next bytes field of the snapshot into out
+inline void hogetstr(HOREADER* rd, std::string* out) {
+    uint32_t len;
+    hoget(rd,&len);
+    if(rd->off + len > rd->buf.size()) {
+        rd->bad = true;
+        return;
+    }
+    out->assign(rd->buf.data() + rd->off,len);
+    rd->off += len;
+}
+
+// function to read the next fd field of the snapshot. returns the recved fd or -1 for no fd
+inline int hogetfd(HOREADER* rd) {
+    int idx;
+    hoget(rd,&idx);
+    if(idx == -1)
+        return -1;
+    if(idx < 0 || idx >= (int)rd->fds.size()) {
+        rd->bad = true;
+        return -1;
+    }
+    return rd->fds[idx];
+}
+
+// function to fill addr with the Unix socket address path. returns false if path is too long
+inline bool hoaddr(sockaddr_un* addr, const char* path) {
+    memset(addr,0,sizeof *addr);
+    addr->sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof addr->sun_path)
+        return false;
+    strcpy(addr->sun_path,path);
+    return true;
+}
+
+// function to connect to the server listening at the Unix socket path. returns the connection fd or -1 if no server
+// listens there
+inline int hoconnect(const char* path) {
+    sockaddr_un addr;
+    int fd;
+    if(!hoaddr(&addr,path) || (fd = socket(AF_UNIX,SOCK_STREAM,0)) == -1)
+        return -1;
+    if(connect(fd,(sockaddr*)&addr,sizeof addr) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// function to create a Unix socket listening at path. a stale socket file is replaced. returns -1 on failure
+inline int holisten(const char* path) {
+    sockaddr_un addr;
+    int fd;
+    if(!hoaddr(&addr,path) || (fd = socket(AF_UNIX,SOCK_STREAM,0)) == -1)
+        return -1;
+    unlink(path);
+    if(bind(fd,(sockaddr*)&addr,sizeof addr) != 0 || listen(fd,4) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// function to send the len bytes of data on the socket. returns false on failure
+inline bool hosendall(int sock, const char* data, size_t len) {
+    while(len > 0) {
+        ssize_t ret = send(sock,data,len,MSG_NOSIGNAL);
+        if(ret < 0 && errno == EINTR)
+            continue;
+        if(ret <= 0)
+            return false;
+        data += ret; len -= ret;
+    }
+    return true;
+}
+
+// function to recv exactly len bytes from the socket into data. returns false on failure
+inline bool horecvall(int sock, char* data, size_t len) {
+    while(len > 0) {
+        ssize_t ret = recv(sock,data,len,0);
+        if(ret < 0 && errno == EINTR)
+            continue;
+        if(ret <= 0)
+            return false;
+        data += ret; len -= ret;
+    }
+    return true;
+}
+
+// function to send the snapshot of pk and its fds on the socket. each batch of fds rides on one byte, so that the
+// reader gets exactly one batch per recvmsg(). returns false on failure
+inline bool hosend(int sock, const HOPACKER* pk) {
+    HOHEADER hdr = {HOMAGIC,HOVERSION,pk->buf.size(),(uint32_t)pk->fds.size()};
+    if(!hosendall(sock,(const char*)&hdr,sizeof hdr) || !hosendall(sock,pk->buf.data(),pk->buf.size()))
+        return false;
+    std::vector<char> ctl(CMSG_SPACE(sizeof(int) * HOMAXFDS));
+    for(size_t i=0;i<pk->fds.size();i+=HOMAXFDS) {
+        size_t n = std::min((size_t)HOMAXFDS,pk->fds.size() - i);
+        char byte = 0;
+        iovec iov = {&byte,1};
+        msghdr mh;
+        memset(&mh,0,sizeof mh);
+        mh.msg_iov = &iov; mh.msg_iovlen = 1;
+        mh.msg_control = ctl.data(); mh.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+        cmsghdr* cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_SOCKET; cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(int) * n);
+        memcpy(CMSG_DATA(cm),pk->fds.data() + i,sizeof(int) * n);
+        ssize_t ret;
+        while((ret = sendmsg(sock,&mh,MSG_NOSIGNAL)) < 0 && errno == EINTR);
+        if(ret != 1)
+            return false;
+    }
+    return true;
+}
+
+// function to recv a snapshot and its fds from the socket into rd. returns false on failure or if the snapshot has
+// another format than this build. the fds recved so far are kept in rd->fds either way
+inline bool horecv(int sock, HOREADER* rd) {
+    HOHEADER hdr;
+    rd->off = 0;
+    rd->bad = false;
+    if(!horecvall(sock,(char*)&hdr,sizeof hdr) || hdr.magic != HOMAGIC || hdr.version != HOVERSION)
+        return false;
+    rd->buf.resize(hdr.len);
+    if(!horecvall(sock,&rd->buf[0],hdr.len))
+        return false;
+    // grow the fd table once for all the fds to come. growing it step by step as they arrive is slow in a process
+    // with threads, since every step waits for the other threads
+    int top = fcntl(sock,F_DUPFD,(int)(sock + hdr.nfds + 64));
+    if(top != -1)
+        close(top);
+    std::vector<char> ctl(CMSG_SPACE(sizeof(int) * HOMAXFDS));
+    while(rd->fds.size() < hdr.nfds) {
+        char byte;
+        iovec iov = {&byte,1};
+        msghdr mh;
+        memset(&mh,0,sizeof mh);
+        mh.msg_iov = &iov; mh.msg_iovlen = 1;
+        mh.msg_control = ctl.data(); mh.msg_controllen = ctl.size();
+        ssize_t ret;
+        while((ret = recvmsg(sock,&mh,0)) < 0 && errno == EINTR);
+        if(ret != 1 || (mh.msg_flags & MSG_CTRUNC))
+            return false;
+        for(cmsghdr* cm = CMSG_FIRSTHDR(&mh);cm != NULL;cm = CMSG_NXTHDR(&mh,cm)) {
+            if(cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS)
+                continue;
+            size_t n = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            size_t at = rd->fds.size();
+            rd->fds.resize(at + n);
+            memcpy(rd->fds.data() + at,CMSG_DATA(cm),sizeof(int) * n);
+        }
+    }
+    return rd->fds.size() == hdr.nfds;
+}
+
+#endif
@@ -0,0 +1,208 @@
+/*
+    leaderboard.h = In-memory player records and leaderboard of the TicTacToe server
+    Author = Vikram, CS19B021
+    Purpose = Keeps the record (games, wins, losses, draws, timeouts, disconnects and rating) of every player in
+              STATSHARDS lock-striped shards. Named players are kept by name, like their ratings, so their records
+              last across sessions. Anonymous players are kept by player id for the length of their session. A
+              record is updated only when a game finishes, by whoever drives the game, so moves never touch it.
+              Named players are also ranked by rating in one ordered index. The two records of a game and the
+              index are updated in one critical section, and whenever the top LEADERK change, an immutable
+              snapshot of them is published. Readers of the leaderboard just take the current snapshot: it is
+              always the top LEADERK at some instant, and reading it takes no lock.
+*/
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+#include <bits/stdc++.h>
+#define STATSHARDS 64                                                   // num of shards of the table of records
+#define LEADERK 10                                                      // num of players on the leaderboard
+
+// what a finished game means for one of its players. SR_TIMEOUT -> the player ran out of time,
+// SR_OPPTIMEOUT -> its partner did
+enum STATRESULT { SR_WIN, SR_LOSS, SR_DRAW, SR_TIMEOUT, SR_OPPTIMEOUT, SR_DISCONNECT };
+
+// structure to represent the record of a player
+struct PLAYERREC {
+    uint32_t games, wins, losses, draws, timeouts, disconnects;        // timeouts = times the player ran out of time
+    int rating;
+};
+
+// structure to represent a player of a finished game for statsrecord()
+struct STATPLAYER {
+    const char* name;                                                   // "" -> anonymous player
+    uint32_t pid;                                                       // player id. 0 -> the server's bot, which isn't recorded
+    int rating;                                                         // rating after the game
+    STATRESULT result;
+};
+
+// structure to represent a shard of the records
+struct STATSHARD {
+    std::mutex lock;
+    std::unordered_map<std::string,PLAYERREC> named;                    // records of named players
+    std::unordered_map<uint32_t,PLAYERREC> anon;                        // records of anonymous players by player id
+};
+
+// structure to represent a player on the leaderboard
+struct LEADER {
+    std::string name;
+    PLAYERREC rec;
+};
+
+// key of a named player in the ordered index: higher ratings first, then names in order
+typedef std::pair<int,std::string> RANKKEY;
+
+// structure to represent the records and the leaderboard
+struct STATSTABLE {
+    STATSHARD shards[STATSHARDS];
+    std::mutex ranklock;                                                // guards ranks. taken after the shard locks
+    std::map<RANKKEY,PLAYERREC> ranks;                                  // named players by rating
+    std::shared_ptr<const std::vector<LEADER>> top;                     // top LEADERK. replaced, never changed
+};
+
+STATSTABLE statstable;
+
+// function to return the shard of a named player
+inline STATSHARD* statshard(const char* name) {
+    return &statstable.shards[std::hash<std::string_view>()(name) % STATSHARDS];
+}
+
+// function to return the shard of an anonymous player
+inline STATSHARD* statshard(uint32_t pid) {
+    return &statstable.shards[pid % STATSHARDS];
+}
+
+// function to return true iff key is among the first LEADERK keys of the index (or would be)
+inline bool intop(const RANKKEY& key) {
+    auto it = statstable.ranks.begin();
+    for(int i=0;i<LEADERK && it != statstable.ranks.end();++i,++it) {
+        if(!(it->first < key))
+            return true;
+    }
+    return statstable.ranks.size() < LEADERK;
+}
+
+// function to publish the first LEADERK players of the index as the leaderboard. statstable.ranklock must be held
+inline void publishtop() {
+    auto top = std::make_shared<std::vector<LEADER>>();
+    for(auto it = statstable.ranks.begin();it != statstable.ranks.end() && top->size() < LEADERK;++it)
+        top->push_back({it->first.second,it->second});
+    std::atomic_store(&statstable.top,std::shared_ptr<const std::vector<LEADER>>(top));
+}
+
+// function to apply the result of a game to rec
+inline void applyresult(PLAYERREC* rec, const STATPLAYER* p) {
+    ++rec->games;
+    rec->rating = p->rating;
+    if(p->result == SR_WIN) ++rec->wins;
+    else if(p->result == SR_LOSS) ++rec->losses;
+    else if(p->result == SR_DRAW) ++rec->draws;
+    else if(p->result == SR_TIMEOUT) ++rec->timeouts;
+    else if(p->result == SR_DISCONNECT) ++rec->disconnects;
+}
+
+// function to add a finished game to the records of its two players p[0] and p[1]. both records and the
+// leaderboard change at once
+inline void statsrecord(const STATPLAYER p[2]) {
+    // lock the shards of both players, in the order of the shards
+    STATSHARD* shard[2];
+    for(int i=0;i<2;++i)
+        shard[i] = (p[i].name[0] != '\0') ? statshard(p[i].name) : statshard(p[i].pid);
+    std::unique_lock<std::mutex> first(std::min(shard[0],shard[1])->lock);
+    std::unique_lock<std::mutex> second;
+    if(shard[0] != shard[1])
+        second = std::unique_lock<std::mutex>(std::max(shard[0],shard[1])->lock);
+    bool ranked = false;
+    RANKKEY oldkey[2];
+    for(int i=0;i<2;++i) {
+        if(p[i].pid == 0)
+            continue;
+        if(p[i].name[0] == '\0') {
+            applyresult(&shard[i]->anon[p[i].pid],&p[i]);
+            continue;
+        }
+        PLAYERREC* rec = &shard[i]->named[p[i].name];
+        oldkey[i] = {-rec->rating,p[i].name};
+        applyresult(rec,&p[i]);
+        ranked = true;
+    }
+    if(!ranked)
+        return;
+    // move the named players in the index and publish the top LEADERK if they were or are among them
+    std::lock_guard<std::mutex> guard(statstable.ranklock);
+    bool changed = false;
+    for(int i=0;i<2;++i) {
+        if(p[i].pid == 0 || p[i].name[0] == '\0')
+            continue;
+        RANKKEY newkey = {-p[i].rating,p[i].name};
+        changed |= intop(oldkey[i]);
+        statstable.ranks.erase(oldkey[i]);
+        statstable.ranks[newkey] = shard[i]->named[p[i].name];
+        changed |= intop(newkey);
+    }
+    if(changed)
+        publishtop();
+}
+
+// function to put back the record rec of the player with the given name (or player id if it has no name), which was
+// kept by another server process (see handoff.h). the leaderboard is published again
+inline void statsload(const char* name, uint32_t pid, const PLAYERREC& rec) {
+    STATSHARD* shard = (name[0] != '\0') ? statshard(name) : statshard(pid);
+    std::lock_guard<std::mutex> guard(shard->lock);
+    if(name[0] == '\0') {
+        shard->anon[pid] = rec;
+        return;
+    }
+    shard->named[name] = rec;
+    std::lock_guard<std::mutex> rankguard(statstable.ranklock);
+    statstable.ranks[{-rec.rating,name}] = rec;
+    if(intop({-rec.rating,name}))
+        publishtop();
+}
+
+// function to forget the record of the anonymous player pid once its session is over
+inline void statsforget(uint32_t pid) {
+    STATSHARD* shard = statshard(pid);
+    std::lock_guard<std::mutex> guard(shard->lock);
+    shard->anon.erase(pid);
+}
+
+// function to get the record of the player with the given name (or player id if it has no name).
+// returns false if the player has no finished games
+inline bool statsof(const char* name, uint32_t pid, PLAYERREC* rec) {
+    STATSHARD* shard = (name[0] != '\0') ? statshard(name) : statshard(pid);
+    std::lock_guard<std::mutex> guard(shard->lock);
+    if(name[0] != '\0') {
+        auto it = shard->named.find(name);
+        if(it == shard->named.end())
+            return false;
+        *rec = it->second;
+        return true;
+    }
+    auto it = shard->anon.find(pid);
+    if(it == shard->anon.end())
+        return false;
+    *rec = it->second;
+    return true;
+}
+
+// function to return the current snapshot of the leaderboard. NULL -> no named player has finished a game yet
+inline std::shared_ptr<const std::vector<LEADER>> leaderboard() {
+    return std::atomic_load(&statstable.top);
+}
+
+// function to write the leaderboard as text to out
+inline void leaderboardtext(std::string& out) {
+    auto top = leaderboard();
+    if(top == NULL || top->empty()) {
+        out += "The leaderboard is empty. Players who give a name get on it.";
+        return;
+    }
+    out += "Leaderboard (rating, wins-losses-draws):";
+    char line[128];
+    for(size_t i=0;i<top->size();++i) {
+        const LEADER& l = (*top)[i];
+        snprintf(line,sizeof line,"\n%2zu. %-32s %5d  %u-%u-%u",i + 1,l.name.c_str(),l.rec.rating,l.rec.wins,l.rec.losses,l.rec.draws);
+        out += line;
+    }
+}
+
+#endif
@@ -0,0 +1,680 @@
+/*
+    loadgen.cpp = Load generator for the TicTacToe server
+    Author = Vikram, CS19B021
+    Compilation CMD = g++ loadgen.cpp -o loadgen --std=c++17 -O2
+    Usage = ./loadgen [SERVER IP ADDRESS] [SERVER PORT NO] [-n NUM OF PLAYERS] [-c CONNECTS PER S] [-t MEAN THINK MS]
+                      [-i INVALID MOVE %] [-r REPLAY %] [-x DISCONNECT %] [-d DURATION S] [-C] [-k] [-P SERVER PID]
+                      [-G GAMES PER CONNECTION] [-U MAX SERVER CPU %] [-L MAX REJECT P99 MS]
+    Purpose = Simulates n concurrent players over non-blocking sockets in one epoll thread. Every player speaks the framed
+              protocol of protocol.h, thinks for an exponentially distributed time before answering a prompt, makes
+              random legal moves (and invalid ones at the given rate), replays or drops the connection at the given
+              rates and reconnects as a new player once its session is over. At the end, the throughput and the
+              latency percentiles of connect-to-match and move-to-reply are printed, along with the num of KEEP_ALIVE
+              msgs the server sent to idle players.
+              With -C, every player disconnects as soon as the server's first msg arrives and the rate of connection
+              setups and their latency are printed instead (a benchmark of accepting and pairing). With -k, players ask
+              for compact T_MOVE updates (HELLO_COMPACT) instead of the board text.
+              Players who are turned away by a full server (BUSYTEXT) reconnect as new players. The num of them and
+              their connect-to-reject latency are printed, along with the num of players who had to wait in the
+              waiting room. With -P, the CPU time the server process used during the run is printed too, e.g. to
+              check that a saturated server doesn't spin, and the num of fds it has open at the end.
+              -U and -L turn such a run into a pass/fail check of a saturated server: the run fails (exit status 1)
+              if the server used more than the given % of one core (needs -P), if the p99 connect-to-reject latency
+              was above the given ms, or if -L is given and no player was turned away, since then the server
+              wasn't saturated. e.g. ./gameserver PORT -m 10 -q 10 and ./loadgen IP PORT -n 200 -c 2000 -P PID -U 50 -L 5
+              With -G g, the players share connections: every connection is a session (HELLO_MUX) that carries the
+              games of g players at once, each under its own id. A player joins a game with T_JOIN and leaves it
+              with T_LEAVE instead of connecting and closing, and KEEP_ALIVE msgs are sent and acked per connection.
+              Comparing a run with -G 1000 to the same run without shows the fds, connection setups and KEEP_ALIVE
+              msgs saved (the server must run with -e).
+              The server must allow enough players, e.g. ./gameserver PORT -e 4 -m 100000
+*/
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <bits/stdc++.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include "protocol.h"
+#include "timerwheel.h"
+#define SERVERPORT argv[2]          // server port number
+#define SERVERIPADDR argv[1]        // server ip address
+#define RECVBUFLEN 4096             // size of the buffer for recved but unhandled bytes of a player
+#define MAXEVENTS 256               // max number of events fetched by one epoll_wait() call
+#define MAXTHINK 10000              // max think time (in ms). the server's move timeout is 15 s
+#define USAGE "Usage : ./loadgen [SERVER IP ADDRESS] [SERVER PORT NO] [-n NUM OF PLAYERS] [-c CONNECTS PER S] [-t MEAN THINK MS] [-i INVALID MOVE %] [-r REPLAY %] [-x DISCONNECT %] [-d DURATION S] [-C] [-k] [-P SERVER PID] [-G GAMES PER CONNECTION] [-U MAX SERVER CPU %] [-L MAX REJECT P99 MS]\n"
+using namespace std;
+
+// what a player has to send once its think time is over. PEND_NONE -> nothing
+enum PENDING { PEND_NONE, PEND_MOVE, PEND_REPLAY };
+
+// structure to represent a simulated player. fd = -1 -> the player is waiting to (re)connect. with -G, the players
+// are seats of shared connections, which are PLAYERs with seats but without games of their own
+struct PLAYER {
+    int id;                                                             // num of the player. its sessions use the name "loadgen<id>"
+    int fd;                                                             // connection fd
+    bool connected;                                                     // true iff the non-blocking connect() has completed
+    char inbuf[RECVBUFLEN];                                             // recved but unhandled bytes
+    int inlen;                                                          // num of bytes in inbuf
+    string outbuf;                                                      // pending bytes to send
+    bool outwatched;                                                    // true iff EPOLLOUT is asked for
+    int symbol;                                                         // 1 -> 'X', 2 -> 'O', 0 -> no game yet
+    char board[9];                                                      // cells of the last game status. 'X', 'O' or '_'
+    long long connectstart;                                             // time (in us) of the connect(). 0 -> matched already
+    long long movestart;                                                // time (in us) the last move was sent. 0 -> no reply pending
+    bool waited;                                                        // true iff the session has been in the server's waiting room
+    PENDING pending;                                                    // what to send when timer fires
+    TIMER timer;                                                        // think timer
+    PLAYER* link;                                                       // (-G only) connection that carries the games of the player
+    vector<PLAYER*> seats;                                              // (-G only) players whose games this connection carries
+    uint32_t tag;                                                       // (-G only) id of the player's games on link. index in link->seats + 1
+    bool joined;                                                        // (-G only) true iff the player is in a session on link
+    bool leaving;                                                       // (-G only) true iff the player has sent T_LEAVE and waits for the T_GAMEOVER
+};
+
+// structure to represent the counters and latency samples (in us) of the whole run
+struct STATS {
+    uint64_t connects, connfails, setups, matches, games, timeouts, moves, invalid, drops, replays, errors, keepalives;
+    uint64_t joins;                                                     // (-G only) sessions started with T_JOIN
+    uint64_t rejects, waited;                                           // sessions turned away by the server / that waited in its waiting room
+    uint64_t rxbytes, rxcalls;                                          // bytes recved from the server and the recv() calls that got them
+    vector<uint32_t> setuplat, matchlat, movelat, rejectlat;
+};
+
+int epfd;                                                               // epoll fd
+TIMERWHEEL wheel;                                                       // think timers of all players
+sockaddr_in servaddr;                                                   // internet address of server
+STATS stats;
+deque<PLAYER*> idle;                                                    // players waiting to (re)connect
+mt19937_64 rng(random_device{}());
+int thinkms = 10;                                                       // mean think time (in ms)
+int invalidpct = 0;                                                     // % of moves that are invalid
+int replaypct = 50;                                                     // % of REPLAY questions answered with YES
+int droppct = 0;                                                        // % of prompts answered by closing the connection
+bool setuponly = false;                                                 // true iff players only connect and wait for the first msg
+bool compact = false;                                                   // true iff players ask for HELLO_COMPACT
+int muxgames = 0;                                                       // num of players per connection (-G). 0 -> a connection per player
+double maxcpupct = -1;                                                  // max % of one core the server may use (-U). -1 -> no limit
+double maxrejectms = -1;                                                // max p99 connect-to-reject latency in ms (-L). -1 -> no limit
+
+// function to get the current time in us from a monotonic clock
+long long nowus() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// function to return true with probability pct%
+bool chance(int pct) {
+    return (int)(rng() % 100) < pct;
+}
+
+// function to (re)register the fd of pl with epoll. EPOLLOUT is asked for while connecting or while outbuf isn't empty
+void watchplayer(PLAYER* pl, int op) {
+    epoll_event ev;
+    pl->outwatched = !pl->connected || !pl->outbuf.empty();
+    ev.events = EPOLLIN | EPOLLRDHUP | (pl->outwatched ? (uint32_t)EPOLLOUT : 0);
+    ev.data.ptr = pl;
+    epoll_ctl(epfd,op,pl->fd,&ev);
+}
+
+// function to close the connection of pl and queue it for a reconnect as a new player. a seat of a shared
+// connection just waits to join again. a shared connection ends the sessions of all its seats
+void endsession(PLAYER* pl) {
+    twcancel(&wheel,&pl->timer);
+    if(pl->link != NULL) {
+        pl->joined = false;
+        idle.push_back(pl);
+        return;
+    }
+    close(pl->fd);
+    pl->fd = -1;
+    if(pl->seats.empty()) {
+        idle.push_back(pl);
+        return;
+    }
+    for(PLAYER* seat : pl->seats) {
+        if(seat->joined)
+            endsession(seat);
+    }
+}
+
+// function to send as much of pl->outbuf as the socket accepts now. returns false iff the send failed
+bool flushplayer(PLAYER* pl) {
+    size_t sent = 0;
+    while(sent < pl->outbuf.size()) {
+        int ret = send(pl->fd,pl->outbuf.data() + sent,pl->outbuf.size() - sent,MSG_NOSIGNAL|MSG_DONTWAIT);
+        if(ret < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        sent += ret;
+    }
+    pl->outbuf.erase(0,sent);
+    if(pl->outbuf.empty() == pl->outwatched)
+        watchplayer(pl,EPOLL_CTL_MOD);
+    return true;
+}
+
+// function to send a frame with the given type and text to pl (on its shared connection with its id, if it has one).
+// returns false iff the send failed
+bool sendframe(PLAYER* pl, int type, const char* text, int len = -1) {
+    FRAMEHDR hdr;
+    if(len < 0)
+        len = strlen(text);
+    makehdr(&hdr,type,pl->tag,len);
+    if(pl->link != NULL)
+        pl = pl->link;
+    bool wasempty = pl->outbuf.empty();
+    pl->outbuf.append((char*)&hdr,sizeof hdr);
+    pl->outbuf.append(text,len);
+    return !wasempty || flushplayer(pl);
+}
+
+// function to start the connection of the idle player pl as a new player. a seat of a shared connection joins a
+// new game on it instead. the connection is set up first if it isn't up. then the seat joins once it is
+void connectplayer(PLAYER* pl) {
+    pl->symbol = 0;
+    pl->connectstart = nowus();
+    pl->movestart = 0;
+    pl->waited = false;
+    pl->pending = PEND_NONE;
+    if(pl->link != NULL) {
+        ++stats.joins;
+        pl->joined = true;
+        pl->leaving = false;
+        if(pl->link->fd == -1) {
+            connectplayer(pl->link);
+        }
+        else if(pl->link->connected && !sendframe(pl,T_JOIN,"")) {
+            ++stats.errors;
+            endsession(pl->link);
+        }
+        return;
+    }
+    ++stats.connects;
+    if((pl->fd = socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK,0)) == -1) {
+        perror("ERROR: socket creation failed"); exit(-1);
+    }
+    // the msgs are small and many games may share a connection. without TCP_NODELAY, Nagle's algorithm and the
+    // server's delayed ACKs would hold them back and be measured as server latency
+    int yes = 1;
+    setsockopt(pl->fd,IPPROTO_TCP,TCP_NODELAY,&yes,sizeof yes);
+    pl->connected = false;
+    pl->inlen = 0;
+    pl->outbuf.clear();
+    if(connect(pl->fd,(sockaddr*)&servaddr,sizeof servaddr) == -1 && errno != EINPROGRESS) {
+        ++stats.connfails;
+        endsession(pl);
+        return;
+    }
+    watchplayer(pl,EPOLL_CTL_ADD);
+}
+
+// function to pick a move on pl->board and put it in move (room for 16 chars). an invalid move is out of range
+// or on a filled position
+void pickmove(PLAYER* pl, char* move) {
+    int cells[9], n = 0, filled[9], m = 0;
+    for(int k=0;k<9;++k) {
+        if(pl->board[k] == '_')
+            cells[n++] = k;
+        else
+            filled[m++] = k;
+    }
+    int k;
+    if(n == 0 || chance(invalidpct)) {
+        ++stats.invalid;
+        if(m == 0 || chance(50)) {
+            strcpy(move,"0 4");
+            return;
+        }
+        k = filled[rng() % m];
+    }
+    else {
+        k = cells[rng() % n];
+    }
+    snprintf(move,16,"%d %d",k/3 + 1,k%3 + 1);
+}
+
+// function to send what pl has been thinking about
+void sendpending(PLAYER* pl) {
+    bool ok = true;
+    if(pl->pending == PEND_MOVE) {
+        char move[16];
+        pickmove(pl,move);
+        pl->movestart = nowus();
+        ok = sendframe(pl,T_INPUT,move);
+    }
+    else if(pl->pending == PEND_REPLAY) {
+        ok = sendframe(pl,T_INPUT,chance(replaypct) ? "YES" : "NO");
+    }
+    pl->pending = PEND_NONE;
+    if(!ok) {
+        ++stats.errors;
+        endsession(pl->link != NULL ? pl->link : pl);
+    }
+}
+
+// function to handle a frame from the server. returns false iff the session of pl is over
+bool onframe(PLAYER* pl, int type, const char* text) {
+    long long now = nowus();
+    if(pl->leaving)
+        return type != T_GAMEOVER;
+    if(type == T_PRINT && strcmp(text,BUSYTEXT) == 0) {
+        stats.rejectlat.push_back(now - pl->connectstart);
+        ++stats.rejects;
+        return pl->link != NULL;                            // a seat's session is over with the T_GAMEOVER that follows
+    }
+    if(type == T_PRINT && strncmp(text,ROOMTEXT,strlen(ROOMTEXT)) == 0) {
+        if(!pl->waited)
+            ++stats.waited;
+        pl->waited = true;
+        return true;
+    }
+    if(setuponly) {
+        stats.setuplat.push_back(now - pl->connectstart);
+        ++stats.setups;
+        return false;
+    }
+    if(pl->movestart != 0 && type != T_KEEPALIVE) {
+        stats.movelat.push_back(now - pl->movestart);
+        pl->movestart = 0;
+        if(strncmp(text,"Invalid Move",12) != 0)
+            ++stats.moves;
+    }
+    if(type == T_KEEPALIVE) {
+        ++stats.keepalives;
+        return sendframe(pl,T_ACK,"");
+    }
+    if(type == T_PRINT) {
+        if(strstr(text,"Starting the game") != NULL) {
+            pl->symbol = (strstr(text,"'X'") != NULL) ? 1 : 2;
+            if(pl->connectstart != 0) {
+                stats.matchlat.push_back(now - pl->connectstart);
+                pl->connectstart = 0;
+                ++stats.matches;
+            }
+        }
+        else if(strncmp(text,"Game Status",11) == 0) {
+            int k = 0;
+            for(const char* c = text;*c != '\0' && k < 9;++c) {
+                if(*c == 'X' || *c == 'O' || *c == '_')
+                    pl->board[k++] = *c;
+            }
+        }
+        else if(pl->symbol == 1 && (strstr(text,"has won!!") != NULL || strstr(text,"was a draw") != NULL)) {
+            ++stats.games;                                  // only player 1 counts the games, so each is counted once
+        }
+        else if(pl->symbol == 1 && (strstr(text,"run out of time") != NULL || strstr(text,"timed out") != NULL)) {
+            ++stats.games; ++stats.timeouts;
+        }
+        else if(strncmp(text,"Starting a new game",19) == 0 && pl->symbol == 1) {
+            ++stats.replays;
+        }
+        return true;
+    }
+    if(type == T_MOVE) {
+        const MOVEUPDATE* u = (const MOVEUPDATE*)text;
+        if(u->p == 0)
+            memset(pl->board,'_',sizeof pl->board);
+        else if(u->r >= 1 && u->r <= 3 && u->c >= 1 && u->c <= 3)
+            pl->board[3*(u->r - 1) + u->c - 1] = (u->p == 1) ? 'X' : 'O';
+        return true;
+    }
+    if(type == T_PROMPT) {
+        if(chance(droppct)) {
+            ++stats.drops;
+            if(pl->link == NULL)
+                return false;
+            pl->leaving = true;                             // a seat leaves its game, but its id is in use till the T_GAMEOVER
+            if(!sendframe(pl,T_LEAVE,"")) {
+                ++stats.errors;
+                endsession(pl->link);
+            }
+            return true;
+        }
+        pl->pending = (strncmp(text,"Do you",6) == 0) ? PEND_REPLAY : PEND_MOVE;
+        // exponentially distributed think time
+        double u = (rng() >> 11) * (1.0 / 9007199254740992.0);
+        long long think = min((long long)MAXTHINK,(long long)(-thinkms * log(1.0 - u)));
+        if(think == 0) {
+            sendpending(pl);
+            return pl->link != NULL || pl->fd != -1;
+        }
+        twadd(&wheel,&pl->timer,now / 1000 + think);
+        return true;
+    }
+    // T_GAMEOVER or anything else ends the session
+    return false;
+}
+
+// function to read all the data available from pl and handle every whole frame in it. the frames of a shared
+// connection go to the seats given by their ids. frames with id 0 are for the connection itself
+void readplayer(PLAYER* pl) {
+    while(1) {
+        int ret = recv(pl->fd,pl->inbuf + pl->inlen,RECVBUFLEN - pl->inlen,MSG_DONTWAIT);
+        if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if(ret < 0 && errno == EINTR)
+            continue;
+        if(ret <= 0) {
+            if(ret < 0 || (pl->symbol == 0 && !setuponly))
+                ++stats.errors;
+            endsession(pl);
+            return;
+        }
+        pl->inlen += ret;
+        stats.rxbytes += ret; ++stats.rxcalls;
+        int size;
+        while((size = framesize(pl->inbuf,pl->inlen)) > 0) {
+            char text[MAXPAYLOAD + 1];
+            int len = size - sizeof(FRAMEHDR);
+            memcpy(text,pl->inbuf + sizeof(FRAMEHDR),len);
+            text[len] = '\0';
+            int type = (unsigned char)pl->inbuf[1];
+            FRAMEHDR hdr;
+            memcpy(&hdr,pl->inbuf,sizeof hdr);
+            uint32_t tag = ntohl(hdr.gameid);
+            pl->inlen -= size;
+            memmove(pl->inbuf,pl->inbuf + size,pl->inlen);
+            PLAYER* to = pl;
+            if(!pl->seats.empty()) {
+                if(tag == 0 && type == T_KEEPALIVE) {
+                    ++stats.keepalives;
+                    if(!sendframe(pl,T_ACK,"")) {
+                        ++stats.errors;
+                        endsession(pl);
+                        return;
+                    }
+                }
+                if(tag == 0 || tag > pl->seats.size() || !pl->seats[tag - 1]->joined)
+                    continue;
+                to = pl->seats[tag - 1];
+            }
+            bool more = onframe(to,type,text);
+            if(pl->fd == -1)
+                return;                                     // the connection broke while to answered
+            if(!more && to != pl) {
+                endsession(to);
+            }
+            else if(!more) {
+                endsession(pl);
+                return;
+            }
+        }
+        if(size < 0) {
+            ++stats.errors;
+            endsession(pl);
+            return;
+        }
+    }
+}
+
+// function to return the CPU time (in s) used so far by the process pid. -1 -> unknown
+double cputime(int pid) {
+    char path[64];
+    snprintf(path,sizeof path,"/proc/%d/stat",pid);
+    ifstream f(path);
+    string stat;
+    if(!getline(f,stat) || stat.rfind(')') == string::npos)
+        return -1;
+    // utime and stime are the 12th and 13th fields after the ") " that ends the command name
+    istringstream in(stat.substr(stat.rfind(')') + 2));
+    string field;
+    for(int i=0;i<11;++i)
+        in >> field;
+    unsigned long long utime = 0, stime = 0;
+    in >> utime >> stime;
+    return (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+// function to return the num of fds the process pid has open. -1 -> unknown
+int countfds(int pid) {
+    char path[64];
+    snprintf(path,sizeof path,"/proc/%d/fd",pid);
+    error_code ec;
+    int n = 0;
+    for(auto it = filesystem::directory_iterator(path,ec);!ec && it != filesystem::directory_iterator();it.increment(ec))
+        ++n;
+    return ec ? -1 : n;
+}
+
+// function to print the num of samples and the percentiles (in ms) of the latency samples lat
+void printlat(const char* name, vector<uint32_t>& lat) {
+    if(lat.empty()) {
+        printf("%-22s n = 0\n",name);
+        return;
+    }
+    sort(lat.begin(),lat.end());
+    auto pct = [&](double p) { return lat[min(lat.size() - 1,(size_t)(p * lat.size()))] / 1000.0; };
+    printf("%-22s n = %-9zu p50 = %8.3f  p90 = %8.3f  p99 = %8.3f  p99.9 = %8.3f  max = %8.3f ms\n",
+           name,lat.size(),pct(0.5),pct(0.9),pct(0.99),pct(0.999),lat.back() / 1000.0);
+}
+
+// function to check the run against the limits of -U and -L, given the % of one core the server used (-1 -> unknown)
+// and the connect-to-reject latencies. returns the exit status of the run: 1 iff a limit was exceeded
+int checklimits(double cpupct, vector<uint32_t>& rejectlat) {
+    if(maxcpupct < 0 && maxrejectms < 0)
+        return 0;
+    int failed = 0;
+    if(maxcpupct >= 0 && (cpupct < 0 || cpupct > maxcpupct)) {
+        printf("FAILED: server cpu = %.1f%% of one core, limit = %.1f%%\n",cpupct,maxcpupct);
+        failed = 1;
+    }
+    if(maxrejectms >= 0 && rejectlat.empty()) {
+        printf("FAILED: no player was rejected, so the server wasn't saturated\n");
+        failed = 1;
+    }
+    else if(maxrejectms >= 0) {
+        sort(rejectlat.begin(),rejectlat.end());
+        double p99 = rejectlat[min(rejectlat.size() - 1,(size_t)(0.99 * rejectlat.size()))] / 1000.0;
+        if(p99 > maxrejectms) {
+            printf("FAILED: p99 connect-to-reject = %.3f ms, limit = %.3f ms\n",p99,maxrejectms);
+            failed = 1;
+        }
+    }
+    if(!failed)
+        printf("PASSED: the server stayed within the limits\n");
+    return failed;
+}
+
+int main(int argc, char** argv) {
+
+    if(argc < 3) {
+        cout << USAGE;
+        exit(-1);
+    }
+
+    // parse the options given after the server address
+    int numplayers = 100, connrate = 1000, duration = 10, serverpid = 0;
+    int opt;
+    while((opt = getopt(argc - 2,argv + 2,"n:c:t:i:r:x:d:CkP:G:U:L:")) != -1) {
+        if(opt == 'n')
+            numplayers = max(1,atoi(optarg));
+        else if(opt == 'c')
+            connrate = max(0,atoi(optarg));
+        else if(opt == 't')
+            thinkms = max(0,atoi(optarg));
+        else if(opt == 'i')
+            invalidpct = min(100,max(0,atoi(optarg)));
+        else if(opt == 'r')
+            replaypct = min(100,max(0,atoi(optarg)));
+        else if(opt == 'x')
+            droppct = min(100,max(0,atoi(optarg)));
+        else if(opt == 'd')
+            duration = max(1,atoi(optarg));
+        else if(opt == 'C')
+            setuponly = true;
+        else if(opt == 'k')
+            compact = true;
+        else if(opt == 'P')
+            serverpid = atoi(optarg);
+        else if(opt == 'G')
+            muxgames = max(1,atoi(optarg));
+        else if(opt == 'U')
+            maxcpupct = max(0.0,atof(optarg));
+        else if(opt == 'L')
+            maxrejectms = max(0.0,atof(optarg));
+        else {
+            cout << USAGE;
+            exit(-1);
+        }
+    }
+    if(setuponly && muxgames > 0) {
+        cout << "-C measures connection setups. It can't be used with -G" << endl;
+        exit(-1);
+    }
+    if(maxcpupct >= 0 && serverpid == 0) {
+        cout << "-U needs the pid of the server (-P)" << endl;
+        exit(-1);
+    }
+
+    memset(&servaddr,0,sizeof servaddr);
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_port = htons((short)atoi(SERVERPORT));
+    if(inet_pton(AF_INET,SERVERIPADDR,&servaddr.sin_addr) != 1) {
+        cout << "Bad Server IP Address" << endl;
+        exit(-1);
+    }
+
+    // every player needs a fd. so, raise the limit on open fds as far as allowed
+    rlimit lim;
+    if(getrlimit(RLIMIT_NOFILE,&lim) == 0) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE,&lim);
+    }
+    if((epfd = epoll_create1(0)) == -1) {
+        perror("ERROR - epoll_create1 failed"); exit(-1);
+    }
+    long long start = nowus();
+    double servercpu = serverpid ? cputime(serverpid) : -1;
+    twinit(&wheel,start / 1000);
+    vector<PLAYER> players(numplayers);
+    vector<PLAYER> links(muxgames > 0 ? (numplayers + muxgames - 1) / muxgames : 0);
+    for(int i=0;i<numplayers;++i) {
+        PLAYER& pl = players[i];
+        pl.id = i;
+        pl.fd = -1;
+        pl.timer.data = &pl;
+        if(muxgames > 0) {
+            pl.link = &links[i / muxgames];
+            pl.link->seats.push_back(&pl);
+            pl.tag = pl.link->seats.size();
+        }
+        idle.push_back(&pl);
+    }
+    for(size_t i=0;i<links.size();++i) {
+        links[i].id = i;
+        links[i].fd = -1;
+        links[i].timer.data = &links[i];
+    }
+
+    // connect idle players at connrate per s (all at once if connrate = 0) and run till duration is over
+    long long end = start + duration * 1000000LL;
+    long long nextconnect = start;
+    epoll_event evs[MAXEVENTS];
+    while(1) {
+        long long now = nowus();
+        if(now >= end)
+            break;
+        while(!idle.empty() && now >= nextconnect) {
+            PLAYER* pl = idle.front();
+            idle.pop_front();
+            connectplayer(pl);
+            if(connrate > 0)
+                nextconnect += 1000000 / connrate;
+        }
+        if(connrate > 0 && idle.empty() && nextconnect < now)
+            nextconnect = now;                              // don't save up connects while every player is busy
+        int tmout = twtimeout(&wheel,now / 1000);
+        long long due = idle.empty() ? end : max(now,nextconnect);
+        int till = (int)((min(due,end) - now + 999) / 1000);
+        tmout = (tmout < 0) ? till : min(tmout,till);
+        int n = epoll_wait(epfd,evs,MAXEVENTS,tmout);
+        for(int i=0;i<n;++i) {
+            PLAYER* pl = (PLAYER*)evs[i].data.ptr;
+            if(pl->fd == -1)
+                continue;
+            if(!pl->connected && (evs[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                int err = 0;
+                socklen_t errlen = sizeof err;
+                getsockopt(pl->fd,SOL_SOCKET,SO_ERROR,&err,&errlen);
+                if(err != 0) {
+                    ++stats.connfails;
+                    endsession(pl);
+                    continue;
+                }
+                // connected. ask for the framed protocol. the name lets the server keep the player's rating. a shared
+                // connection asks for HELLO_MUX and its waiting seats join their games at once
+                pl->connected = true;
+                watchplayer(pl,EPOLL_CTL_MOD);
+                char hello[32];
+                bool shared = !pl->seats.empty();
+                int len = snprintf(hello,sizeof hello,shared ? "loadgenmux%d" : "loadgen%d",pl->id) + 1;
+                hello[len++] = (compact ? HELLO_COMPACT : 0) | (shared ? HELLO_MUX : 0);
+                bool ok = sendframe(pl,T_HELLO,hello,len);
+                for(size_t j=0;j<pl->seats.size() && ok;++j) {
+                    if(pl->seats[j]->joined)
+                        ok = sendframe(pl->seats[j],T_JOIN,"");
+                }
+                if(!ok) {
+                    ++stats.errors;
+                    endsession(pl);
+                }
+                continue;
+            }
+            if((evs[i].events & EPOLLOUT) && !flushplayer(pl)) {
+                ++stats.errors;
+                endsession(pl);
+                continue;
+            }
+            if(evs[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+                readplayer(pl);
+        }
+        // players whose think time is over send their move or REPLAY choice
+        TIMER* timer;
+        while((timer = twexpired(&wheel,nowus() / 1000)) != NULL) {
+            sendpending((PLAYER*)timer->data);
+        }
+    }
+
+    double secs = (nowus() - start) / 1e6;
+    double cpupct = -1;
+    if(servercpu >= 0) {
+        double used = cputime(serverpid) - servercpu;
+        cpupct = used / secs * 100;
+        printf("server cpu = %.2f s (%.1f%% of one core), server fds = %d\n",used,cpupct,countfds(serverpid));
+    }
+    if(muxgames > 0)
+        printf("shared connections = %zu with %d games each, joins = %lu\n",links.size(),muxgames,(unsigned long)stats.joins);
+    if(stats.rejects > 0 || stats.waited > 0) {
+        printf("rejected = %lu (%.1f/s), waited in the waiting room = %lu\n",(unsigned long)stats.rejects,stats.rejects / secs,
+               (unsigned long)stats.waited);
+        printlat("connect-to-reject",stats.rejectlat);
+    }
+    if(setuponly) {
+        printf("players = %d, duration = %.2f s\n",numplayers,secs);
+        printf("connects = %lu (failed %lu), setups = %lu (%.1f/s), errors = %lu\n",(unsigned long)stats.connects,
+               (unsigned long)stats.connfails,(unsigned long)stats.setups,stats.setups / secs,(unsigned long)stats.errors);
+        printlat("connect-to-first-msg",stats.setuplat);
+        return checklimits(cpupct,stats.rejectlat);
+    }
+    printf("players = %d, duration = %.2f s, think = %d ms, invalid = %d%%, replay = %d%%, disconnect = %d%%\n",
+           numplayers,secs,thinkms,invalidpct,replaypct,droppct);
+    printf("connects = %lu (failed %lu), matches = %lu, errors = %lu, disconnects = %lu, keepalives = %lu\n",
+           (unsigned long)stats.connects,(unsigned long)stats.connfails,(unsigned long)stats.matches,
+           (unsigned long)stats.errors,(unsigned long)stats.drops,(unsigned long)stats.keepalives);
+    printf("games = %lu (%.1f/s, %lu timed out, %lu replays), moves = %lu (%.1f/s), invalid moves = %lu\n",
+           (unsigned long)stats.games,stats.games / secs,(unsigned long)stats.timeouts,(unsigned long)stats.replays,
+           (unsigned long)stats.moves,stats.moves / secs,(unsigned long)stats.invalid);
+    printf("recved = %lu bytes in %lu recv calls (%.1f bytes and %.2f calls per move)\n",(unsigned long)stats.rxbytes,
+           (unsigned long)stats.rxcalls,(double)stats.rxbytes / max<uint64_t>(1,stats.moves),
+           (double)stats.rxcalls / max<uint64_t>(1,stats.moves));
+    printlat("connect-to-match",stats.matchlat);
+    printlat("move-to-reply",stats.movelat);
+    return checklimits(cpupct,stats.rejectlat);
+}
@@ -0,0 +1,535 @@
+/*
+    loganalyze.cpp = Parallel analytics over the game logs of the TicTacToe server
+    Author = Vikram, CS19B021
+    Compilation CMD = g++ loganalyze.cpp -o loganalyze --std=c++17 -O2 -pthread
+    Usage = ./loganalyze [-t THREADS] [-p TOP PLAYERS] [-a] [LOG FILE] ...
+            ./loganalyze -b [-t MAX THREADS] [LOG FILE] ...
+            ./loganalyze -g [NUM OF GAMES] [LOG FILE]
+    Purpose = Maps the log files (LOGFILE of the server) into memory and cuts them into chunks that start at
+              [NEW ENTRY] lines. The chunks are parsed by t threads (all cores by default) straight out of the
+              mapping into a LOGREC on the stack, and every thread adds the games to its own aggregates, which
+              are merged at the end. Nothing is allocated per game: a thread's tables only grow for new players
+              and new hours. Printed are the results by cause, the players with the most games and their
+              win/loss/draw/timeout/disconnect rates, the frequencies and player 1 win rates of the opening moves
+              of 3x3 games, the distributions of game length and duration and the game throughput by hour of the
+              day (-a -> by every hour of the log). Times are the local times the server wrote.
+              -b runs the parse with 1, 2, 4, ... up to t threads and prints the throughput in GB/s. Run it
+              twice, or on a file that fits in RAM, to measure the parse rather than the disk.
+              -g writes a synthetic log of n random games in the server's format, e.g. for the benchmark.
+*/
+#include <bits/stdc++.h>
+#include "gamestore.h"
+#define CHUNKSPERTHREAD 8                                               // num of chunks per thread, so that threads finish together
+#define MINCHUNK (1 << 20)                                              // min size of a chunk
+#define DURBUCKETS 16                                                   // duration buckets: < 1 s, 1 s, 2-3 s, 4-7 s, ... >= 2^14 s
+#define LOGMARK "[NEW ENTRY]\n"
+using namespace std;
+
+// structure to represent the aggregates of one player
+struct PSTATS {
+    uint32_t pid;
+    uint64_t games, wins, losses, draws, timeouts, disconnects;        // timeouts = timeouts caused by the player
+};
+
+// structure to represent a table of PSTATS by player id with open addressing. slots with games = 0 are free
+struct PTABLE {
+    vector<PSTATS> slots;
+    size_t used = 0;
+};
+
+// structure to represent the aggregates of a set of games
+struct STATS {
+    uint64_t games, bytes, malformed;
+    uint64_t causes[5];                                                 // games by cause (1 - win, 2 - draw, 3 - timeout, 4 - disconnect)
+    uint64_t p1wins, p2wins;
+    uint64_t openings[9], openingwins[9];                               // 3x3 games by first move cell and the ones player 1 won
+    uint64_t lengths[LOGMAXMOVES + 1];                                  // games by num of moves
+    uint64_t durations[DURBUCKETS];                                     // games by duration bucket
+    uint64_t hourofday[24];                                             // games by hour of the day of their start
+    unordered_map<int64_t,uint64_t> hours;                              // games by hour (start time / 3600)
+    PTABLE players;
+};
+
+// structure to represent a part of a mapped log that starts with a [NEW ENTRY] line (or the start of the file)
+struct CHUNK {
+    const char* begin;
+    const char* end;
+    const char* fileend;                                                // end of the mapping. the last entry of the chunk may reach beyond end
+};
+
+// function to get the current time in s from a monotonic clock
+double nowsecs() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+PSTATS* playerstats(PTABLE* t, uint32_t pid);
+
+// function to make room in t for n more players, so that the pointers returned by the next n playerstats() calls
+// stay valid. t is kept at most half full
+void reserveplayers(PTABLE* t, size_t n) {
+    if(2 * (t->used + n) <= t->slots.size())
+        return;
+    // grow to twice the size and put the players back
+    vector<PSTATS> old(max<size_t>(1024,2 * t->slots.size()));
+    old.swap(t->slots);
+    t->used = 0;
+    for(const PSTATS& s : old) {
+        if(s.games != 0)
+            *playerstats(t,s.pid) = s;
+    }
+}
+
+// function to return the stats of player pid in t, adding them if needed. the caller has made room with reserveplayers()
+PSTATS* playerstats(PTABLE* t, uint32_t pid) {
+    size_t mask = t->slots.size() - 1;
+    for(size_t i = (pid * 0x9E3779B97F4A7C15ULL) >> 20 & mask;;i = (i + 1) & mask) {
+        PSTATS* s = &t->slots[i];
+        if(s->games == 0) {
+            s->pid = pid;
+            ++t->used;
+            return s;
+        }
+        if(s->pid == pid)
+            return s;
+    }
+}
+
+// function to read a decimal number at p. returns the position after it, or NULL if there is no digit
+inline const char* getnum(const char* p, const char* end, int64_t* val) {
+    if(p >= end || *p < '0' || *p > '9')
+        return NULL;
+    int64_t v = 0;
+    while(p < end && *p >= '0' && *p <= '9')
+        v = v * 10 + (*p++ - '0');
+    *val = v;
+    return p;
+}
+
+// function to skip the text s at p. returns the position after it, or NULL if p doesn't start with it
+inline const char* skip(const char* p, const char* end, const char* s) {
+    size_t len = strlen(s);
+    if((size_t)(end - p) < len || memcmp(p,s,len) != 0)
+        return NULL;
+    return p + len;
+}
+
+// function to return the num of days from 1970-01-01 to the date y-m-d of the proleptic Gregorian calendar
+inline int64_t daysfromcivil(int64_t y, int m, int d) {
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+// function to read a time written by ctime() ("Tue Dec  5 00:52:56 2023\n") at p as s since the epoch (of the
+// local time, i.e. without a time zone). returns the position after the newline, or NULL if it is malformed
+inline const char* gettime(const char* p, const char* end, int64_t* t) {
+    static const char months[] = "JanFebMarAprMayJunJulAugSepOctNovDec";
+    if(end - p < 25 || p[24] != '\n')
+        return NULL;
+    const char* m = (const char*)memmem(months,36,p + 4,3);
+    if(m == NULL || (m - months) % 3 != 0)
+        return NULL;
+    auto two = [](const char* q) { return (q[0] == ' ' ? 0 : q[0] - '0') * 10 + (q[1] - '0'); };
+    int64_t year = (p[20] - '0') * 1000 + (p[21] - '0') * 100 + (p[22] - '0') * 10 + (p[23] - '0');
+    *t = daysfromcivil(year,(m - months) / 3 + 1,two(p + 8)) * 86400 + two(p + 11) * 3600 + two(p + 14) * 60 + two(p + 17);
+    return p + 25;
+}
+
+// function to parse the [NEW ENTRY] block whose fields start at p (right after the [NEW ENTRY] line) into rec.
+// returns false if the block is malformed
+bool parseentry(const char* p, const char* end, LOGREC* rec) {
+    int64_t v, m;
+    if(!(p = skip(p,end,"Game ID = ")) || !(p = getnum(p,end,&v)))
+        return false;
+    rec->gameid = v;
+    if(!(p = skip(p,end,"\nPlayer 1 ID = ")) || !(p = getnum(p,end,&v)))
+        return false;
+    rec->pid1 = v;
+    if(!(p = skip(p,end,"\nPlayer 2 ID = ")) || !(p = getnum(p,end,&v)))
+        return false;
+    rec->pid2 = v;
+    if(!(p = skip(p,end,"\nStart Time = ")) || !(p = gettime(p,end,&rec->starttime)))
+        return false;
+    if(!(p = skip(p,end,"End Time = ")) || !(p = gettime(p,end,&rec->endtime)))
+        return false;
+    // the duration is end time - start time. the line is only checked
+    if(!(p = skip(p,end,"Duration = ")) || !(p = getnum(p,end,&m)) || !(p = skip(p,end," m ")) || !(p = getnum(p,end,&v)))
+        return false;
+    if(!(p = skip(p,end," s\nMoves Made = <")))
+        return false;
+    rec->nmoves = 0;
+    while(p < end && *p == '(') {
+        // (PLRi,r,c) followed by ", " or by the closing '>'
+        int64_t r, c;
+        if(!(p = skip(p,end,"(PLR")) || !(p = getnum(p,end,&v)) || !(p = skip(p,end,",")) || !(p = getnum(p,end,&r)) ||
+           !(p = skip(p,end,",")) || !(p = getnum(p,end,&c)) || !(p = skip(p,end,")")) || rec->nmoves == LOGMAXMOVES)
+            return false;
+        rec->moves[rec->nmoves++] = (r << 4) | c;
+        if(p < end && *p == ',')
+            p += 2;
+    }
+    if(!(p = skip(p,end,">\nResult = ")))
+        return false;
+    rec->winner = 0;
+    if(skip(p,end,"Player ") != NULL) {
+        if(!getnum(p + 7,end,&v))
+            return false;
+        rec->cause = 1;
+        rec->winner = v;
+    }
+    else if(skip(p,end,"The game was a draw.") != NULL) {
+        rec->cause = 2;
+    }
+    else if(skip(p,end,"The game was quitted due to inactivity.") != NULL) {
+        rec->cause = 3;
+    }
+    else if(skip(p,end,"The game was quitted due to disconnection.") != NULL) {
+        rec->cause = 4;
+    }
+    else {
+        return false;
+    }
+    // a game on another board than 3x3 has a line with its board after the result
+    rec->variant = 0;
+    const char* board = (const char*)memchr(p,'\n',end - p);
+    int64_t m2, k;
+    if(board != NULL && (p = skip(board + 1,end,"Board = ")) != NULL) {
+        if(!(p = getnum(p,end,&m)) || !(p = skip(p,end,"x")) || !(p = getnum(p,end,&m2)) || !(p = skip(p,end,", ")) ||
+           !(p = getnum(p,end,&k)) || !(p = skip(p,end," in a row")))
+            return false;
+        int v = variantof(m,m2,k);
+        if(v <= 0)
+            return false;
+        rec->variant = v;
+    }
+    return true;
+}
+
+// function to add the game rec to st
+void addgame(STATS* st, const LOGREC* rec) {
+    ++st->games;
+    ++st->causes[rec->cause];
+    ++st->lengths[rec->nmoves];
+    int64_t duration = max<int64_t>(0,rec->endtime - rec->starttime);
+    ++st->durations[min(DURBUCKETS - 1,duration == 0 ? 0 : 64 - __builtin_clzll(duration))];
+    ++st->hourofday[(rec->starttime / 3600 % 24 + 24) % 24];
+    ++st->hours[rec->starttime / 3600];
+    if(rec->nmoves > 0 && rec->variant == 0) {
+        int cell = ((rec->moves[0] >> 4) - 1) * 3 + (rec->moves[0] & 15) - 1;
+        if(cell >= 0 && cell < 9) {
+            ++st->openings[cell];
+            st->openingwins[cell] += (rec->cause == 1 && rec->winner == 1);
+        }
+    }
+    if(rec->cause == 1) {
+        ++(rec->winner == 1 ? st->p1wins : st->p2wins);
+    }
+    reserveplayers(&st->players,2);
+    PSTATS* p[2] = {playerstats(&st->players,rec->pid1),playerstats(&st->players,rec->pid2)};
+    for(int i=0;i<2;++i) {
+        ++p[i]->games;
+        if(rec->cause == 1)
+            ++(rec->winner == i + 1 ? p[i]->wins : p[i]->losses);
+        else if(rec->cause == 2)
+            ++p[i]->draws;
+        else if(rec->cause == 4)
+            ++p[i]->disconnects;
+    }
+    // the player who timed out is the one whose move was awaited. player 1 makes the moves with an even index
+    if(rec->cause == 3)
+        ++p[rec->nmoves % 2]->timeouts;
+}
+
+// function to parse every [NEW ENTRY] block that starts in c and add its game to st
+void parsechunk(const CHUNK& c, STATS* st) {
+    const size_t marklen = strlen(LOGMARK);
+    const char* p = c.begin;
+    while(p < c.end) {
+        const char* mark = (const char*)memmem(p,c.end - p,LOGMARK,marklen);
+        if(mark == NULL)
+            break;
+        p = mark + marklen;
+        LOGREC rec;
+        if(parseentry(p,c.fileend,&rec))
+            addgame(st,&rec);
+        else
+            ++st->malformed;
+    }
+    st->bytes += c.end - c.begin;
+}
+
+// function to cut the mapped files into about n chunks that start at [NEW ENTRY] lines
+vector<CHUNK> makechunks(const vector<MAPPED>& files, int n) {
+    size_t total = 0;
+    for(const MAPPED& m : files)
+        total += m.size;
+    size_t target = max<size_t>(MINCHUNK,total / max(1,n));
+    vector<CHUNK> chunks;
+    for(const MAPPED& m : files) {
+        const char* data = (const char*)m.data;
+        const char* end = data + m.size;
+        const char* begin = data;
+        while(begin < end) {
+            const char* cut = begin + min(target,(size_t)(end - begin));
+            if(cut < end) {
+                // move the cut to the start of the next [NEW ENTRY] line
+                const char* mark = (const char*)memmem(cut,end - cut,LOGMARK,strlen(LOGMARK));
+                cut = (mark == NULL) ? end : mark;
+            }
+            chunks.push_back({begin,cut,end});
+            begin = cut;
+        }
+    }
+    return chunks;
+}
+
+// function to add the aggregates of from to to
+void mergestats(STATS* to, const STATS* from) {
+    to->games += from->games; to->bytes += from->bytes; to->malformed += from->malformed;
+    to->p1wins += from->p1wins; to->p2wins += from->p2wins;
+    for(int i=0;i<5;++i) to->causes[i] += from->causes[i];
+    for(int i=0;i<9;++i) {
+        to->openings[i] += from->openings[i]; to->openingwins[i] += from->openingwins[i];
+    }
+    for(int i=0;i<=LOGMAXMOVES;++i) to->lengths[i] += from->lengths[i];
+    for(int i=0;i<DURBUCKETS;++i) to->durations[i] += from->durations[i];
+    for(int i=0;i<24;++i) to->hourofday[i] += from->hourofday[i];
+    for(const auto& h : from->hours) to->hours[h.first] += h.second;
+    for(const PSTATS& s : from->players.slots) {
+        if(s.games == 0)
+            continue;
+        reserveplayers(&to->players,1);
+        PSTATS* t = playerstats(&to->players,s.pid);
+        t->games += s.games; t->wins += s.wins; t->losses += s.losses; t->draws += s.draws;
+        t->timeouts += s.timeouts; t->disconnects += s.disconnects;
+    }
+}
+
+// function to parse all the chunks with nthreads threads. returns the merged aggregates
+STATS* analyze(const vector<CHUNK>& chunks, int nthreads) {
+    vector<STATS*> stats(nthreads);
+    atomic<size_t> next(0);
+    vector<thread> ths;
+    for(int i=0;i<nthreads;++i) {
+        stats[i] = new STATS();
+        ths.emplace_back([&,i]() {
+            size_t c;
+            while((c = next++) < chunks.size())
+                parsechunk(chunks[c],stats[i]);
+        });
+    }
+    for(thread& th : ths)
+        th.join();
+    for(int i=1;i<nthreads;++i) {
+        mergestats(stats[0],stats[i]);
+        delete stats[i];
+    }
+    return stats[0];
+}
+
+// function to return x as a % of total
+double pct(uint64_t x, uint64_t total) {
+    return total == 0 ? 0 : 100.0 * x / total;
+}
+
+// function to print the aggregates of st
+void report(const STATS* st, int topn, bool allhours) {
+    uint64_t n = st->games;
+    printf("games = %lu, malformed entries = %lu, players = %zu\n",(unsigned long)n,(unsigned long)st->malformed,st->players.used);
+    printf("results: win %.1f%% (player 1 %.1f%%, player 2 %.1f%%), draw %.1f%%, timeout %.1f%%, disconnect %.1f%%\n",
+           pct(st->causes[1],n),pct(st->p1wins,n),pct(st->p2wins,n),pct(st->causes[2],n),pct(st->causes[3],n),pct(st->causes[4],n));
+
+    vector<const PSTATS*> players;
+    for(const PSTATS& s : st->players.slots) {
+        if(s.games != 0)
+            players.push_back(&s);
+    }
+    size_t top = min(players.size(),(size_t)topn);
+    partial_sort(players.begin(),players.begin() + top,players.end(),[](const PSTATS* a, const PSTATS* b) {
+        return a->games != b->games ? a->games > b->games : a->pid < b->pid;
+    });
+    printf("\nplayers with the most games:\n%10s %10s %8s %8s %8s %8s %8s\n","player","games","win%","loss%","draw%","timeout%","discon%");
+    for(size_t i=0;i<top;++i) {
+        const PSTATS* s = players[i];
+        printf("%10u %10lu %8.1f %8.1f %8.1f %8.1f %8.1f\n",s->pid,(unsigned long)s->games,pct(s->wins,s->games),
+               pct(s->losses,s->games),pct(s->draws,s->games),pct(s->timeouts,s->games),pct(s->disconnects,s->games));
+    }
+
+    printf("\nopening moves of 3x3 games (share of games, player 1 win%% after it):\n");
+    uint64_t opened = 0;
+    for(int i=0;i<9;++i)
+        opened += st->openings[i];
+    for(int r=0;r<3;++r) {
+        for(int c=0;c<3;++c) {
+            int k = 3 * r + c;
+            printf("  (%d,%d) %5.1f%% %5.1f%%",r + 1,c + 1,pct(st->openings[k],opened),pct(st->openingwins[k],st->openings[k]));
+        }
+        printf("\n");
+    }
+
+    printf("\ngame length (moves):\n");
+    for(int i=0;i<=LOGMAXMOVES;++i) {
+        if(i > 9 && st->lengths[i] == 0)
+            continue;                                       // only games on bigger boards than 3x3 are that long
+        printf("  %d: %10lu %5.1f%%\n",i,(unsigned long)st->lengths[i],pct(st->lengths[i],n));
+    }
+
+    printf("\ngame duration:\n");
+    for(int b=0;b<DURBUCKETS;++b) {
+        if(st->durations[b] == 0)
+            continue;
+        if(b == 0)
+            printf("  %13s","< 1 s");
+        else if(b == DURBUCKETS - 1)
+            printf("  >= %7lld s  ",1LL << (b - 1));
+        else
+            printf("  %5lld-%5lld s",1LL << (b - 1),(1LL << b) - 1);
+        printf(" %10lu %5.1f%%\n",(unsigned long)st->durations[b],pct(st->durations[b],n));
+    }
+
+    vector<pair<int64_t,uint64_t>> hours(st->hours.begin(),st->hours.end());
+    sort(hours.begin(),hours.end());
+    uint64_t peak = 0;
+    int64_t peakhour = 0;
+    for(const auto& h : hours) {
+        if(h.second > peak) {
+            peak = h.second; peakhour = h.first;
+        }
+    }
+    char when[32];
+    auto hourname = [&](int64_t hour) {
+        time_t t = hour * 3600;
+        tm parts;
+        gmtime_r(&t,&parts);                                            // the times are local times without a zone
+        strftime(when,sizeof when,"%Y-%m-%d %H:00",&parts);
+        return when;
+    };
+    printf("\nthroughput: %zu hours with games, %.1f games/hour on average",hours.size(),hours.empty() ? 0.0 : (double)n / hours.size());
+    if(!hours.empty())
+        printf(", peak %lu games in the hour from %s",(unsigned long)peak,hourname(peakhour));
+    printf("\nby hour of the day:\n");
+    for(int h=0;h<24;++h)
+        printf("  %02d:00 %10lu %5.1f%%\n",h,(unsigned long)st->hourofday[h],pct(st->hourofday[h],n));
+    if(allhours) {
+        printf("by hour:\n");
+        for(const auto& h : hours)
+            printf("  %s %10lu\n",hourname(h.first),(unsigned long)h.second);
+    }
+}
+
+// function to write a log of n random games to path in the server's format. 1000 games start every hour
+void generate(const char* path, long long n) {
+    FILE* f = fopen(path,"w");
+    if(f == NULL) {
+        perror("ERROR - fopen failed"); exit(-1);
+    }
+    mt19937_64 rng(1);
+    static const int lines[8][3] = {{0,1,2},{3,4,5},{6,7,8},{0,3,6},{1,4,7},{2,5,8},{0,4,8},{2,4,6}};
+    string out;
+    int64_t start = 1700000000;
+    for(long long g=0;g<n;++g) {
+        LOGREC rec;
+        rec.gameid = g + 1;
+        rec.pid1 = 1 + rng() % 10000;
+        rec.pid2 = 1 + rng() % 10000;
+        rec.starttime = start + g * 36 / 10 + rng() % 4;
+        rec.nmoves = 0;
+        rec.cause = 2;
+        rec.winner = 0;
+        rec.variant = 0;
+        // random moves till a win or a full board. a few games end early by timeout or disconnect
+        int board[9] = {0};
+        int quitat = (rng() % 100 < 10) ? rng() % 9 : -1;
+        while(rec.nmoves < 9) {
+            if(rec.nmoves == quitat) {
+                rec.cause = (rng() % 2) ? 3 : 4;
+                break;
+            }
+            int cell;
+            do {
+                cell = rng() % 9;
+            } while(board[cell] != 0);
+            int p = rec.nmoves % 2 + 1;
+            board[cell] = p;
+            rec.moves[rec.nmoves++] = ((cell / 3 + 1) << 4) | (cell % 3 + 1);
+            bool won = false;
+            for(const auto& l : lines)
+                won |= board[l[0]] == p && board[l[1]] == p && board[l[2]] == p;
+            if(won) {
+                rec.cause = 1; rec.winner = p;
+                break;
+            }
+        }
+        rec.endtime = rec.starttime + rec.nmoves * (1 + rng() % 8);
+        formatrec(&rec,out);
+        if(out.size() >= (1 << 20)) {
+            fwrite(out.data(),1,out.size(),f);
+            out.clear();
+        }
+    }
+    fwrite(out.data(),1,out.size(),f);
+    fclose(f);
+}
+
+int main(int argc, char** argv) {
+    int nthreads = thread::hardware_concurrency(), topn = 10;
+    bool bench = false, allhours = false;
+    long long gen = 0;
+    int opt;
+    while((opt = getopt(argc,argv,"t:p:abg:")) != -1) {
+        if(opt == 't')
+            nthreads = max(1,atoi(optarg));
+        else if(opt == 'p')
+            topn = max(0,atoi(optarg));
+        else if(opt == 'a')
+            allhours = true;
+        else if(opt == 'b')
+            bench = true;
+        else if(opt == 'g')
+            gen = max(1LL,atoll(optarg));
+        else
+            optind = argc + 1;
+    }
+    if(optind >= argc) {
+        cout << "Usage: ./loganalyze [-t THREADS] [-p TOP PLAYERS] [-a] [LOG FILE] ...\n"
+                "       ./loganalyze -b [-t MAX THREADS] [LOG FILE] ...\n"
+                "       ./loganalyze -g [NUM OF GAMES] [LOG FILE]" << endl;
+        exit(-1);
+    }
+    if(gen > 0) {
+        generate(argv[optind],gen);
+        return 0;
+    }
+    vector<MAPPED> files;
+    for(int i=optind;i<argc;++i) {
+        MAPPED m = mapfile(argv[i]);
+        if(m.size == 0) {
+            fprintf(stderr,"ERROR - %s is missing or empty\n",argv[i]);
+            continue;
+        }
+        madvise((void*)m.data,m.size,MADV_SEQUENTIAL);
+        files.push_back(m);
+    }
+    if(!bench) {
+        STATS* st = analyze(makechunks(files,nthreads * CHUNKSPERTHREAD),nthreads);
+        report(st,topn,allhours);
+        delete st;
+    }
+    else {
+        for(int t=1;;t=min(2 * t,nthreads)) {
+            double start = nowsecs();
+            STATS* st = analyze(makechunks(files,t * CHUNKSPERTHREAD),t);
+            double secs = nowsecs() - start;
+            printf("threads = %2d: %8.3f s, %6.2f GB/s, %10.0f games/s\n",t,secs,st->bytes / secs / 1e9,st->games / secs);
+            delete st;
+            if(t == nthreads)
+                break;
+        }
+    }
+    for(MAPPED& m : files)
+        unmapfile(m);
+    return 0;
+}
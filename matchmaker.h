@@ -0,0 +1,231 @@
+/*
+    matchmaker.h = Rating-aware matchmaking queue for the TicTacToe server
+    Author = Vikram, CS19B021
+    Purpose = Waiting players are kept in MMBANDS shards by rating band, each with its own lock, so any number of
+              threads can add, match and remove players at the same time. A new player is matched with a waiting
+              player whose rating is within MMWINDOW of its own, looking at the nearest bands first. A player who
+              can't be matched waits in its band and retries now and then with a window that widens by MMWIDEN
+              per second of waiting. Ratings are Elo ratings, remembered by player name and updated after every
+              won or drawn game. The queue depth, the num of matches and a histogram of the time-to-match are kept
+              for reports.
+*/
+#ifndef MATCHMAKER_H
+#define MATCHMAKER_H
+#include <bits/stdc++.h>
+#define MMBANDWIDTH 50                                                  // rating points per band
+#define MMBANDS 64                                                      // num of bands. the last band takes all higher ratings
+#define MMWINDOW MMBANDWIDTH                                            // initial match window (+/- rating points)
+#define MMWIDEN 100                                                     // growth of the match window per second of waiting
+#define MMMAXWINDOW (MMBANDS * MMBANDWIDTH)                             // max match window. it covers every rating
+#define MMRETRY 250                                                     // time (in ms) between the match attempts of a waiting player
+#define MMHISTLEN 24                                                    // num of buckets of the time-to-match histogram
+#define ELOSTART 1200                                                   // rating of a new player
+#define ELOK 32                                                         // max rating change per game
+#define MAXNAME 32                                                      // max len of a player name
+#define RATINGSHARDS 16                                                 // num of shards of the table of ratings
+
+// states of an entry. MM_IDLE -> not in the queue, MM_WAITING -> in the queue, MM_TAKEN -> matched by a
+// player. only the owner of an entry moves it from MM_TAKEN back to MM_IDLE
+enum MMSTATE { MM_IDLE, MM_WAITING, MM_TAKEN };
+
+// structure to represent a player in the queue. it is embedded in the object of its owner (data). the other
+// fields are only changed under the lock of the band shard the entry is in
+struct MMENTRY {
+    int rating;                                                         // rating of the player
+    int variant;                                                        // board the player wants (see mnkboard.h). only equal variants match
+    long long since;                                                    // time (in ms) the player started waiting
+    MMSTATE state;                                                      // where the entry is
+    int band;                                                           // band of the entry while it is waiting
+    size_t pos;                                                         // index of the entry in the list of its band
+    void* data;                                                         // owner of the entry
+    const void* owner;                                                  // session of the player (a multiplexed connection). entries of one session never match. NULL -> none
+};
+
+// structure to represent the waiting players of one rating band
+struct MMSHARD {
+    alignas(64) std::mutex lock;
+    std::vector<MMENTRY*> entries;
+};
+
+// structure to represent the matchmaker and its counters
+struct MATCHMAKER {
+    MMSHARD shards[MMBANDS];
+    alignas(64) std::atomic<long> depth;                                // num of waiting players
+    std::atomic<uint64_t> matches;                                      // num of matches made
+    std::atomic<uint64_t> left;                                         // num of players who left the queue unmatched
+    std::atomic<uint64_t> waithist[MMHISTLEN];                          // bucket i counts waits of < 2^i ms (the last one the rest)
+};
+
+// structure to represent a shard of the table of ratings
+struct RATINGSHARD {
+    std::mutex lock;
+    std::unordered_map<std::string,int> ratings;
+};
+
+MATCHMAKER matchmaker;
+RATINGSHARD ratingtable[RATINGSHARDS];
+
+// function to return the band of rating
+inline int mmband(int rating) {
+    return std::min(MMBANDS - 1,std::max(0,rating / MMBANDWIDTH));
+}
+
+// function to count a time-to-match of waitms ms
+inline void mmrecord(long long waitms) {
+    int b = (waitms <= 0) ? 0 : std::min(MMHISTLEN - 1,64 - __builtin_clzll(waitms));
+    matchmaker.waithist[b].fetch_add(1,std::memory_order_relaxed);
+}
+
+// function to take e out of the list of its band. the lock of the band must be held
+inline void mmerase(MMSHARD* shard, MMENTRY* e) {
+    MMENTRY* last = shard->entries.back();
+    shard->entries[e->pos] = last;
+    last->pos = e->pos;
+    shard->entries.pop_back();
+    matchmaker.depth.fetch_sub(1,std::memory_order_relaxed);
+}
+
+// function to find a waiting player of another session who wants e's board with a rating within window of e's rating. the bands are
+// searched nearest first and the player who has waited longest in a band is preferred. the match is taken out of
+// the queue and returned. NULL is returned if there is no match
+inline MMENTRY* mmmatch(MMENTRY* e, int window, long long now) {
+    int home = mmband(e->rating);
+    int lo = mmband(e->rating - window), hi = mmband(e->rating + window);
+    for(int d=0;home - d >= lo || home + d <= hi;++d) {
+        for(int side=0;side<2;++side) {
+            int b = (side == 0) ? home - d : home + d;
+            if(b < lo || b > hi || (d == 0 && side == 1))
+                continue;
+            MMSHARD* shard = &matchmaker.shards[b];
+            std::lock_guard<std::mutex> guard(shard->lock);
+            MMENTRY* best = NULL;
+            for(MMENTRY* cand : shard->entries) {
+                if(cand->variant == e->variant && abs(cand->rating - e->rating) <= window &&
+                   (e->owner == NULL || cand->owner != e->owner) &&
+                   (best == NULL || cand->since < best->since))
+                    best = cand;
+            }
+            if(best != NULL) {
+                mmerase(shard,best);
+                best->state = MM_TAKEN;
+                mmrecord(now - best->since);
+                matchmaker.matches.fetch_add(1,std::memory_order_relaxed);
+                return best;
+            }
+        }
+    }
+    return NULL;
+}
+
+// function to put e in the queue of its band
+inline void mmwait(MMENTRY* e) {
+    MMSHARD* shard = &matchmaker.shards[mmband(e->rating)];
+    std::lock_guard<std::mutex> guard(shard->lock);
+    e->band = mmband(e->rating);
+    e->pos = shard->entries.size();
+    e->state = MM_WAITING;
+    shard->entries.push_back(e);
+    matchmaker.depth.fetch_add(1,std::memory_order_relaxed);
+}
+
+// function to take e out of the queue. returns false if e has been matched already
+inline bool mmleave(MMENTRY* e) {
+    MMSHARD* shard = &matchmaker.shards[e->band];
+    std::lock_guard<std::mutex> guard(shard->lock);
+    if(e->state != MM_WAITING)
+        return false;
+    mmerase(shard,e);
+    e->state = MM_IDLE;
+    return true;
+}
+
+// function to match a new player e at time now. the match is returned. if there is none, e waits in the queue
+// and NULL is returned
+inline MMENTRY* mmenqueue(MMENTRY* e, long long now) {
+    e->since = now;
+    MMENTRY* m = mmmatch(e,MMWINDOW,now);
+    if(m != NULL) {
+        mmrecord(0);
+        return m;
+    }
+    mmwait(e);
+    return NULL;
+}
+
+// function to try again to match the waiting player e with the window it has earned by waiting till now.
+// the match is returned. NULL is returned if e still waits or if e has been matched already (e->state = MM_TAKEN)
+inline MMENTRY* mmretry(MMENTRY* e, long long now) {
+    if(!mmleave(e))
+        return NULL;
+    int window = std::min((long long)MMMAXWINDOW,MMWINDOW + MMWIDEN * (now - e->since) / 1000);
+    MMENTRY* m = mmmatch(e,window,now);
+    if(m != NULL) {
+        mmrecord(now - e->since);
+        return m;
+    }
+    mmwait(e);
+    return NULL;
+}
+
+// function to return the rating remembered for name. players without a name always start with ELOSTART
+inline int ratingof(const char* name) {
+    if(name[0] == '\0')
+        return ELOSTART;
+    RATINGSHARD* shard = &ratingtable[std::hash<std::string_view>()(name) % RATINGSHARDS];
+    std::lock_guard<std::mutex> guard(shard->lock);
+    auto it = shard->ratings.find(name);
+    return (it == shard->ratings.end()) ? ELOSTART : it->second;
+}
+
+// function to remember rating for name
+inline void setrating(const char* name, int rating) {
+    if(name[0] == '\0')
+        return;
+    RATINGSHARD* shard = &ratingtable[std::hash<std::string_view>()(name) % RATINGSHARDS];
+    std::lock_guard<std::mutex> guard(shard->lock);
+    shard->ratings[name] = rating;
+}
+
+// function to add delta to the rating remembered for name and return the new rating. the games of one name may be
+// played at once (by the seats of a multiplexed connection), so each adds its own change instead of overwriting the
+// rating. a player without a name isn't remembered: its rating becomes rating + delta
+inline int addrating(const char* name, int rating, int delta) {
+    if(name[0] == '\0')
+        return rating + delta;
+    RATINGSHARD* shard = &ratingtable[std::hash<std::string_view>()(name) % RATINGSHARDS];
+    std::lock_guard<std::mutex> guard(shard->lock);
+    auto it = shard->ratings.try_emplace(name,ELOSTART).first;
+    it->second += delta;
+    return it->second;
+}
+
+// function to update the ratings ra and rb of two players after a game. scorea = 1 -> a won, 0.5 -> draw, 0 -> b won
+inline void eloupdate(int* ra, int* rb, double scorea) {
+    double ea = 1.0 / (1.0 + pow(10.0,(*rb - *ra) / 400.0));
+    int delta = (int)lround(ELOK * (scorea - ea));
+    *ra += delta; *rb -= delta;
+}
+
+// function to estimate the time-to-match (in ms) below which a fraction q of the matched players got matched.
+// it is the upper bound of the histogram bucket that holds that fraction
+inline long long mmquantile(double q) {
+    uint64_t total = 0, seen = 0;
+    for(int i=0;i<MMHISTLEN;++i)
+        total += matchmaker.waithist[i].load(std::memory_order_relaxed);
+    for(int i=0;i<MMHISTLEN;++i) {
+        seen += matchmaker.waithist[i].load(std::memory_order_relaxed);
+        if(total > 0 && seen >= q * total)
+            return (i == 0) ? 0 : (1LL << i);
+    }
+    return 0;
+}
+
+// function to print the counters of the matchmaker to f
+inline void mmreport(FILE* f) {
+    fprintf(f,"matchmaker: depth = %ld, matches = %lu, left unmatched = %lu, time-to-match p50 <= %lld ms, p90 <= %lld ms, p99 <= %lld ms\n",
+            matchmaker.depth.load(),(unsigned long)matchmaker.matches.load(),(unsigned long)matchmaker.left.load(),
+            mmquantile(0.5),mmquantile(0.9),mmquantile(0.99));
+    fflush(f);
+}
+
+#endif
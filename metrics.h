@@ -0,0 +1,253 @@
+/*
+    metrics.h = Low-overhead metrics of the TicTacToe server
+    Author = Vikram, CS19B021
+    Purpose = Every thread counts into its own METRICS block, so counting is a plain load and store with no lock
+              and no shared cache line. Latencies go into log-linear (HDR-style) histograms with 8 sub-buckets per
+              power of 2, i.e. a recorded value is off by at most 12.5%. The blocks of all threads are merged only
+              when the metrics are asked for and are written in the Prometheus text format. The block of a thread
+              that exits is folded into a retired block and reused by the next new thread.
+*/
+#ifndef METRICS_H
+#define METRICS_H
+#include <bits/stdc++.h>
+#define HISTSUBBITS 3                                                   // 2^HISTSUBBITS sub-buckets per power of 2
+#define HISTSUB (1 << HISTSUBBITS)
+#define HISTMAXBIT 40                                                   // values of 2^HISTMAXBIT us (~12 days) or more go into the last bucket
+#define HISTLEN (2*HISTSUB + (HISTMAXBIT - HISTSUBBITS - 1) * HISTSUB)  // num of buckets of a histogram
+
+// counters. M_WINS to M_DISCONNECTS count finished games by cause
+enum METRICCOUNTER { M_ACCEPTS, M_SESSIONS, M_SESSIONSFREED, M_GAMESSTARTED, M_WINS, M_DRAWS, M_TIMEOUTS, M_DISCONNECTS,
+                     M_MOVES, M_INVALIDMOVES, M_SENDFAILS, M_SPECJOINS, M_SPECDROPS, M_QUEUED, M_REJECTS, M_QUERIES,
+                     M_MUXCONNS, M_MUXJOINS, M_NUMCOUNTERS };
+
+// histograms of latencies (in us, H_LOGPUSH in ns). H_MATCHWAIT -> time-to-match, H_MOVE -> move prompt to move,
+// H_HEARTBEAT -> KEEP_ALIVE to ack, H_LOGPUSH -> time taken to hand a finished game to the logger
+enum METRICHIST { H_MATCHWAIT, H_MOVE, H_HEARTBEAT, H_LOGPUSH, H_NUMHISTS };
+
+// structure to represent a histogram. only its owner thread writes to it
+struct HISTOGRAM {
+    std::atomic<uint64_t> buckets[HISTLEN];
+    std::atomic<uint64_t> sum;                                          // sum of the recorded values
+};
+
+// structure to represent the metrics of one thread
+struct METRICS {
+    alignas(64) std::atomic<uint64_t> counters[M_NUMCOUNTERS];
+    HISTOGRAM hists[H_NUMHISTS];
+};
+
+// structure to represent the blocks of all threads
+struct METRICSREGISTRY {
+    std::mutex lock;
+    std::vector<METRICS*> live;                                         // blocks of running threads
+    std::vector<METRICS*> free;                                         // zeroed blocks of exited threads
+    METRICS retired;                                                    // sum of the blocks of exited threads
+};
+
+METRICSREGISTRY metricsregistry;
+
+// function to add the values of block from to block to and zero from if clear is true
+inline void metricsadd(METRICS* to, METRICS* from, bool clear) {
+    for(int c=0;c<M_NUMCOUNTERS;++c) {
+        to->counters[c].fetch_add(from->counters[c].load(std::memory_order_relaxed),std::memory_order_relaxed);
+        if(clear)
+            from->counters[c].store(0,std::memory_order_relaxed);
+    }
+    for(int h=0;h<H_NUMHISTS;++h) {
+        HISTOGRAM* th = &to->hists[h];
+        HISTOGRAM* fh = &from->hists[h];
+        for(int b=0;b<HISTLEN;++b) {
+            uint64_t v = fh->buckets[b].load(std::memory_order_relaxed);
+            if(v != 0) {
+                th->buckets[b].fetch_add(v,std::memory_order_relaxed);
+                if(clear)
+                    fh->buckets[b].store(0,std::memory_order_relaxed);
+            }
+        }
+        th->sum.fetch_add(fh->sum.load(std::memory_order_relaxed),std::memory_order_relaxed);
+        if(clear)
+            fh->sum.store(0,std::memory_order_relaxed);
+    }
+}
+
+// structure to represent the block of the current thread. the block is retired when the thread exits
+struct METRICSREF {
+    METRICS* m = NULL;
+    ~METRICSREF() {
+        if(m == NULL)
+            return;
+        std::lock_guard<std::mutex> guard(metricsregistry.lock);
+        metricsadd(&metricsregistry.retired,m,true);
+        auto& live = metricsregistry.live;
+        live.erase(std::find(live.begin(),live.end(),m));
+        metricsregistry.free.push_back(m);
+    }
+};
+
+// function to return the block of the current thread
+inline METRICS* mymetrics() {
+    static thread_local METRICSREF ref;
+    if(ref.m == NULL) {
+        std::lock_guard<std::mutex> guard(metricsregistry.lock);
+        if(metricsregistry.free.empty()) {
+            ref.m = new METRICS();
+        }
+        else {
+            ref.m = metricsregistry.free.back();
+            metricsregistry.free.pop_back();
+        }
+        metricsregistry.live.push_back(ref.m);
+    }
+    return ref.m;
+}
+
+// function to add n to counter c of the current thread
+inline void mcount(int c, uint64_t n = 1) {
+    std::atomic<uint64_t>& x = mymetrics()->counters[c];
+    x.store(x.load(std::memory_order_relaxed) + n,std::memory_order_relaxed);
+}
+
+// function to return the bucket of value v. values < 2*HISTSUB have a bucket each. after that, every power of 2
+// is split into HISTSUB buckets
+inline int histbucket(uint64_t v) {
+    if(v < 2*HISTSUB)
+        return v;
+    int msb = 63 - __builtin_clzll(v);
+    if(msb >= HISTMAXBIT)
+        return HISTLEN - 1;
+    return 2*HISTSUB + (msb - HISTSUBBITS - 1) * HISTSUB + ((v >> (msb - HISTSUBBITS)) & (HISTSUB - 1));
+}
+
+// function to return the smallest value of bucket b
+inline uint64_t histlow(int b) {
+    if(b < 2*HISTSUB)
+        return b;
+    int msb = (b - 2*HISTSUB) / HISTSUB + HISTSUBBITS + 1;
+    return ((uint64_t)(HISTSUB + (b - 2*HISTSUB) % HISTSUB)) << (msb - HISTSUBBITS);
+}
+
+// function to record the value val in histogram h of the current thread
+inline void mrecord(int h, long long val) {
+    HISTOGRAM* hist = &mymetrics()->hists[h];
+    uint64_t v = std::max(0LL,val);
+    std::atomic<uint64_t>& b = hist->buckets[histbucket(v)];
+    b.store(b.load(std::memory_order_relaxed) + 1,std::memory_order_relaxed);
+    hist->sum.store(hist->sum.load(std::memory_order_relaxed) + v,std::memory_order_relaxed);
+}
+
+// function to merge the blocks of all threads into total
+inline void metricsmerge(METRICS* total) {
+    std::lock_guard<std::mutex> guard(metricsregistry.lock);
+    metricsadd(total,&metricsregistry.retired,false);
+    for(METRICS* m : metricsregistry.live)
+        metricsadd(total,m,false);
+}
+
+// function to return the value below which a fraction q of the values recorded in hist lie.
+// the upper end of the bucket that holds that fraction is returned
+inline double histquantile(HISTOGRAM* hist, uint64_t count, double q) {
+    if(count == 0)
+        return 0;
+    uint64_t seen = 0;
+    for(int b=0;b<HISTLEN;++b) {
+        seen += hist->buckets[b].load(std::memory_order_relaxed);
+        if(seen >= q * count)
+            return (b == HISTLEN - 1) ? histlow(b) : histlow(b + 1);
+    }
+    return histlow(HISTLEN - 1);
+}
+
+// names and help texts of the counters and histograms in the Prometheus text format
+const char* countername[M_NUMCOUNTERS] = {
+    "tictactoe_accepts_total", "tictactoe_sessions_started_total", "tictactoe_sessions_closed_total",
+    "tictactoe_games_started_total",
+    "tictactoe_games_finished_total{cause=\"win\"}", "tictactoe_games_finished_total{cause=\"draw\"}",
+    "tictactoe_games_finished_total{cause=\"timeout\"}", "tictactoe_games_finished_total{cause=\"disconnect\"}",
+    "tictactoe_moves_total{valid=\"true\"}", "tictactoe_moves_total{valid=\"false\"}", "tictactoe_send_failures_total",
+    "tictactoe_spectators_total", "tictactoe_spectators_dropped_total", "tictactoe_waiting_room_entries_total",
+    "tictactoe_rejected_total", "tictactoe_queries_total", "tictactoe_mux_connections_total", "tictactoe_mux_joins_total"
+};
+const char* counterhelp[M_NUMCOUNTERS] = {
+    "Player connections accepted.", "Pairs of players moved into a game.", "Game sessions whose connections were closed.",
+    "Games started (including replays).", "Games finished, by cause.", NULL, NULL, NULL, "Moves received, by validity.", NULL,
+    "Sends to players that failed.", "Spectators who started watching a game.", "Spectators disconnected for not keeping up.",
+    "Players who had to wait in the waiting room.", "Connections turned away since the server and its waiting room were full.",
+    "Leaderboard and record queries answered.", "Connections that play many games at once (HELLO_MUX).",
+    "Games joined over multiplexed connections."
+};
+const char* histname[H_NUMHISTS] = {
+    "tictactoe_time_to_match_seconds", "tictactoe_move_latency_seconds", "tictactoe_heartbeat_rtt_seconds",
+    "tictactoe_log_push_seconds"
+};
+const char* histhelp[H_NUMHISTS] = {
+    "Time from a player's protocol negotiation to its match.", "Time from a move prompt to the move.",
+    "Time from a KEEP_ALIVE msg to its ack.", "Time taken to hand a finished game to the logger."
+};
+const double histunit[H_NUMHISTS] = {1e6, 1e6, 1e6, 1e9};              // units of the values of a histogram per second
+
+// structure to represent a value that is kept outside of the METRICS blocks (e.g. by the matchmaker)
+struct METRICVALUE {
+    const char* name;
+    const char* type;                                                   // "counter" or "gauge"
+    const char* help;
+    double value;
+};
+
+// function to write the merged metrics and the given values in the Prometheus text format to out
+inline void metricstext(std::string& out, const std::vector<METRICVALUE>& values) {
+    METRICS* total = new METRICS();
+    metricsmerge(total);
+    char line[256];
+    for(int c=0;c<M_NUMCOUNTERS;++c) {
+        if(counterhelp[c] != NULL) {
+            std::string family(countername[c],strcspn(countername[c],"{"));
+            snprintf(line,sizeof line,"# HELP %s %s\n# TYPE %s counter\n",family.c_str(),counterhelp[c],family.c_str());
+            out += line;
+        }
+        snprintf(line,sizeof line,"%s %lu\n",countername[c],(unsigned long)total->counters[c].load());
+        out += line;
+    }
+    for(const METRICVALUE& v : values) {
+        snprintf(line,sizeof line,"# HELP %s %s\n# TYPE %s %s\n%s %.17g\n",v.name,v.help,v.name,v.type,v.name,v.value);
+        out += line;
+    }
+    // histograms with a bucket for every power of 2 units, which is a bucket boundary of HISTOGRAM too. the bucket of
+    // 2^bit counts the values < 2^bit. values are whole units, so its le (which is inclusive) is 2^bit - 1 units
+    for(int h=0;h<H_NUMHISTS;++h) {
+        HISTOGRAM* hist = &total->hists[h];
+        snprintf(line,sizeof line,"# HELP %s %s\n# TYPE %s histogram\n",histname[h],histhelp[h],histname[h]);
+        out += line;
+        uint64_t count = 0;
+        int b = 0;
+        for(int bit=0;bit<HISTMAXBIT;++bit) {
+            for(;b < HISTLEN - 1 && histlow(b) < (1ULL << bit);++b)
+                count += hist->buckets[b].load();
+            snprintf(line,sizeof line,"%s_bucket{le=\"%.15g\"} %lu\n",histname[h],(double)((1ULL << bit) - 1) / histunit[h],
+                     (unsigned long)count);
+            out += line;
+        }
+        for(;b < HISTLEN;++b)
+            count += hist->buckets[b].load();
+        snprintf(line,sizeof line,"%s_bucket{le=\"+Inf\"} %lu\n%s_sum %g\n%s_count %lu\n",histname[h],(unsigned long)count,
+                 histname[h],hist->sum.load() / histunit[h],histname[h],(unsigned long)count);
+        out += line;
+    }
+    // quantiles from the full resolution of the histograms
+    out += "# HELP tictactoe_latency_quantile_seconds Latency quantiles of every stage from the full resolution histograms.\n"
+           "# TYPE tictactoe_latency_quantile_seconds gauge\n";
+    const char* stage[H_NUMHISTS] = {"match", "move", "heartbeat", "log_push"};
+    for(int h=0;h<H_NUMHISTS;++h) {
+        HISTOGRAM* hist = &total->hists[h];
+        uint64_t count = 0;
+        for(int b=0;b<HISTLEN;++b)
+            count += hist->buckets[b].load();
+        for(double q : {0.5,0.9,0.99,0.999}) {
+            snprintf(line,sizeof line,"tictactoe_latency_quantile_seconds{stage=\"%s\",quantile=\"%g\"} %g\n",stage[h],q,
+                     histquantile(hist,count,q) / histunit[h]);
+            out += line;
+        }
+    }
+    delete total;
+}
+
+#endif
@@ -0,0 +1,102 @@
+/*
+    mmbench.cpp = Benchmark of the matchmaker of the TicTacToe server (see matchmaker.h)
+    Author = Vikram, CS19B021
+    Compilation CMD = g++ mmbench.cpp -o mmbench --std=c++17 -O2 -pthread
+    Usage = ./mmbench [-t MAX THREADS] [-d DURATION MS] [-s RATING SD]
+    Purpose = Runs 1, 2, 4, ... up to t threads that act like acceptor threads. Every thread queues new players
+              with normally distributed ratings (mean ELOSTART) as fast as it can and retries its own waiting
+              players every MMRETRY ms, like the lobby does. For every thread count, the rate of new players and
+              matches and the time-to-match are printed. -s 0 puts every player in one band, i.e. behind one lock.
+*/
+#include <bits/stdc++.h>
+#include "matchmaker.h"
+using namespace std;
+
+// function to get the current time in ms from a monotonic clock
+long long nowms() {
+    return chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// function executed by a benchmark thread till stop is set. new players are counted in added
+void feeder(atomic<bool>* stop, atomic<uint64_t>* added, int sd, int seed) {
+    mt19937 rng(seed);
+    normal_distribution<double> dist(ELOSTART,sd);
+    vector<MMENTRY*> free;
+    vector<pair<MMENTRY*,long long>> waiting;                  // waiting players with the time of their next retry
+    uint64_t n = 0;
+    while(!stop->load(memory_order_relaxed)) {
+        MMENTRY* e;
+        if(free.empty()) {
+            e = new MMENTRY();
+        }
+        else {
+            e = free.back(); free.pop_back();
+        }
+        e->rating = (sd == 0) ? ELOSTART : (int)dist(rng);
+        long long now = nowms();
+        MMENTRY* m = mmenqueue(e,now);
+        ++n;
+        if(m != NULL)
+            free.push_back(e);                              // the match is freed by its own thread
+        else
+            waiting.push_back({e,now + MMRETRY});
+        // retry the waiting players that are due. players matched by other threads are freed. the state of an
+        // entry is only read after mmretry() has taken the lock of its band
+        if((n & 255) == 0) {
+            for(size_t i=0;i<waiting.size();) {
+                MMENTRY* w = waiting[i].first;
+                if(now < waiting[i].second) {
+                    ++i;
+                    continue;
+                }
+                if(mmretry(w,now) != NULL || w->state == MM_TAKEN) {
+                    free.push_back(w);
+                    waiting[i] = waiting.back(); waiting.pop_back();
+                    continue;
+                }
+                waiting[i].second = now + MMRETRY;
+                ++i;
+            }
+        }
+    }
+    for(auto& w : waiting)
+        mmleave(w.first);
+    added->fetch_add(n);
+}
+
+int main(int argc, char** argv) {
+    int maxthreads = thread::hardware_concurrency(), duration = 1000, sd = 200;
+    int opt;
+    while((opt = getopt(argc,argv,"t:d:s:")) != -1) {
+        if(opt == 't')
+            maxthreads = max(1,atoi(optarg));
+        else if(opt == 'd')
+            duration = max(1,atoi(optarg));
+        else if(opt == 's')
+            sd = max(0,atoi(optarg));
+        else {
+            cout << "Usage: ./mmbench [-t MAX THREADS] [-d DURATION MS] [-s RATING SD]" << endl;
+            exit(-1);
+        }
+    }
+    for(int threads=1;threads<=maxthreads;threads*=2) {
+        uint64_t matches = matchmaker.matches.load();
+        for(int i=0;i<MMHISTLEN;++i)
+            matchmaker.waithist[i] = 0;
+        atomic<bool> stop(false);
+        atomic<uint64_t> added(0);
+        vector<thread> ths;
+        auto start = chrono::steady_clock::now();
+        for(int i=0;i<threads;++i)
+            ths.emplace_back(feeder,&stop,&added,sd,i + 1);
+        this_thread::sleep_for(chrono::milliseconds(duration));
+        stop = true;
+        for(thread& th : ths)
+            th.join();
+        double secs = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        matches = matchmaker.matches.load() - matches;
+        printf("threads = %2d: %10.0f players/s, %10.0f matches/s, time-to-match p50 <= %lld ms, p99 <= %lld ms\n",
+               threads,added / secs,matches / secs,mmquantile(0.5),mmquantile(0.99));
+    }
+    return 0;
+}
@@ -0,0 +1,122 @@
+/*
+    mnkbench.cpp = Benchmark of the m,n,k boards of the TicTacToe server (see mnkboard.h)
+    Author = Vikram, CS19B021
+    Compilation CMD = g++ mnkbench.cpp -o mnkbench --std=c++17 -O2
+    Usage = ./mnkbench [-n MOVES PER VARIANT]
+    Purpose = For every variant of mnkboard.h, random games of about n moves in all are played first and their moves
+              are kept. Then the same games are replayed three ways, timed: on the variant's bitboard through its
+              function pointers, the way the server does it; on a char array, with a win check that walks the
+              cells of the four lines through the move one at a time; and, for the 3x3 board, through the lookup
+              table of boardtable.h. The time per move and the size of the board are printed for all of them.
+*/
+#include <bits/stdc++.h>
+#include "boardtable.h"
+#include "mnkboard.h"
+using namespace std;
+
+// function to get the current time in ns from a monotonic clock
+long long nowns() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// function to place player p at (r,c) of the m x n char array cells and check for k in a row through (r,c) cell by
+// cell. returns the status of the board like mnkplay() (filled = num of filled cells after the move)
+int walkplay(char* cells, int m, int n, int k, int filled, int p, int r, int c) {
+    cells[r * n + c] = p;
+    const int dirs[4][2] = {{0,1},{1,0},{1,1},{1,-1}};
+    for(const auto& d : dirs) {
+        int run = 1;
+        for(int side : {1,-1}) {
+            int nr = r + side * d[0], nc = c + side * d[1];
+            while(nr >= 0 && nr < m && nc >= 0 && nc < n && cells[nr * n + nc] == p) {
+                ++run;
+                nr += side * d[0]; nc += side * d[1];
+            }
+        }
+        if(run >= k)
+            return p;
+    }
+    return filled == m * n ? 3 : 0;
+}
+
+int main(int argc, char** argv) {
+    long long target = 1000000;
+    int opt;
+    while((opt = getopt(argc,argv,"n:")) != -1) {
+        if(opt == 'n')
+            target = max(1LL,atoll(optarg));
+        else {
+            cout << "Usage: ./mnkbench [-n MOVES PER VARIANT]" << endl;
+            exit(-1);
+        }
+    }
+    mt19937 rng(1);
+    for(int v=0;v<NVARIANTS;++v) {
+        const VARIANT* var = &variants[v];
+        // random games. a game is its moves (cells r * n + c) in order
+        vector<vector<uint16_t>> games;
+        vector<char> mem(var->size);
+        void* b = mem.data();
+        long long moves = 0;
+        while(moves < target) {
+            var->init(b);
+            vector<uint16_t> g;
+            int status = 0;
+            for(int p=1;status == 0;p=3-p) {
+                int cell = var->pick(b,p,rng() % 2,rng());
+                status = var->play(b,p,cell / var->n,cell % var->n);
+                g.push_back(cell);
+            }
+            moves += g.size();
+            games.push_back(move(g));
+        }
+        // bitboard through the function pointers of the variant
+        int check = 0;
+        long long start = nowns();
+        for(const auto& g : games) {
+            var->init(b);
+            int p = 1;
+            for(uint16_t cell : g) {
+                check += var->play(b,p,cell / var->n,cell % var->n);
+                p = 3 - p;
+            }
+        }
+        double bitns = (double)(nowns() - start) / moves;
+        // char array with a win check that walks the lines through the move
+        vector<char> cells(var->m * var->n);
+        int walkcheck = 0;
+        start = nowns();
+        for(const auto& g : games) {
+            fill(cells.begin(),cells.end(),0);
+            int p = 1, filled = 0;
+            for(uint16_t cell : g) {
+                walkcheck += walkplay(cells.data(),var->m,var->n,var->k,++filled,p,cell / var->n,cell % var->n);
+                p = 3 - p;
+            }
+        }
+        double walkns = (double)(nowns() - start) / moves;
+        if(check != walkcheck) {
+            printf("ERROR - the bitboard and the cell walk disagree on board %s\n",var->name);
+            exit(-1);
+        }
+        printf("board %8s: %7lld games, %9lld moves, bitboard %6.1f ns/move (%4zu bytes), cell walk %6.1f ns/move",
+               var->name,(long long)games.size(),moves,bitns,var->size,walkns);
+        if(var->m == 3 && var->n == 3 && var->k == 3) {
+            // lookup table of boardtable.h
+            int tablecheck = 0;
+            start = nowns();
+            for(const auto& g : games) {
+                uint16_t board = 0;
+                int p = 1;
+                for(uint16_t cell : g) {
+                    board += p * pow3[cell];
+                    tablecheck += boardtable.info[board].status;
+                    p = 3 - p;
+                }
+            }
+            printf(", table %6.1f ns/move%s",(double)(nowns() - start) / moves,tablecheck == check ? "" : " (MISMATCH)");
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,224 @@
+/*
+    mnkboard.h = Bitboards of m,n,k games (TicTacToe on an m x n board, k in a row wins)
+    Author = Vikram, CS19B021
+    Purpose = MNKBOARD<M,N,K> keeps the cells of each player as bits in one word per line: a word per row, per
+              column, per diagonal and per anti-diagonal. The size of the words is picked at compile time from M
+              and N. A move sets one bit in each of the four lines through it, and only those four words are
+              checked for a win. Each check ANDs the word with itself shifted by 1, 2, 4, ... bits, so K in a
+              row costs about log2(K) shifts per line. The board sizes the server offers are listed in variants,
+              which gives the server (and its clients) the size of each board and its functions by number.
+              Variant 0 is the classic 3x3 board. The server still plays it from boardtable.h.
+*/
+#ifndef MNKBOARD_H
+#define MNKBOARD_H
+#include <bits/stdc++.h>
+#define MNKMAXDIM 15                                                    // max num of rows or cols of a variant. logs keep a move as (r << 4) | c
+#define MNKMAXCELLS (MNKMAXDIM * MNKMAXDIM)                             // max num of cells (and moves) of a variant
+#define MNKTEXTLEN (14 + MNKMAXCELLS * 4 + 1)                           // max size of the "Game Status" text of a board (with the NUL)
+
+// structure to represent an m x n board with k in a row to win. players are 1 ('X') and 2 ('O'). r and c are
+// 0-indexed. every line is a word with a bit per cell: bit c of a row and bit r of a column or a diagonal
+template<int M, int N, int K>
+struct MNKBOARD {
+    static_assert(M >= 1 && N >= 1 && M <= 64 && N <= 64, "a line must fit in a word");
+    static_assert(K >= 1 && K <= std::max(M,N), "k in a row must fit on the board");
+    typedef typename std::conditional<(M <= 16 && N <= 16),uint16_t,
+            typename std::conditional<(M <= 32 && N <= 32),uint32_t,uint64_t>::type>::type LINE;
+    LINE rows[2][M];                                                    // rows[p-1][r]: cells of player p in row r
+    LINE cols[2][N];                                                    // cols[p-1][c]: cells of player p in col c
+    LINE diags[2][M + N - 1];                                           // diags[p-1][r - c + N - 1]: cells (r,c) of player p on a diagonal
+    LINE antis[2][M + N - 1];                                           // antis[p-1][r + c]: cells (r,c) of player p on an anti-diagonal
+    int filled;                                                         // num of filled cells
+    uint8_t status;                                                     // 0 -> not over, 1 -> 'X' won, 2 -> 'O' won, 3 -> draw
+};
+
+// function to check the line x for K set bits in a row. after x &= x >> s with a run of len bits, bit i is set iff
+// bits i to i + len + s - 1 were all set. len doubles each time, so K is reached in about log2(K) steps
+template<int K>
+inline bool hasrun(uint64_t x) {
+    for(int len=1;len<K;) {
+        int s = std::min(len,K - len);
+        x &= x >> s;
+        len += s;
+    }
+    return x != 0;
+}
+
+// function to return true iff (r,c) is unfilled
+template<int M, int N, int K>
+inline bool mnkempty(const MNKBOARD<M,N,K>* b, int r, int c) {
+    return !(((b->rows[0][r] | b->rows[1][r]) >> c) & 1);
+}
+
+// function to return true iff player p would win by placing his symbol at the unfilled cell (r,c). only the four
+// lines through (r,c) are looked at. a line can't hold a run elsewhere, since the game would be over already
+template<int M, int N, int K>
+inline bool mnkwins(const MNKBOARD<M,N,K>* b, int p, int r, int c) {
+    uint64_t rbit = 1ULL << c, cbit = 1ULL << r;
+    return hasrun<K>(b->rows[p-1][r] | rbit) || hasrun<K>(b->cols[p-1][c] | cbit) ||
+           hasrun<K>(b->diags[p-1][r - c + N - 1] | cbit) || hasrun<K>(b->antis[p-1][r + c] | cbit);
+}
+
+// function to make all cells of b unfilled
+template<int M, int N, int K>
+inline void mnkinit(MNKBOARD<M,N,K>* b) {
+    memset(b,0,sizeof *b);
+}
+
+// function to try placing the symbol of player p at (r,c). returns -1 if (r,c) is not on the board and -2 if it is
+// filled. otherwise, the move is made and the status of the board is returned (see MNKBOARD::status)
+template<int M, int N, int K>
+inline int mnkplay(MNKBOARD<M,N,K>* b, int p, int r, int c) {
+    if(r < 0 || r >= M || c < 0 || c >= N)
+        return -1;
+    if(!mnkempty(b,r,c))
+        return -2;
+    bool won = mnkwins(b,p,r,c);
+    b->rows[p-1][r] |= 1ULL << c;
+    b->cols[p-1][c] |= 1ULL << r;
+    b->diags[p-1][r - c + N - 1] |= 1ULL << r;
+    b->antis[p-1][r + c] |= 1ULL << r;
+    ++b->filled;
+    b->status = won ? p : (b->filled == M * N ? 3 : 0);
+    return b->status;
+}
+
+// function to return the player (1 or 2) whose symbol is at (r,c), or 0 if it is unfilled
+template<int M, int N, int K>
+inline int mnkcell(const MNKBOARD<M,N,K>* b, int r, int c) {
+    return ((b->rows[0][r] >> c) & 1) ? 1 : (((b->rows[1][r] >> c) & 1) ? 2 : 0);
+}
+
+// function to write b in human-friendly form ("Game Status:-\n" and then rows like "X | _ | O \n") to out, which
+// must have room for MNKTEXTLEN chars. returns the len of the text
+template<int M, int N, int K>
+inline int mnktext(const MNKBOARD<M,N,K>* b, char* out) {
+    const char sym[3] = {'_','X','O'};
+    int pos = sprintf(out,"Game Status:-\n");
+    for(int r=0;r<M;++r) {
+        for(int c=0;c<N;++c) {
+            out[pos++] = sym[mnkcell(b,r,c)];
+            out[pos++] = ' ';
+            if(c != N - 1) {
+                out[pos++] = '|'; out[pos++] = ' ';
+            }
+        }
+        out[pos++] = '\n';
+    }
+    out[pos] = '\0';
+    return pos;
+}
+
+// function to pick a move for player p on b, which must have an unfilled cell. returns the cell (r * N + c).
+// smart -> a winning move, else a move that blocks a win of the partner, else an unfilled cell next to a filled one
+// (the centre of an unfilled board). otherwise, any unfilled cell. rnd picks among the candidates
+template<int M, int N, int K>
+inline int mnkpick(const MNKBOARD<M,N,K>* b, int p, bool smart, uint32_t rnd) {
+    if(smart) {
+        for(int who : {p,3 - p}) {
+            for(int r=0;r<M;++r) {
+                for(int c=0;c<N;++c) {
+                    if(mnkempty(b,r,c) && mnkwins(b,who,r,c))
+                        return r * N + c;
+                }
+            }
+        }
+        if(b->filled == 0)
+            return (M / 2) * N + N / 2;
+    }
+    // candidates are counted first and the chosen one is found by a second scan, so that nothing is allocated
+    auto candidate = [&](int r, int c) {
+        if(!mnkempty(b,r,c))
+            return false;
+        if(!smart)
+            return true;
+        for(int dr=-1;dr<=1;++dr) {
+            for(int dc=-1;dc<=1;++dc) {
+                int nr = r + dr, nc = c + dc;
+                if(nr >= 0 && nr < M && nc >= 0 && nc < N && !mnkempty(b,nr,nc))
+                    return true;
+            }
+        }
+        return false;
+    };
+    int count = 0;
+    for(int r=0;r<M;++r)
+        for(int c=0;c<N;++c)
+            count += candidate(r,c);
+    if(count == 0)
+        return mnkpick(b,p,false,rnd);
+    int pick = rnd % count;
+    for(int r=0;r<M;++r) {
+        for(int c=0;c<N;++c) {
+            if(candidate(r,c) && pick-- == 0)
+                return r * N + c;
+        }
+    }
+    return -1;
+}
+
+// structure to represent a variant: the size of its board and the functions of MNKBOARD<m,n,k> on a board of
+// that size passed as void*, so that a game can pick its variant at run time
+struct VARIANT {
+    const char* name;                                                   // "m,n,k"
+    int m, n, k;
+    size_t size;                                                        // sizeof(MNKBOARD<m,n,k>)
+    void (*init)(void* b);
+    int (*play)(void* b, int p, int r, int c);
+    int (*cell)(const void* b, int r, int c);
+    int (*text)(const void* b, char* out);
+    int (*pick)(const void* b, int p, bool smart, uint32_t rnd);
+};
+
+// structure to hold the functions of a variant, so that they can be taken as plain function pointers
+template<int M, int N, int K>
+struct MNKOPS {
+    typedef MNKBOARD<M,N,K> BOARD;
+    static void init(void* b) { mnkinit((BOARD*)b); }
+    static int play(void* b, int p, int r, int c) { return mnkplay((BOARD*)b,p,r,c); }
+    static int cell(const void* b, int r, int c) { return mnkcell((const BOARD*)b,r,c); }
+    static int text(const void* b, char* out) { return mnktext((const BOARD*)b,out); }
+    static int pick(const void* b, int p, bool smart, uint32_t rnd) { return mnkpick((const BOARD*)b,p,smart,rnd); }
+};
+
+// function to make the VARIANT of MNKBOARD<M,N,K>
+template<int M, int N, int K>
+constexpr VARIANT makevariant(const char* name) {
+    static_assert(M <= MNKMAXDIM && N <= MNKMAXDIM, "moves of a variant must fit in a byte of the log");
+    typedef MNKOPS<M,N,K> OPS;
+    return {name,M,N,K,sizeof(MNKBOARD<M,N,K>),OPS::init,OPS::play,OPS::cell,OPS::text,OPS::pick};
+}
+
+// variants offered by the server. the index of a variant is its number in T_HELLO and in the logs, so new
+// variants go at the end
+constexpr VARIANT variants[] = {
+    makevariant<3,3,3>("3,3,3"),                                        // classic TicTacToe
+    makevariant<4,4,4>("4,4,4"),
+    makevariant<5,5,4>("5,5,4"),
+    makevariant<7,6,4>("7,6,4"),
+    makevariant<9,9,5>("9,9,5"),
+    makevariant<15,15,5>("15,15,5")                                     // gomoku
+};
+constexpr int NVARIANTS = sizeof variants / sizeof variants[0];
+
+// function to return the number of the variant with the given name ("m,n,k", or "gomoku" for "15,15,5"), or -1
+inline int variantof(const char* name) {
+    if(strcmp(name,"gomoku") == 0)
+        name = "15,15,5";
+    for(int v=0;v<NVARIANTS;++v) {
+        if(strcmp(variants[v].name,name) == 0)
+            return v;
+    }
+    return -1;
+}
+
+// function to return the number of the variant of an m x n board with k in a row, or -1
+inline int variantof(int m, int n, int k) {
+    for(int v=0;v<NVARIANTS;++v) {
+        if(variants[v].m == m && variants[v].n == n && variants[v].k == k)
+            return v;
+    }
+    return -1;
+}
+
+#endif
@@ -0,0 +1,117 @@
+/*
+    protocol.h = Wire protocol shared by the TicTacToe server and its clients
+    Author = Vikram, CS19B021
+    Purpose = Defines the framed (version 2) protocol. Every frame is a FRAMEHDR followed by len bytes of payload.
+              The first byte of a frame is never '@', so it can't be confused with a legacy msg, which is
+              always LEGACYLEN bytes of the form "@i@ data". A client asks for the framed protocol by sending a
+              T_HELLO frame right after connecting. Clients that don't are served with legacy msgs.
+              The payload of T_HELLO is the player name, optionally followed by a NUL and a byte of HELLO_* flags.
+              The flags may be followed by a byte with the number of the board variant the player wants (see
+              mnkboard.h). Players are only matched with players who want the same variant. 0 -> 3x3 board.
+              With HELLO_COMPACT, the board is sent as a T_MOVE frame with just the last move instead of its text,
+              and move prompts have no text. The client keeps the board and renders it itself. With HELLO_WATCH,
+              the client is a spectator of the live game whose id is in the header of T_HELLO. It gets T_PRINT
+              frames with the board and the events of the game (and of its replays) and a T_GAMEOVER at the end.
+              Between moves and games, a client may send a T_QUERY frame. Its payload "top" asks for the
+              leaderboard and an empty payload asks for the client's own record. The answer is a T_PRINT frame,
+              followed by the prompt the client still owes an answer to, if any.
+              With HELLO_MUX (event loop mode only), the connection is a session that plays many games at once. No
+              game is joined by the T_HELLO itself. The client sends a T_JOIN frame for every game it wants, with an
+              id of its choice for it in the header (not 0 and not in use by another of its games) and optionally
+              a variant byte as payload. From then on, every frame of that game in both directions carries the
+              client's id in the header in place of the game id, replays included. T_LEAVE ends the game as a
+              disconnect. A game ends with a T_GAMEOVER frame with its id, after which the id may be used again.
+              Liveness is checked per connection: T_KEEPALIVE and T_ACK frames carry id 0, and a session must ack a
+              T_KEEPALIVE at any time, even while its games wait for moves.
+*/
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+#include <bits/stdc++.h>
+#include <arpa/inet.h>
+#define PROTOVERSION 2                                                  // version of the framed protocol
+#define FRAMEMARK (0xF0 | PROTOVERSION)                                 // first byte of every frame
+#define MAXPAYLOAD 1024                                                 // max len of the payload of a frame
+#define LEGACYLEN 100                                                   // size of a legacy msg
+#define HELLO_COMPACT 1                                                 // flag of T_HELLO: send T_MOVE frames instead of the board text
+#define HELLO_WATCH 2                                                   // flag of T_HELLO: watch the game given by the header's game id
+#define HELLO_MUX 4                                                     // flag of T_HELLO: play many games on this connection (T_JOIN)
+#define QUERYTOP "top"                                                  // payload of T_QUERY that asks for the leaderboard
+
+// texts of the server's T_PRINT msgs about admission. a client that gets BUSYTEXT is turned away (T_GAMEOVER follows).
+// a client that gets ROOMTEXT waits for a free slot. the text is followed by its position in the waiting room
+#define BUSYTEXT "The server is busy. Please try again later."
+#define ROOMTEXT "The server is full. Your position in the waiting room is "
+
+// frame types. types 0-3 are sent by the server and match the codes of the legacy msgs.
+// T_KEEPALIVE -> are you alive?; T_PRINT -> print payload; T_PROMPT -> print payload and send a T_INPUT back;
+// T_GAMEOVER -> close the connection. types 4-6 are sent by clients. T_HELLO -> use the framed protocol;
+// T_ACK -> reply to T_KEEPALIVE; T_INPUT -> a line typed by the player. T_MOVE (server, HELLO_COMPACT clients
+// only) -> a MOVEUPDATE. T_QUERY (client) -> ask for the leaderboard ("top") or the client's own record ("").
+// T_JOIN, T_LEAVE (HELLO_MUX clients only) -> join a new game or leave one, given by the id in the header
+enum FRAMETYPE { T_KEEPALIVE = 0, T_PRINT = 1, T_PROMPT = 2, T_GAMEOVER = 3, T_HELLO = 4, T_ACK = 5, T_INPUT = 6, T_MOVE = 7,
+                 T_QUERY = 8, T_JOIN = 9, T_LEAVE = 10 };
+
+// structure to represent the header of a frame. multi-byte fields are in network byte order
+struct FRAMEHDR {
+    uint8_t mark;                                                       // = FRAMEMARK
+    uint8_t type;                                                       // one of FRAMETYPE
+    uint16_t len;                                                       // num of payload bytes after the header
+    uint32_t gameid;                                                    // id of the game the frame belongs to (the client's id with HELLO_MUX). 0 -> no game
+};
+static_assert(sizeof(FRAMEHDR) == 8, "FRAMEHDR must be packed");
+
+// structure to represent the payload of a T_MOVE frame. it is sent to both players after every move and at the
+// start of every game, in place of the "Game Status" text
+struct MOVEUPDATE {
+    uint8_t p;                                                          // player who moved (1 -> 'X', 2 -> 'O'). 0 -> new game with an unfilled board
+    uint8_t r, c;                                                       // row and col of the move, both from 1 (in {1,2,3} on a 3x3 board)
+    uint8_t status;                                                     // 0 -> not over, 1 -> 'X' won, 2 -> 'O' won, 3 -> draw
+    uint8_t you;                                                        // player number of the recipient (1 or 2)
+};
+static_assert(sizeof(MOVEUPDATE) == 5, "MOVEUPDATE must be packed");
+
+// function to fill hdr for a frame of the given type, game id and payload len
+inline void makehdr(FRAMEHDR* hdr, int type, uint32_t gameid, int len) {
+    hdr->mark = FRAMEMARK;
+    hdr->type = type;
+    hdr->len = htons(len);
+    hdr->gameid = htonl(gameid);
+}
+
+// function to check the n bytes at buf for a complete frame. returns the size of the frame if it is complete,
+// 0 if more bytes are needed and -1 if the bytes can't be a valid frame
+inline int framesize(const char* buf, int n) {
+    if(n < (int)sizeof(FRAMEHDR))
+        return 0;
+    FRAMEHDR hdr;
+    memcpy(&hdr,buf,sizeof hdr);
+    int len = ntohs(hdr.len);
+    if(hdr.mark != FRAMEMARK || len > MAXPAYLOAD)
+        return -1;
+    return (n < (int)sizeof(FRAMEHDR) + len) ? 0 : sizeof(FRAMEHDR) + len;
+}
+
+// function to build the legacy msg with code cd and data dt in buf (LEGACYLEN bytes). the rest of buf is zeroed and
+// dt is cut short if it doesn't fit
+inline void makelegacy(char* buf, int cd, const char* dt) {
+    memset(buf,0,LEGACYLEN);
+    snprintf(buf,LEGACYLEN,"@%d@ %s",cd,dt);
+}
+
+// function to read two integers r and c from the NUL terminated str the way "stringstream >> r >> c" does,
+// but without any allocation. returns false if str doesn't start with two integers
+inline bool parsemove(const char* str, int* r, int* c) {
+    int* dest[2] = {r,c};
+    for(int i=0;i<2;++i) {
+        char* end;
+        errno = 0;
+        long val = strtol(str,&end,10);
+        if(end == str || errno == ERANGE || val < INT_MIN || val > INT_MAX)
+            return false;
+        *dest[i] = val;
+        str = end;
+    }
+    return true;
+}
+
+#endif
@@ -0,0 +1,584 @@
+/*
+    replay.cpp = Replayer of captured client traffic for the TicTacToe server
+    Author = Vikram, CS19B021
+    Compilation CMD = g++ replay.cpp -o replay --std=c++17 -O2
+    Usage = ./replay [SERVER IP ADDRESS] [SERVER PORT NO] [-s SPEED] [-f] [-w GATE WAIT MS] [-l ORIGINAL LOG]
+                     [-L NEW LOG] CAPTURE FILE...
+    Purpose = Drives a server with the traffic its clients once sent to another server, captured with
+              ./gameserver PORT -R FILE (see capture.h). Every captured connection is opened again and the msgs of
+              its client are sent at the times they were recved, -s times faster (real time by default), or as
+              soon as possible with -f. The captures of many files are replayed at once, all starting together.
+              A msg is held back till the server has sent the connection as many prompts as it had when the msg
+              was captured (on a multiplexed connection, as many prompts for the msg's game), so that moves never
+              run ahead of the game even with -f. A msg that is still held back GATE WAIT ms after it is due is
+              sent anyway. The KEEP_ALIVE acks of the capture are left out and the replayer answers the KEEP_ALIVE
+              msgs of the new server itself. Once the msgs of a connection are all sent, it waits for the server
+              to close it. The replay is over when every connection is closed or waits so and the last record of
+              the captures is SETTLEMS (LINGERMS with -f) overdue. Connections still open then were open when the
+              capture ended. They are closed only after the log check, so that the new server doesn't log their
+              games as disconnects either. At the end, the num of msgs, how late they went out and the time from
+              each msg to the server's next msg on its connection are printed. With -l and -L, the games of the
+              log the capturing server wrote are compared to the games of the log of the replayed server,
+              ignoring ids and times. Each game is its moves, its result and its board. Any difference is printed
+              and the exit status is 1.
+    Caveat = Games are replayed as captured only if the players are paired as they were. Pairing depends on when
+             players arrive and when ratings change, so replay in real time against one lobby (-a 1). -f and -s
+             change the order of arrivals and pair some players differently. On a multiplexed connection, the
+             msgs of a game that was paired differently hold up the msgs of all its other games till GATE WAIT.
+             Games that ended by a timeout are replayed by waiting for the server's timeout, even with -f.
+*/
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <bits/stdc++.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include "protocol.h"
+#include "capture.h"
+#define SERVERPORT argv[2]          // server port number
+#define SERVERIPADDR argv[1]        // server ip address
+#define BUFLEN 100                  // size of a legacy msg
+#define RECVBUFLEN 4096             // size of the buffer for recved but unhandled bytes of a connection
+#define MAXEVENTS 256               // max number of events fetched by one epoll_wait() call
+#define GATEWAIT 10000              // default time (in ms) a due msg waits for its prompt before it is sent anyway
+#define SETTLEMS 1000               // time (in ms) the server gets after the last msg of the capture is due to answer it
+#define LINGERMS 20000              // the same with -f. it outlasts the server's move timeout
+#define SPINUS 1000                 // time (in us) before a due msg from which the replayer polls instead of sleeping
+#define USAGE "Usage : ./replay [SERVER IP ADDRESS] [SERVER PORT NO] [-s SPEED] [-f] [-w GATE WAIT MS] [-l ORIGINAL LOG] [-L NEW LOG] CAPTURE FILE...\n"
+using namespace std;
+
+const char ackbuffer[BUFLEN] = "I_AM_ALIVE";
+
+// structure to represent a msg of a captured client, or the close of its connection
+struct RMSG {
+    long long us;                                                       // time (in us since its capture started) the server recved it
+    uint32_t prompts;                                                   // num of prompts the client had got by then (for the msg's game with HELLO_MUX)
+    uint32_t tag;                                                       // (HELLO_MUX only) the client's id for the game of the msg
+    string data;                                                        // bytes of the msg. a close has none
+    bool close;                                                         // true iff the client closed the connection here
+};
+
+// structure to represent a replayed connection
+struct RCONN {
+    int fd;                                                             // connection fd. -1 -> not connected (yet or anymore)
+    bool connected;                                                     // true iff the non-blocking connect() has completed
+    bool done;                                                          // true iff the connection is over
+    bool idle;                                                          // true iff all msgs have been sent and the connection is open
+    bool framed;                                                        // true iff the client speaks the framed protocol
+    bool muxed;                                                         // true iff the client plays many games on the connection (HELLO_MUX)
+    long long openus;                                                   // time (in us since its capture started) the connection was accepted
+    vector<RMSG> msgs;                                                  // msgs to send in order
+    size_t next;                                                        // index of the next msg to send
+    uint32_t prompts;                                                   // num of prompts recved from the server
+    unordered_map<uint32_t,uint32_t> tagprompts;                        // (HELLO_MUX only) num of prompts recved by the client's id for the game
+    char inbuf[RECVBUFLEN];                                             // recved but unhandled bytes
+    int inlen;                                                          // num of bytes in inbuf
+    string outbuf;                                                      // pending bytes to send
+    bool outwatched;                                                    // true iff EPOLLOUT is asked for
+    long long sentus;                                                   // time (in us) the last msg was sent. 0 -> no reply pending
+    long long wakeus;                                                   // time (in us) the next msg (or the connect) is due. 0 -> none
+};
+
+// structure to represent the counters and latency samples (in us) of the whole run
+struct STATS {
+    uint64_t connects, connfails, msgs, forced, cut, errors, keepalives, prompts;
+    vector<uint32_t> replylat, latelat;
+};
+
+int epfd;                                                               // epoll fd
+typedef pair<long long,RCONN*> WAKEUP;
+priority_queue<WAKEUP,vector<WAKEUP>,greater<WAKEUP>> timers;           // wake up times of the connections, earliest first. an entry
+                                                                        // whose time isn't the wakeus of its connection is stale
+sockaddr_in servaddr;                                                   // internet address of server
+STATS stats;
+double speed = 1;                                                       // replay speed. 0 -> as fast as possible
+int gatewait = GATEWAIT;
+long long startus;                                                      // time (in us) the replay started
+long long baseus;                                                       // capture time (in us) of the first connection. it is due at startus
+int live = 0;                                                           // num of connections that aren't over
+int idle = 0;                                                           // num of live connections that have sent all their msgs
+long long endus = 0;                                                    // time (in us since its capture started) of the last record
+
+// function to get the current time in us from a monotonic clock
+long long nowus() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// function to return the time (in us) at which something captured at us is due in the replay
+long long dueus(long long us) {
+    return speed == 0 ? startus : startus + (long long)((us - baseus) / speed);
+}
+
+// function to cut the bytes a client sent on one connection into msgs. a frame or a BUFLEN byte legacy msg is a msg.
+// a msg gets the time and prompts of the record that completed it. acks of KEEP_ALIVE msgs are left out.
+// a multiplexed connection is known by the flags of its T_HELLO, and its msgs are gated by the prompts of their games
+void splitmsgs(RCONN* rc, const vector<const CAPEVENT*>& evs) {
+    string pending;
+    bool known = false;
+    for(const CAPEVENT* ev : evs) {
+        if(ev->kind == CK_OPEN) {
+            rc->openus = ev->us;
+            continue;
+        }
+        if(ev->kind == CK_CLOSE) {
+            if(!pending.empty())
+                rc->msgs.push_back({ev->us,ev->prompts,0,pending,false});       // bytes of a msg the client never finished
+            rc->msgs.push_back({ev->us,ev->prompts,0,"",true});
+            return;
+        }
+        pending += ev->data;
+        if(!known && !pending.empty()) {
+            rc->framed = (unsigned char)pending[0] == FRAMEMARK;
+            known = true;
+        }
+        while(1) {
+            int size;
+            if(rc->framed)
+                size = framesize(pending.data(),pending.size());
+            else
+                size = (pending.size() < BUFLEN) ? 0 : BUFLEN;
+            if(size == 0)
+                break;
+            if(size < 0)
+                size = pending.size();                                      // a broken frame goes out as it came
+            FRAMEHDR hdr = {};
+            if(rc->framed && size >= (int)sizeof hdr)
+                memcpy(&hdr,pending.data(),sizeof hdr);
+            if(hdr.type == T_HELLO && rc->msgs.empty()) {
+                size_t nul = pending.find('\0',sizeof hdr);
+                rc->muxed = nul + 1 < (size_t)size && (pending[nul + 1] & HELLO_MUX);
+            }
+            bool ack = rc->framed ? hdr.type == T_ACK : strncmp(pending.data(),ackbuffer,BUFLEN) == 0;
+            if(!ack)
+                rc->msgs.push_back({ev->us,ev->prompts,ntohl(hdr.gameid),pending.substr(0,size),false});
+            pending.erase(0,size);
+        }
+    }
+    if(!pending.empty())
+        rc->msgs.push_back({evs.back()->us,evs.back()->prompts,0,pending,false});
+}
+
+// function to (re)register the fd of rc with epoll. EPOLLOUT is asked for while connecting or while outbuf isn't empty
+void watchconn(RCONN* rc, int op) {
+    epoll_event ev;
+    rc->outwatched = !rc->connected || !rc->outbuf.empty();
+    ev.events = EPOLLIN | EPOLLRDHUP | (rc->outwatched ? (uint32_t)EPOLLOUT : 0);
+    ev.data.ptr = rc;
+    epoll_ctl(epfd,op,rc->fd,&ev);
+}
+
+// function to end the connection rc. the msgs it didn't get to send are counted as cut
+void endconn(RCONN* rc) {
+    if(rc->done)
+        return;
+    rc->wakeus = 0;
+    if(rc->fd != -1)
+        close(rc->fd);
+    rc->fd = -1;
+    rc->done = true;
+    for(size_t i=rc->next;i<rc->msgs.size();++i)
+        stats.cut += !rc->msgs[i].close;
+    --live;
+    idle -= rc->idle;
+}
+
+// function to make rc wake up at the time us (in us)
+void wakeat(RCONN* rc, long long us) {
+    rc->wakeus = max(1LL,us);
+    timers.push({rc->wakeus,rc});
+}
+
+// function to send as much of rc->outbuf as the socket accepts now. returns false iff the send failed
+bool flushconn(RCONN* rc) {
+    size_t sent = 0;
+    while(sent < rc->outbuf.size()) {
+        int ret = send(rc->fd,rc->outbuf.data() + sent,rc->outbuf.size() - sent,MSG_NOSIGNAL|MSG_DONTWAIT);
+        if(ret < 0) {
+            if(errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+            if(errno == EINTR)
+                continue;
+            return false;
+        }
+        sent += ret;
+    }
+    rc->outbuf.erase(0,sent);
+    if(rc->outbuf.empty() == rc->outwatched)
+        watchconn(rc,EPOLL_CTL_MOD);
+    return true;
+}
+
+// function to queue the len bytes of data to rc and send what the socket takes. returns false iff the send failed
+bool sendbytes(RCONN* rc, const char* data, size_t len) {
+    bool wasempty = rc->outbuf.empty();
+    rc->outbuf.append(data,len);
+    return !wasempty || flushconn(rc);
+}
+
+// function to send the msgs of rc that are due and have been asked for. a due msg that hasn't been asked for
+// gatewait ms after it is due is sent anyway. rc is set to wake up for its next msg
+void sendmsgs(RCONN* rc) {
+    long long now = nowus();
+    while(!rc->done && rc->connected && rc->next < rc->msgs.size()) {
+        const RMSG* m = &rc->msgs[rc->next];
+        long long due = dueus(m->us);
+        if(now < due) {
+            wakeat(rc,due);
+            return;
+        }
+        if((rc->muxed ? rc->tagprompts[m->tag] : rc->prompts) < m->prompts) {
+            if(now < due + gatewait * 1000LL) {
+                wakeat(rc,due + gatewait * 1000LL);
+                return;
+            }
+            ++stats.forced;
+        }
+        stats.latelat.push_back(now - due);
+        ++rc->next;
+        if(m->close) {
+            endconn(rc);
+            return;
+        }
+        ++stats.msgs;
+        rc->sentus = now;
+        if(!sendbytes(rc,m->data.data(),m->data.size())) {
+            ++stats.errors;
+            endconn(rc);
+            return;
+        }
+    }
+    // all sent. the connection waits for the server to close it
+    if(!rc->done && rc->connected && !rc->idle) {
+        rc->idle = true;
+        ++idle;
+    }
+}
+
+// function to connect rc to the server
+void connectconn(RCONN* rc) {
+    ++stats.connects;
+    ++live;
+    if((rc->fd = socket(AF_INET,SOCK_STREAM|SOCK_NONBLOCK,0)) == -1) {
+        perror("ERROR: socket creation failed"); exit(-1);
+    }
+    // the msgs are small and many games may share a connection. without TCP_NODELAY, Nagle's algorithm and the
+    // server's delayed ACKs would hold them back and be measured as server latency
+    int yes = 1;
+    setsockopt(rc->fd,IPPROTO_TCP,TCP_NODELAY,&yes,sizeof yes);
+    if(connect(rc->fd,(sockaddr*)&servaddr,sizeof servaddr) == -1 && errno != EINPROGRESS) {
+        ++stats.connfails;
+        endconn(rc);
+        return;
+    }
+    watchconn(rc,EPOLL_CTL_ADD);
+}
+
+// function to wake up rc. it connects rc or sends its due msgs
+void ontimer(RCONN* rc) {
+    if(rc->fd == -1)
+        connectconn(rc);
+    else
+        sendmsgs(rc);
+}
+
+// function to handle a msg of the given type (a legacy code is a type too) for the game tag from the server on rc.
+// returns false iff the ack of a KEEP_ALIVE msg couldn't be sent
+bool onservermsg(RCONN* rc, int type, uint32_t tag) {
+    long long now = nowus();
+    if(type == T_KEEPALIVE) {
+        ++stats.keepalives;
+        if(rc->framed) {
+            FRAMEHDR hdr;
+            makehdr(&hdr,T_ACK,0,0);
+            return sendbytes(rc,(const char*)&hdr,sizeof hdr);
+        }
+        return sendbytes(rc,ackbuffer,BUFLEN);
+    }
+    if(rc->sentus != 0) {
+        stats.replylat.push_back(now - rc->sentus);
+        rc->sentus = 0;
+    }
+    if(type == T_PROMPT) {
+        ++rc->prompts;
+        if(rc->muxed)
+            ++rc->tagprompts[tag];
+        ++stats.prompts;
+        sendmsgs(rc);
+    }
+    return true;
+}
+
+// function to read all the data available from rc and handle every whole msg in it
+void readconn(RCONN* rc) {
+    while(!rc->done) {
+        int ret = recv(rc->fd,rc->inbuf + rc->inlen,RECVBUFLEN - rc->inlen,MSG_DONTWAIT);
+        if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if(ret < 0 && errno == EINTR)
+            continue;
+        if(ret <= 0) {
+            endconn(rc);
+            return;
+        }
+        rc->inlen += ret;
+        int size;
+        while(!rc->done) {
+            int type;
+            uint32_t tag = 0;
+            if(rc->framed) {
+                if((size = framesize(rc->inbuf,rc->inlen)) <= 0)
+                    break;
+                FRAMEHDR hdr;
+                memcpy(&hdr,rc->inbuf,sizeof hdr);
+                type = hdr.type;
+                tag = ntohl(hdr.gameid);
+            }
+            else {
+                if((size = (rc->inlen < BUFLEN) ? 0 : BUFLEN) == 0)
+                    break;
+                type = rc->inbuf[1] - '0';
+            }
+            rc->inlen -= size;
+            memmove(rc->inbuf,rc->inbuf + size,rc->inlen);
+            if(!onservermsg(rc,type,tag)) {
+                ++stats.errors;
+                endconn(rc);
+                return;
+            }
+        }
+        if(size < 0) {
+            ++stats.errors;
+            endconn(rc);
+            return;
+        }
+    }
+}
+
+// function to read the games of the log at path into games. a game is the lines of its entry without ids and times
+bool loadgames(const char* path, vector<string>& games) {
+    ifstream f(path);
+    if(!f)
+        return false;
+    string line, game;
+    bool in = false;
+    while(getline(f,line)) {
+        if(line == "[NEW ENTRY]") {
+            if(in)
+                games.push_back(game);
+            game.clear();
+            in = true;
+        }
+        else if(in && (line.rfind("Moves Made",0) == 0 || line.rfind("Result",0) == 0 || line.rfind("Board",0) == 0)) {
+            game += line + "\n";
+        }
+    }
+    if(in)
+        games.push_back(game);
+    return true;
+}
+
+// function to compare the games of the logs at orig and at now as multisets. returns true iff they are the same
+bool comparelogs(const char* orig, const char* now) {
+    vector<string> a, b;
+    if(!loadgames(orig,a) || !loadgames(now,b)) {
+        printf("ERROR: the logs %s and %s can't be read\n",orig,now);
+        return false;
+    }
+    map<string,int> diff;
+    for(const string& g : a)
+        ++diff[g];
+    for(const string& g : b)
+        --diff[g];
+    int missing = 0, extra = 0, shown = 0;
+    for(auto& [g,n] : diff) {
+        if(n == 0)
+            continue;
+        (n > 0 ? missing : extra) += abs(n);
+        if(shown++ < 3)
+            printf("%s %d time(s) more in the %s log:\n%s",n > 0 ? "-" : "+",abs(n),n > 0 ? "original" : "new",g.c_str());
+    }
+    printf("log check: %zu games in the original log, %zu in the new one, %zu alike, %d missing, %d extra -> %s\n",
+           a.size(),b.size(),a.size() - missing,missing,extra,(missing == 0 && extra == 0) ? "MATCH" : "MISMATCH");
+    return missing == 0 && extra == 0;
+}
+
+// function to return the num of games in the log at path
+size_t countgames(const char* path) {
+    vector<string> games;
+    loadgames(path,games);
+    return games.size();
+}
+
+// function to print the num of samples and the percentiles (in ms) of the latency samples lat
+void printlat(const char* name, vector<uint32_t>& lat) {
+    if(lat.empty()) {
+        printf("%-22s n = 0\n",name);
+        return;
+    }
+    sort(lat.begin(),lat.end());
+    auto pct = [&](double p) { return lat[min(lat.size() - 1,(size_t)(p * lat.size()))] / 1000.0; };
+    printf("%-22s n = %-9zu p50 = %8.3f  p90 = %8.3f  p99 = %8.3f  p99.9 = %8.3f  max = %8.3f ms\n",
+           name,lat.size(),pct(0.5),pct(0.9),pct(0.99),pct(0.999),lat.back() / 1000.0);
+}
+
+int main(int argc, char** argv) {
+
+    if(argc < 3) {
+        cout << USAGE;
+        exit(-1);
+    }
+
+    // parse the options given after the server address. the rest are capture files
+    const char* origlog = NULL;
+    const char* newlog = NULL;
+    int opt;
+    while((opt = getopt(argc - 2,argv + 2,"s:fw:l:L:")) != -1) {
+        if(opt == 's')
+            speed = max(0.001,atof(optarg));
+        else if(opt == 'f')
+            speed = 0;
+        else if(opt == 'w')
+            gatewait = max(0,atoi(optarg));
+        else if(opt == 'l')
+            origlog = optarg;
+        else if(opt == 'L')
+            newlog = optarg;
+        else {
+            cout << USAGE;
+            exit(-1);
+        }
+    }
+    if((origlog == NULL) != (newlog == NULL)) {
+        cout << "-l and -L go together" << endl;
+        exit(-1);
+    }
+
+    memset(&servaddr,0,sizeof servaddr);
+    servaddr.sin_family = AF_INET;
+    servaddr.sin_port = htons((short)atoi(SERVERPORT));
+    if(inet_pton(AF_INET,SERVERIPADDR,&servaddr.sin_addr) != 1) {
+        cout << "Bad Server IP Address" << endl;
+        exit(-1);
+    }
+
+    // load the captures. the records of every connection are cut into its msgs
+    vector<RCONN> conns;
+    for(int i=optind + 2;i<argc;++i) {
+        vector<CAPEVENT> events;
+        if(!capload(argv[i],events)) {
+            printf("ERROR: %s isn't a capture file\n",argv[i]);
+            exit(-1);
+        }
+        map<uint32_t,vector<const CAPEVENT*>> byconn;
+        for(const CAPEVENT& ev : events)
+            byconn[ev.conn].push_back(&ev);
+        if(!events.empty())
+            endus = max(endus,events.back().us);
+        for(auto& [id,evs] : byconn) {
+            conns.emplace_back();
+            RCONN& rc = conns.back();
+            rc.fd = -1;
+            rc.openus = evs.front()->us;
+            splitmsgs(&rc,evs);
+        }
+    }
+    size_t nmsgs = 0;
+    for(const RCONN& rc : conns)
+        nmsgs += rc.msgs.size();
+    if(speed == 0)
+        printf("replaying %zu connections with %zu msgs at full speed\n",conns.size(),nmsgs);
+    else
+        printf("replaying %zu connections with %zu msgs at %gx speed\n",conns.size(),nmsgs,speed);
+
+    // every connection needs a fd. so, raise the limit on open fds as far as allowed
+    rlimit lim;
+    if(getrlimit(RLIMIT_NOFILE,&lim) == 0) {
+        lim.rlim_cur = lim.rlim_max;
+        setrlimit(RLIMIT_NOFILE,&lim);
+    }
+    if((epfd = epoll_create1(0)) == -1) {
+        perror("ERROR - epoll_create1 failed"); exit(-1);
+    }
+    startus = nowus();
+    // connections are opened in the order they were accepted
+    sort(conns.begin(),conns.end(),[](const RCONN& a, const RCONN& b) { return a.openus < b.openus; });
+    baseus = conns.empty() ? 0 : conns.front().openus;
+    for(RCONN& rc : conns) {
+        wakeat(&rc,dueus(rc.openus));
+    }
+    size_t pending = conns.size();                      // num of connections not opened yet
+    long long overus = dueus(endus) + (speed == 0 ? LINGERMS : SETTLEMS) * 1000LL;
+    epoll_event evs[MAXEVENTS];
+    while(pending > 0 || live > idle || nowus() < overus) {
+        // sleep till the next connection is due, but poll during its last SPINUS us, so that it goes out on time
+        while(!timers.empty() && timers.top().first != timers.top().second->wakeus)
+            timers.pop();
+        long long wakeus = timers.empty() ? overus : min(overus,timers.top().first);
+        int tmout = (int)max(0LL,(wakeus - nowus() - SPINUS) / 1000);
+        int n = epoll_wait(epfd,evs,MAXEVENTS,tmout);
+        for(int i=0;i<n;++i) {
+            RCONN* rc = (RCONN*)evs[i].data.ptr;
+            if(rc->done)
+                continue;
+            if(!rc->connected && (evs[i].events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+                int err = 0;
+                socklen_t errlen = sizeof err;
+                getsockopt(rc->fd,SOL_SOCKET,SO_ERROR,&err,&errlen);
+                if(err != 0) {
+                    ++stats.connfails;
+                    endconn(rc);
+                    continue;
+                }
+                rc->connected = true;
+                watchconn(rc,EPOLL_CTL_MOD);
+                sendmsgs(rc);
+                continue;
+            }
+            if((evs[i].events & EPOLLOUT) && !flushconn(rc)) {
+                ++stats.errors;
+                endconn(rc);
+                continue;
+            }
+            if(evs[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP))
+                readconn(rc);
+        }
+        long long now = nowus();
+        while(!timers.empty() && timers.top().first <= now) {
+            auto [us,rc] = timers.top();
+            timers.pop();
+            if(us != rc->wakeus)
+                continue;
+            rc->wakeus = 0;
+            if(rc->fd == -1 && !rc->done)
+                --pending;
+            ontimer(rc);
+        }
+    }
+
+    double secs = (nowus() - startus) / 1e6;
+    printf("connections = %lu (failed %lu), duration = %.2f s, msgs = %lu (%.1f/s), prompts = %lu, keepalives = %lu\n",
+           (unsigned long)stats.connects,(unsigned long)stats.connfails,secs,(unsigned long)stats.msgs,stats.msgs / secs,
+           (unsigned long)stats.prompts,(unsigned long)stats.keepalives);
+    printf("sent before asked for = %lu, cut by the server = %lu, left open = %d, errors = %lu\n",
+           (unsigned long)stats.forced,(unsigned long)stats.cut,idle,(unsigned long)stats.errors);
+    printlat("msg-late-by",stats.latelat);
+    printlat("msg-to-reply",stats.replylat);
+    if(origlog == NULL)
+        return 0;
+    // the server writes its log in batches. wait till the num of games in it stops changing
+    size_t seen = countgames(newlog);
+    for(int stable=0;stable<4;) {
+        this_thread::sleep_for(chrono::milliseconds(250));
+        size_t now = countgames(newlog);
+        stable = (now == seen) ? stable + 1 : 0;
+        seen = now;
+    }
+    bool match = comparelogs(origlog,newlog);
+    for(RCONN& rc : conns)
+        if(!rc.done)
+            endconn(&rc);
+    return match ? 0 : 1;
+}
@@ -0,0 +1,519 @@
+/*
+    serverbench.cpp = Microbenchmarks of the hot functions of the TicTacToe server
+    Author = Vikram, CS19B021
+    Compilation CMD = g++ serverbench.cpp -o serverbench --std=c++17 -O2 -pthread
+    Usage = ./serverbench [-o JSON FILE] [-b BASELINE JSON FILE] [-r MAX SLOWDOWN %] [-t MAX LOG THREADS] [-s SAMPLES]
+                          [-f NAME FILTER] [-l SCRATCH LOG FILE]
+    Purpose = Times the functions a game runs on every move, without a network: makemove() on the moves clients
+              send (invalid ones included), the evaluation of every reachable 3x3 board (the status lookup, every
+              move from it and the bot's pick), gamestring() for every board variant, parsemove() (and the
+              stringstream parsing it replaced), the encoding of legacy msgs (makelegacy()), frames and T_MOVE
+              updates as codesend() does it, the same sent with one sendmsg() to a socketpair like sendiov(), and
+              the game logger (packlog() and logpush() of gamelog.h, as logger() calls them) with 1, 2, 4, ... up
+              to t threads pushing at once. The functions timed are the server's own, from its headers. For every benchmark, a timed call does a batch of ops and is one sample. The mean
+              ns/op, the p50/p90/p99 ns/op of the samples and the heap allocations per op (counted by a global
+              operator new) are written as JSON, one result per line, to stdout or the -o file. With -b, the p50
+              of every result is compared to the p50 of the result of the same name in an earlier JSON output.
+              A result more than r% (default 10) slower is marked as a regression and the exit status is 1.
+              serverbench-baseline.json is such an output, made with ./serverbench -o serverbench-baseline.json on a
+              1 core Intel Xeon VM, whose speed varied by up to 2x between runs with the load of its host. Compare
+              against a baseline made on the same quiet machine, just before the change.
+              The logger results per thread count are the cost of a push ("logpush/threads=N") and the cost of
+              a record from its push till the writer thread has written it ("logwrite/threads=N"). Each round
+              pushes fewer records than the queue holds, so nothing is dropped.
+*/
+#include <bits/stdc++.h>
+#include <sys/socket.h>
+#include "boardtable.h"
+#include "mnkboard.h"
+#include "protocol.h"
+#include "gamelog.h"
+#define SAMPLES 200                                                     // default num of timed calls per benchmark
+#define MAXSLOWDOWN 10                                                  // default % by which a p50 may exceed its baseline
+#define LOGTHREADS 64                                                   // default max num of threads pushing log records
+#define LOGROUND 60000                                                  // num of records pushed in a logger round. less than LOGQUEUELEN
+#define LOGBATCHOPS 16                                                  // num of pushes per sample of a logger thread
+#define LOGFLUSHMS 10                                                   // max time (in ms) a record waits in a batch, as in the server
+#define MOVEPROMPT "Enter (ROW, COL) for placing your mark: "           // text of a move prompt, as in the server
+#define USAGE "Usage: ./serverbench [-o JSON FILE] [-b BASELINE JSON FILE] [-r MAX SLOWDOWN %] [-t MAX LOG THREADS] [-s SAMPLES] [-f NAME FILTER] [-l SCRATCH LOG FILE]"
+using namespace std;
+
+atomic<uint64_t> allocs(0);                                             // num of calls of operator new so far
+
+// the global operator new and delete count allocations. they are kept out of line, so that the compiler doesn't
+// mix them up with the ones they replace
+__attribute__((noinline)) void* operator new(size_t n) {
+    allocs.fetch_add(1,memory_order_relaxed);
+    void* p = malloc(n == 0 ? 1 : n);
+    if(p == NULL)
+        throw bad_alloc();
+    return p;
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+    free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept {
+    free(p);
+}
+
+// structure to represent the result of a benchmark
+struct RESULT {
+    string name;
+    uint64_t ops;                                                       // num of timed ops
+    double nsop;                                                        // mean ns/op
+    double allocsop;                                                    // heap allocations per op
+    double p50, p90, p99;                                               // percentiles of the ns/op of the samples
+    double base;                                                        // p50 of the baseline. 0 -> no baseline
+    bool regressed;                                                     // true iff p50 exceeds base by more than the allowed %
+};
+
+vector<RESULT> results;
+int samples = SAMPLES;
+const char* filter = "";                                                // only benchmarks whose names contain it are run
+volatile long long sink;                                                // results of timed ops go here, so they can't be left out
+
+// function to get the current time in ns from a monotonic clock
+long long nowns() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// function to add a result made from the ns/op of its samples (sorted here), its num of ops and allocations
+void addresult(const string& name, vector<double>& persample, uint64_t ops, long long ns, uint64_t nallocs) {
+    sort(persample.begin(),persample.end());
+    auto pct = [&](double q) { return persample[min(persample.size() - 1,(size_t)(q * persample.size()))]; };
+    results.push_back({name,ops,(double)ns / ops,(double)nallocs / ops,pct(0.5),pct(0.9),pct(0.99),0,false});
+    fprintf(stderr,"%-32s %10.2f ns/op  p50 %10.2f  p99 %10.2f  %6.3f allocs/op\n",name.c_str(),results.back().nsop,
+            results.back().p50,results.back().p99,results.back().allocsop);
+}
+
+// function to run the benchmark name: after a warm-up call, fn is called samples times and each call does batch ops.
+// between is called before every call of fn, outside of the timed part
+template<typename F, typename G>
+void runbench(const string& name, int batch, F fn, G between) {
+    if(name.find(filter) == string::npos)
+        return;
+    between();
+    fn();
+    vector<double> persample;
+    long long total = 0;
+    uint64_t nallocs = 0;
+    for(int i=0;i<samples;++i) {
+        between();
+        uint64_t a = allocs.load(memory_order_relaxed);
+        long long start = nowns();
+        fn();
+        long long ns = nowns() - start;
+        nallocs += allocs.load(memory_order_relaxed) - a;
+        total += ns;
+        persample.push_back((double)ns / batch);
+    }
+    addresult(name,persample,(uint64_t)samples * batch,total,nallocs);
+}
+
+template<typename F>
+void runbench(const string& name, int batch, F fn) {
+    runbench(name,batch,fn,[]{});
+}
+
+// structure to represent a move as it reaches makemove(): the board before it and the player and cell asked for
+struct MOVEIN {
+    uint16_t board;
+    int p, r, c;
+};
+
+// function to play random games till n moves are collected. like the moves of loadgen -i, some of them are off the
+// board (1 in 20) or on a filled cell
+vector<MOVEIN> randommoves(int n, mt19937& rng) {
+    vector<MOVEIN> moves;
+    while((int)moves.size() < n) {
+        uint16_t board = 0;
+        int p = 1;
+        while(boardtable.info[board].status == 0 && (int)moves.size() < n) {
+            int r = rng() % 3, c = rng() % 3;
+            if(rng() % 20 == 0)
+                r = 3 + rng() % 2;
+            moves.push_back({board,p,r,c});
+            uint16_t b = board;
+            if(makemove(&b,p,r,c) >= 0) {
+                board = b;
+                p = 3 - p;
+            }
+        }
+    }
+    return moves;
+}
+
+// function to collect every 3x3 board that can come up in a game
+vector<uint16_t> reachableboards() {
+    vector<uint16_t> boards;
+    vector<bool> seen(NBOARDS);
+    vector<uint16_t> stack = {0};
+    seen[0] = true;
+    while(!stack.empty()) {
+        uint16_t b = stack.back();
+        stack.pop_back();
+        boards.push_back(b);
+        const BOARDINFO& info = boardtable.info[b];
+        if(info.status != 0)
+            continue;
+        for(int k=0;k<9;++k) {
+            uint16_t next = b + info.turn * pow3[k];
+            if(((info.unfilled >> k) & 1) && !seen[next]) {
+                seen[next] = true;
+                stack.push_back(next);
+            }
+        }
+    }
+    sort(boards.begin(),boards.end());
+    return boards;
+}
+
+// function to send the iovcnt buffers of iov to fd with one sendmsg(), as sendiov() does
+int sendvec(int fd, iovec* iov, int iovcnt) {
+    msghdr mh;
+    memset(&mh,0,sizeof mh);
+    mh.msg_iov = iov; mh.msg_iovlen = iovcnt;
+    return sendmsg(fd,&mh,MSG_NOSIGNAL|MSG_DONTWAIT);
+}
+
+// function to read everything that has been sent to the other end fd of a socketpair
+void drain(int fd) {
+    char buf[65536];
+    while(recv(fd,buf,sizeof buf,MSG_DONTWAIT) > 0);
+}
+
+// structure to represent a move of a logged game. it has the fields of GMOVE that logger() packs
+struct LOGMOVE {
+    int r, c;
+};
+
+// function to run logger rounds for every num of threads from 1 to maxthreads (doubling). in a round, the threads
+// push LOGROUND records between them as fast as they can. every batch of LOGBATCHOPS pushes of a thread is a sample.
+// the writer thread is started on the first round and writes to logpath. returns true iff it was started
+bool benchlogger(int maxthreads, const char* logpath) {
+    bool started = false;
+    vector<LOGMOVE> moves = {{1,1},{2,2},{1,2},{3,3},{1,3}};
+    for(int nthreads=1;nthreads<=maxthreads;nthreads*=2) {
+        string push = "logpush/threads=" + to_string(nthreads), write = "logwrite/threads=" + to_string(nthreads);
+        if(push.find(filter) == string::npos && write.find(filter) == string::npos)
+            continue;
+        if(!started) {
+            loginit(logpath,LOGFLUSHMS,false);
+            started = true;
+        }
+        int per = LOGROUND / nthreads / LOGBATCHOPS * LOGBATCHOPS;
+        vector<vector<double>> persample(nthreads);
+        vector<double> all, round;
+        long long pushns = 0, writens = 0;
+        uint64_t nallocs = 0;
+        size_t drops = gamelog.drops.load();
+        int rounds = max(1,samples / 20);
+        for(auto& v : persample)
+            v.reserve(rounds * per / LOGBATCHOPS);
+        for(int s=0;s<rounds;++s) {
+            atomic<int> ready(0);
+            atomic<bool> go(false);
+            vector<thread> threads;
+            vector<long long> busy(nthreads);
+            for(int t=0;t<nthreads;++t) {
+                threads.emplace_back([&,t] {
+                    LOGREC rec;
+                    ++ready;
+                    while(!go.load());
+                    for(int i=0;i<per;i+=LOGBATCHOPS) {
+                        long long start = nowns();
+                        for(int j=0;j<LOGBATCHOPS;++j) {
+                            uint32_t gameid = t * per + i + j;
+                            packlog(&rec,gameid,2 * gameid,2 * gameid + 1,1600000000 + gameid,1600000030 + gameid,1,1,0,moves);
+                            logpush(&rec);
+                        }
+                        long long ns = nowns() - start;
+                        busy[t] += ns;
+                        persample[t].push_back((double)ns / LOGBATCHOPS);
+                    }
+                });
+            }
+            while(ready.load() < nthreads);
+            uint64_t a = allocs.load();
+            long long start = nowns();
+            go = true;
+            for(thread& th : threads)
+                th.join();
+            nallocs += allocs.load() - a;
+            for(long long ns : busy)
+                pushns += ns;
+            logdrain();
+            long long ns = nowns() - start;
+            writens += ns;
+            round.push_back((double)ns / (per * nthreads));
+        }
+        for(auto& v : persample)
+            all.insert(all.end(),v.begin(),v.end());
+        uint64_t ops = (uint64_t)all.size() * LOGBATCHOPS;
+        if(push.find(filter) != string::npos)
+            addresult(push,all,ops,pushns,nallocs);
+        if(write.find(filter) != string::npos)
+            addresult(write,round,ops,writens,0);
+        if(gamelog.drops.load() != drops)
+            fprintf(stderr,"WARNING - %zu log records were dropped\n",(size_t)(gamelog.drops.load() - drops));
+    }
+    if(started)
+        unlink(logpath);
+    return started;
+}
+
+// function to read the p50 of every result of the JSON output of an earlier run at path into base
+bool loadbaseline(const char* path, map<string,double>& base) {
+    ifstream in(path);
+    if(!in)
+        return false;
+    string line;
+    while(getline(in,line)) {
+        size_t n = line.find("\"name\": \""), p = line.find("\"p50\": ");
+        if(n == string::npos || p == string::npos)
+            continue;
+        n += 9;
+        base[line.substr(n,line.find('"',n) - n)] = atof(line.c_str() + p + 7);
+    }
+    return true;
+}
+
+// function to write the results as JSON to out, one result per line
+void writejson(FILE* out) {
+    fprintf(out,"{\n  \"samples\": %d,\n  \"results\": [\n",samples);
+    for(size_t i=0;i<results.size();++i) {
+        const RESULT& r = results[i];
+        fprintf(out,"    {\"name\": \"%s\", \"ops\": %lu, \"ns_per_op\": %.3f, \"allocs_per_op\": %.4f, "
+                "\"p50\": %.3f, \"p90\": %.3f, \"p99\": %.3f",r.name.c_str(),(unsigned long)r.ops,r.nsop,r.allocsop,
+                r.p50,r.p90,r.p99);
+        if(r.base > 0)
+            fprintf(out,", \"baseline_p50\": %.3f, \"regressed\": %s",r.base,r.regressed ? "true" : "false");
+        fprintf(out,"}%s\n",i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out,"  ]\n}\n");
+}
+
+int main(int argc, char** argv) {
+    const char* outpath = NULL;
+    const char* basepath = NULL;
+    const char* logpath = "serverbench.log";
+    double maxslowdown = MAXSLOWDOWN;
+    int maxthreads = LOGTHREADS;
+    int opt;
+    while((opt = getopt(argc,argv,"o:b:r:t:s:f:l:")) != -1) {
+        if(opt == 'o')
+            outpath = optarg;
+        else if(opt == 'b')
+            basepath = optarg;
+        else if(opt == 'r')
+            maxslowdown = atof(optarg);
+        else if(opt == 't')
+            maxthreads = max(1,atoi(optarg));
+        else if(opt == 's')
+            samples = max(20,atoi(optarg));
+        else if(opt == 'f')
+            filter = optarg;
+        else if(opt == 'l')
+            logpath = optarg;
+        else {
+            cout << USAGE << endl;
+            exit(-1);
+        }
+    }
+    map<string,double> base;
+    if(basepath != NULL && !loadbaseline(basepath,base)) {
+        printf("ERROR - can't read the baseline %s\n",basepath);
+        exit(-1);
+    }
+    mt19937 rng(1);
+
+    // makemove() on the moves of random games
+    vector<MOVEIN> moves = randommoves(4096,rng);
+    runbench("makemove",moves.size(),[&] {
+        long long s = 0;
+        for(const MOVEIN& m : moves) {
+            uint16_t b = m.board;
+            s += makemove(&b,m.p,m.r,m.c);
+        }
+        sink = s;
+    });
+
+    // every reachable board: its status, every move from it and the bot's pick among the best moves
+    vector<uint16_t> boards = reachableboards();
+    runbench("boardeval/reachable-3x3",boards.size(),[&] {
+        long long s = 0;
+        for(uint16_t board : boards) {
+            const BOARDINFO& info = boardtable.info[board];
+            s += info.status;
+            if(info.status != 0)
+                continue;
+            for(int k=0;k<9;++k) {
+                uint16_t b = board;
+                s += makemove(&b,info.turn,k / 3,k % 3);
+            }
+            s += __builtin_ctz(playtable.info[board].best);
+        }
+        sink = s;
+    });
+
+    // gamestring(): the text of the board as sent to verbose clients (the server takes its strlen to frame it)
+    runbench("gamestring/3,3,3",boards.size(),[&] {
+        long long s = 0;
+        for(uint16_t board : boards)
+            s += strlen(boardtext.text[board]);
+        sink = s;
+    });
+    for(int v=1;v<NVARIANTS;++v) {
+        const VARIANT* var = &variants[v];
+        // 16 boards of a random game of the variant, from empty to its end
+        vector<vector<char>> mnks;
+        vector<char> mem(var->size);
+        var->init(mem.data());
+        for(int p=1,status=0;status == 0;p=3-p) {
+            int cell = var->pick(mem.data(),p,rng() % 2,rng());
+            status = var->play(mem.data(),p,cell / var->n,cell % var->n);
+            mnks.push_back(mem);
+        }
+        while(mnks.size() > 16)
+            mnks.erase(mnks.begin() + rng() % mnks.size());
+        char text[MNKTEXTLEN];
+        runbench(string("gamestring/") + var->name,mnks.size(),[&] {
+            long long s = 0;
+            for(const auto& b : mnks)
+                s += var->text(b.data(),text);
+            sink = s;
+        });
+    }
+
+    // parsemove() on what clients send, and the stringstream parsing it replaced
+    const char* inputs[8] = {"1 2","3 3\n"," 2   1","12 -1","x 1","","2","3 1 extra"};
+    runbench("parsemove",8,[&] {
+        long long s = 0;
+        for(const char* in : inputs) {
+            int r = 0, c = 0;
+            s += parsemove(in,&r,&c) + r + c;
+        }
+        sink = s;
+    });
+    runbench("parsemove/stringstream",8,[&] {
+        long long s = 0;
+        for(const char* in : inputs) {
+            int r = 0, c = 0;
+            stringstream ss(in);
+            s += (bool)(ss >> r >> c) + r + c;
+        }
+        sink = s;
+    });
+
+    // encoding of msgs the way codesend() and sendboard() do it
+    runbench("encode/legacy",64,[&] {
+        char buf[LEGACYLEN];
+        long long s = 0;
+        for(int i=0;i<64;++i) {
+            makelegacy(buf,2,MOVEPROMPT);
+            s += buf[i % LEGACYLEN];
+        }
+        sink = s;
+    });
+    runbench("encode/frame",64,[&] {
+        long long s = 0;
+        for(int i=0;i<64;++i) {
+            FRAMEHDR hdr;
+            const char* dt = boardtext.text[boards[i]];
+            int len = min(strlen(dt),(size_t)MAXPAYLOAD);
+            makehdr(&hdr,T_PRINT,i,len);
+            iovec iov[2] = {{&hdr,sizeof hdr},{(void*)dt,(size_t)len}};
+            s += hdr.len + iov[1].iov_len;
+        }
+        sink = s;
+    });
+    runbench("encode/move",64,[&] {
+        long long s = 0;
+        for(int i=0;i<64;++i) {
+            FRAMEHDR hdr;
+            MOVEUPDATE u = {1,(uint8_t)(i % 3 + 1),(uint8_t)(i / 3 % 3 + 1),0,2};
+            makehdr(&hdr,T_MOVE,i,sizeof u);
+            s += hdr.len + u.r;
+        }
+        sink = s;
+    });
+
+    // the same msgs sent with one sendmsg() each to a socketpair, which is emptied between samples
+    int sv[2];
+    if(socketpair(AF_UNIX,SOCK_STREAM,0,sv) != 0) {
+        perror("ERROR - socketpair failed"); exit(-1);
+    }
+    int sndbuf = 1 << 20;
+    setsockopt(sv[0],SOL_SOCKET,SO_SNDBUF,&sndbuf,sizeof sndbuf);
+    setsockopt(sv[1],SOL_SOCKET,SO_RCVBUF,&sndbuf,sizeof sndbuf);
+    auto empty = [&] { drain(sv[1]); };
+    runbench("codesend/legacy",64,[&] {
+        char buf[LEGACYLEN];
+        long long s = 0;
+        for(int i=0;i<64;++i) {
+            makelegacy(buf,2,MOVEPROMPT);
+            iovec iov = {buf,LEGACYLEN};
+            s += sendvec(sv[0],&iov,1);
+        }
+        sink = s;
+    },empty);
+    runbench("codesend/frame",64,[&] {
+        long long s = 0;
+        for(int i=0;i<64;++i) {
+            FRAMEHDR hdr;
+            const char* dt = boardtext.text[boards[i]];
+            int len = min(strlen(dt),(size_t)MAXPAYLOAD);
+            makehdr(&hdr,T_PRINT,i,len);
+            iovec iov[2] = {{&hdr,sizeof hdr},{(void*)dt,(size_t)len}};
+            s += sendvec(sv[0],iov,2);
+        }
+        sink = s;
+    },empty);
+    runbench("codesend/move",64,[&] {
+        long long s = 0;
+        for(int i=0;i<64;++i) {
+            FRAMEHDR hdr;
+            MOVEUPDATE u = {1,(uint8_t)(i % 3 + 1),(uint8_t)(i / 3 % 3 + 1),0,2};
+            makehdr(&hdr,T_MOVE,i,sizeof u);
+            iovec iov[2] = {{&hdr,sizeof hdr},{&u,sizeof u}};
+            s += sendvec(sv[0],iov,2);
+        }
+        sink = s;
+    },empty);
+    close(sv[0]); close(sv[1]);
+
+    // the logger, with its writer thread writing to a scratch file
+    bool logging = benchlogger(maxthreads,logpath);
+
+    // compare with the baseline
+    int regressions = 0;
+    for(RESULT& r : results) {
+        auto it = base.find(r.name);
+        if(it == base.end() || it->second <= 0)
+            continue;
+        r.base = it->second;
+        r.regressed = r.p50 > r.base * (1 + maxslowdown / 100);
+        if(r.regressed) {
+            fprintf(stderr,"REGRESSION - %s: p50 %.2f ns/op, baseline %.2f ns/op (+%.1f%%)\n",r.name.c_str(),r.p50,r.base,
+                    (r.p50 / r.base - 1) * 100);
+            ++regressions;
+        }
+    }
+    FILE* out = stdout;
+    if(outpath != NULL && (out = fopen(outpath,"w")) == NULL) {
+        perror("ERROR - output file open failed"); exit(-1);
+    }
+    writejson(out);
+    if(out != stdout)
+        fclose(out);
+    if(basepath != NULL)
+        fprintf(stderr,"%d of %zu results regressed by more than %g%%\n",regressions,results.size(),maxslowdown);
+    // the writer thread of the logger never returns. the process ends without running the destructors of the
+    // globals it may still be using
+    fflush(NULL);
+    if(logging)
+        _exit(regressions > 0 ? 1 : 0);
+    return regressions > 0 ? 1 : 0;
+}
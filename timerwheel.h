@@ -0,0 +1,177 @@
+/*
+    timerwheel.h = Hierarchical timing wheel used by the event loops of the TicTacToe server
+    Author = Vikram, CS19B021
+    Purpose = Keeps the deadlines of all the games of an event loop with O(1) arm and cancel.
+              The wheel has no clock of its own. The current time (in ms) is always passed in by
+              the caller, so any clock (real or controlled) can drive it.
+*/
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+#include <bits/stdc++.h>
+#define TWBITS 6                                                        // log2 of num of slots per level
+#define TWSLOTS (1 << TWBITS)                                           // num of slots per level
+#define TWMASK (TWSLOTS - 1)
+#define TWLEVELS 4                                                      // num of levels. the wheel spans 2^24 ms (~4.6 hours)
+
+// structure to represent a timer. timers are intrusive, i.e. they are embedded in the objects that
+// they time and are linked directly into the slot lists of the wheel. data points to the owner.
+struct TIMER {
+    long long expiry;                                                   // time (in ms) at which the timer fires
+    TIMER* prev;                                                        // neighbours in the slot list. prev = NULL -> timer isn't armed
+    TIMER* next;
+    void* data;                                                         // owner of the timer
+};
+
+// structure to represent the wheel. level l has TWSLOTS slots of 2^(l*TWBITS) ms each. a timer is kept in
+// the lowest level whose range covers its distance from cur and moves down (cascades) to lower levels as
+// cur gets close to its expiry. slot lists and the list of expired timers use sentinel heads.
+struct TIMERWHEEL {
+    long long cur;                                                      // next tick (ms) that hasn't been processed yet
+    TIMER slots[TWLEVELS][TWSLOTS];                                     // sentinels of the slot lists
+    TIMER expired;                                                      // sentinel of the list of expired timers not returned yet
+    int count;                                                          // num of armed timers
+};
+
+// function to make list empty
+inline void twlistinit(TIMER* list) {
+    list->prev = list->next = list;
+}
+
+// function to add timer at the end of list
+inline void twlistadd(TIMER* list, TIMER* timer) {
+    timer->prev = list->prev; timer->next = list;
+    list->prev->next = timer; list->prev = timer;
+}
+
+// function to initialize the wheel with the current time = now
+inline void twinit(TIMERWHEEL* wheel, long long now) {
+    wheel->cur = now;
+    wheel->count = 0;
+    for(int l=0;l<TWLEVELS;++l)
+        for(int s=0;s<TWSLOTS;++s)
+            twlistinit(&wheel->slots[l][s]);
+    twlistinit(&wheel->expired);
+}
+
+// function to put an unlinked timer in the slot that matches its expiry
+inline void twplace(TIMERWHEEL* wheel, TIMER* timer) {
+    long long expiry = timer->expiry;
+    long long delta = expiry - wheel->cur;
+    if(delta < 0) {
+        // already expired. it fires at the next processed tick
+        twlistadd(&wheel->slots[0][wheel->cur & TWMASK],timer);
+        return;
+    }
+    int l = 0;
+    while(l < TWLEVELS - 1 && delta >= (1LL << ((l + 1) * TWBITS)))
+        ++l;
+    if(delta >= (1LL << (TWLEVELS * TWBITS))) {
+        // too far away for the wheel. park it in the farthest slot. it is placed again once that slot cascades
+        expiry = wheel->cur + (1LL << (TWLEVELS * TWBITS)) - 1;
+    }
+    twlistadd(&wheel->slots[l][(expiry >> (l * TWBITS)) & TWMASK],timer);
+}
+
+// function to arm timer to fire at expiry. an armed timer is moved to its new expiry
+inline void twadd(TIMERWHEEL* wheel, TIMER* timer, long long expiry) {
+    if(timer->prev != NULL) {
+        timer->prev->next = timer->next; timer->next->prev = timer->prev;
+        --wheel->count;
+    }
+    timer->expiry = expiry;
+    twplace(wheel,timer);
+    ++wheel->count;
+}
+
+// function to disarm timer. disarming a timer that isn't armed does nothing
+inline void twcancel(TIMERWHEEL* wheel, TIMER* timer) {
+    if(timer->prev == NULL)
+        return;
+    timer->prev->next = timer->next; timer->next->prev = timer->prev;
+    timer->prev = timer->next = NULL;
+    --wheel->count;
+}
+
+// function to move all the timers of slot s at level l to lower levels
+inline void twcascade(TIMERWHEEL* wheel, int l, int s) {
+    TIMER list;
+    TIMER* head = &wheel->slots[l][s];
+    if(head->next == head)
+        return;
+    // take the whole slot list over to list and place its timers again
+    list.next = head->next; list.prev = head->prev;
+    list.next->prev = &list; list.prev->next = &list;
+    twlistinit(head);
+    while(list.next != &list) {
+        TIMER* timer = list.next;
+        list.next = timer->next; timer->next->prev = &list;
+        twplace(wheel,timer);
+    }
+}
+
+// function to return the next timer that has expired by now (and disarm it). NULL is returned when
+// no more timers have expired. timers may be armed and cancelled between calls.
+inline TIMER* twexpired(TIMERWHEEL* wheel, long long now) {
+    while(wheel->expired.next == &wheel->expired && wheel->cur <= now && wheel->count > 0) {
+        int s = wheel->cur & TWMASK;
+        // at the start of every rotation of a level, the next slot of the level above comes down
+        for(int l=1;l<TWLEVELS && s == 0;++l) {
+            s = (wheel->cur >> (l * TWBITS)) & TWMASK;
+            twcascade(wheel,l,s);
+        }
+        TIMER* head = &wheel->slots[0][wheel->cur & TWMASK];
+        if(head->next != head) {
+            wheel->expired.next = head->next; wheel->expired.prev = head->prev;
+            head->next->prev = &wheel->expired; head->prev->next = &wheel->expired;
+            twlistinit(head);
+        }
+        ++wheel->cur;
+    }
+    if(wheel->count == 0 && wheel->cur <= now) {
+        // nothing is armed. so, there is nothing to process on the way to now
+        wheel->cur = now + 1;
+    }
+    TIMER* timer = wheel->expired.next;
+    if(timer == &wheel->expired)
+        return NULL;
+    twcancel(wheel,timer);
+    return timer;
+}
+
+// function to call f(timer) for every armed timer of the wheel in no particular order. f must not arm or cancel timers
+template<typename F>
+inline void twforeach(TIMERWHEEL* wheel, F f) {
+    for(int l=0;l<TWLEVELS;++l)
+        for(int s=0;s<TWSLOTS;++s)
+            for(TIMER* t = wheel->slots[l][s].next;t != &wheel->slots[l][s];t = t->next)
+                f(t);
+    for(TIMER* t = wheel->expired.next;t != &wheel->expired;t = t->next)
+        f(t);
+}
+
+// function to return the num of ms from now after which twexpired() should be called again.
+// -1 is returned if no timer is armed. the result may be earlier than the next expiry when the
+// next timer is still in a higher level and has to cascade first
+inline int twtimeout(TIMERWHEEL* wheel, long long now) {
+    if(wheel->expired.next != &wheel->expired)
+        return 0;
+    if(wheel->count == 0)
+        return -1;
+    long long when = LLONG_MAX;
+    for(int l=0;l<TWLEVELS;++l) {
+        // look for the first non-empty slot of level l. a slot comes down (or fires at level 0) when its
+        // range starts, so the slot that holds cur is still pending only if its range starts at cur.
+        long long tick = wheel->cur >> (l * TWBITS);
+        long long first = ((tick << (l * TWBITS)) == wheel->cur) ? tick : tick + 1;
+        for(long long t=first;t < first + TWSLOTS;++t) {
+            TIMER* head = &wheel->slots[l][t & TWMASK];
+            if(head->next != head) {
+                when = std::min(when,t << (l * TWBITS));
+                break;
+            }
+        }
+    }
+    return (int)std::min(std::max(0LL,when - now),(long long)INT_MAX);
+}
+
+#endif
@@ -0,0 +1,278 @@
+/*
+    timerwheeltest.cpp = Test of the timing wheel of the TicTacToe server (see timerwheel.h)
+    Author = Vikram, CS19B021
+    Compilation CMD = g++ timerwheeltest.cpp -o timerwheeltest --std=c++17 -O2
+    Usage = ./timerwheeltest [-n RANDOM OPS] [-s SEED]
+    Purpose = The wheel takes the time from its caller, so the test drives it with a fake clock. First the timeouts
+              of a game are played through: a move that doesn't come within MOVETIMEOUT ends the game with cause 3,
+              and a REPLAY choice that doesn't come within CHTIMEOUT or a KEEP_ALIVE msg that isn't acked within
+              ACKTIMEOUT ends it with cause 4. Timers that are cancelled or moved must never fire at their old time.
+              Then n random arms, re-arms, cancels and clock advances are checked against a reference model (a
+              multimap of expiries). A timer must fire at the first twexpired() call at or after its expiry, except
+              one armed at a time the wheel has already processed (an expiry before cur), which fires at the first
+              call at or after cur, i.e. at most 1 ms late. twtimeout() must never sleep past the next expiry.
+              Every failed check is printed and the exit status is 1 if there was any.
+*/
+#include <bits/stdc++.h>
+#include <unistd.h>
+#include "timerwheel.h"
+#define MOVETIMEOUT 15                                                  // same as in gameserver.cpp
+#define ACKTIMEOUT 2
+#define IDLETIMEOUT 5
+#define CHTIMEOUT 30
+#define RANDOMOPS 200000                                                // default num of random ops
+#define NTIMERS 512                                                     // num of timers of the random test
+using namespace std;
+
+int failures = 0;
+
+#define CHECK(cond) do { if(!(cond)) { ++failures; printf("FAILED line %d: %s\n",__LINE__,#cond); } } while(0)
+
+// states of a game, as in gameserver.cpp
+enum GSTATE { GS_AWAITMOVE, GS_AWAITREPLAY, GS_FINISHED };
+
+// structure to represent the timeouts of a game of gameserver.cpp with one player to check the liveness of
+struct TGAME {
+    TIMER timer;
+    GSTATE state;
+    long long deadline;                                                 // time (in ms) the current wait times out at. 0 -> none
+    long long heardms;                                                  // time (in ms) the player was last heard from
+    long long pingms;                                                   // time (in ms) the last KEEP_ALIVE msg was sent at
+    int ackwait;                                                        // num of KEEP_ALIVE msgs that haven't been acked yet
+    int cause;                                                          // cause the game ended with. 0 -> not ended
+};
+
+// function to get the time the liveness of the player of game must be checked at, like livecheck() of gameserver.cpp
+// for a player who owes no answer. 0 -> never
+long long livecheck(TGAME* game) {
+    if(game->ackwait > 0 && game->heardms <= game->pingms)
+        return game->pingms + ACKTIMEOUT * 1000LL;
+    return game->state == GS_FINISHED ? 0 : game->heardms + IDLETIMEOUT * 1000LL;
+}
+
+// function to arm the timer of game for the earlier of its deadline and its next liveness check, like armgame()
+void armgame(TIMERWHEEL* wheel, TGAME* game) {
+    long long wakeup = game->deadline;
+    long long t = livecheck(game);
+    if(t != 0 && (wakeup == 0 || t < wakeup))
+        wakeup = t;
+    if(wakeup == 0 || game->state == GS_FINISHED)
+        twcancel(wheel,&game->timer);
+    else
+        twadd(wheel,&game->timer,wakeup);
+}
+
+// function to handle the timer of game at now, like gametimeout() and checklive(): an expired move wait is cause 3
+// (movetimeout()), an expired REPLAY wait or an unacked KEEP_ALIVE msg is cause 4 (disconnectgame())
+void gametimeout(TIMERWHEEL* wheel, TGAME* game, long long now) {
+    if(game->deadline != 0 && now >= game->deadline) {
+        game->cause = (game->state == GS_AWAITMOVE) ? 3 : 4;
+        game->state = GS_FINISHED;
+        return;
+    }
+    if(game->ackwait > 0 && game->heardms <= game->pingms) {
+        if(now >= game->pingms + ACKTIMEOUT * 1000LL) {
+            game->cause = 4;
+            game->state = GS_FINISHED;
+            return;
+        }
+    }
+    else if(now >= game->heardms + IDLETIMEOUT * 1000LL) {
+        game->pingms = now;
+        ++game->ackwait;
+    }
+    armgame(wheel,game);
+}
+
+// function to advance the fake clock of wheel to now and handle the timers of the games that fire. returns the num
+// of timers fired
+int runto(TIMERWHEEL* wheel, long long now) {
+    int n = 0;
+    TIMER* timer;
+    while((timer = twexpired(wheel,now)) != NULL) {
+        gametimeout(wheel,(TGAME*)timer->data,now);
+        ++n;
+    }
+    return n;
+}
+
+// function to make a game that waits from now on with the given state and deadline
+void newgame(TIMERWHEEL* wheel, TGAME* game, GSTATE state, int tmout, long long now) {
+    memset(game,0,sizeof *game);
+    game->timer.data = game;
+    game->state = state;
+    game->deadline = now + tmout * 1000LL;
+    game->heardms = now;
+    armgame(wheel,game);
+}
+
+// function to check the timeouts of games
+void testgames() {
+    TIMERWHEEL wheel;
+    long long now = 1000;
+    twinit(&wheel,now);
+
+    // a move that never comes. the player is heard from every 4 s, so no KEEP_ALIVE msg is due
+    TGAME move;
+    newgame(&wheel,&move,GS_AWAITMOVE,MOVETIMEOUT,now);
+    for(long long t=now;t < now + MOVETIMEOUT * 1000LL;t+=4000) {
+        runto(&wheel,t);
+        move.heardms = t;
+        armgame(&wheel,&move);
+    }
+    runto(&wheel,now + MOVETIMEOUT * 1000LL - 1);
+    CHECK(move.cause == 0);
+    runto(&wheel,now + MOVETIMEOUT * 1000LL);
+    CHECK(move.cause == 3);
+    CHECK(wheel.count == 0);
+
+    // a REPLAY choice that never comes, from a player who acks every KEEP_ALIVE msg at once
+    now = wheel.cur + 7;
+    TGAME replay;
+    newgame(&wheel,&replay,GS_AWAITREPLAY,CHTIMEOUT,now);
+    int pings = 0;
+    for(long long t=now;t < now + CHTIMEOUT * 1000LL - 1;++t) {
+        runto(&wheel,t);
+        if(replay.ackwait > 0) {
+            ++pings;
+            --replay.ackwait;
+            replay.heardms = t;
+            armgame(&wheel,&replay);
+        }
+    }
+    CHECK(replay.cause == 0);
+    CHECK(pings == (CHTIMEOUT - 1) / IDLETIMEOUT);
+    runto(&wheel,now + CHTIMEOUT * 1000LL);
+    CHECK(replay.cause == 4);
+
+    // a player who stops acking: a KEEP_ALIVE msg after IDLETIMEOUT and a disconnect ACKTIMEOUT after that, long
+    // before the move wait of its partner runs out
+    now = wheel.cur + 3;
+    TGAME deaf;
+    newgame(&wheel,&deaf,GS_AWAITMOVE,MOVETIMEOUT,now);
+    runto(&wheel,now + IDLETIMEOUT * 1000LL - 1);
+    CHECK(deaf.ackwait == 0);
+    runto(&wheel,now + IDLETIMEOUT * 1000LL);
+    CHECK(deaf.ackwait == 1 && deaf.cause == 0);
+    runto(&wheel,now + (IDLETIMEOUT + ACKTIMEOUT) * 1000LL - 1);
+    CHECK(deaf.cause == 0);
+    runto(&wheel,now + (IDLETIMEOUT + ACKTIMEOUT) * 1000LL);
+    CHECK(deaf.cause == 4);
+
+    // a move that comes in time cancels the wait. the cancelled timer never fires, and neither does the first
+    // timer of a game whose timer was moved later
+    now = wheel.cur;
+    TGAME done, moved;
+    newgame(&wheel,&done,GS_AWAITMOVE,MOVETIMEOUT,now);
+    newgame(&wheel,&moved,GS_AWAITMOVE,1,now);
+    runto(&wheel,now + 500);
+    twcancel(&wheel,&done.timer);
+    twcancel(&wheel,&done.timer);                                       // cancelling twice does nothing
+    moved.deadline = now + 3000; moved.heardms = now + 500;
+    armgame(&wheel,&moved);
+    CHECK(wheel.count == 1);
+    CHECK(runto(&wheel,now + 2999) == 0);
+    CHECK(runto(&wheel,now + 3000) == 1 && moved.cause == 3);
+    CHECK(runto(&wheel,now + 100000) == 0);
+    CHECK(done.cause == 0 && wheel.count == 0);
+    CHECK(twtimeout(&wheel,now + 100000) == -1);
+}
+
+// function to check n random ops on the wheel against a reference model
+void testrandom(int n, unsigned seed) {
+    mt19937_64 rng(seed);
+    TIMERWHEEL wheel;
+    long long now = rng() % 1000000;
+    twinit(&wheel,now);
+    vector<TIMER> timers(NTIMERS);
+    vector<long long> due(NTIMERS,-1);                                  // time the timer must fire at. -1 -> not armed
+    for(int i=0;i<NTIMERS;++i) {
+        timers[i].prev = timers[i].next = NULL;
+        timers[i].data = (void*)(intptr_t)i;
+    }
+    auto randdelay = [&]() -> long long {
+        int k = rng() % 100;
+        if(k < 60) return rng() % 64;                                   // level 0
+        if(k < 85) return rng() % 20000;                                // the timeouts of a game
+        if(k < 99) return rng() % (1 << 24);                            // anywhere in the wheel
+        return (1 << 24) + rng() % (1 << 24);                           // past the wheel
+    };
+    for(int op=0;op<n;++op) {
+        int k = rng() % 100;
+        int i = rng() % NTIMERS;
+        if(k < 40) {
+            // arm or move a timer. an expiry before cur can fire at cur at the earliest
+            long long expiry = now - (long long)(rng() % 3) + randdelay();
+            due[i] = max(expiry,wheel.cur);
+            twadd(&wheel,&timers[i],expiry);
+        }
+        else if(k < 55) {
+            twcancel(&wheel,&timers[i]);
+            due[i] = -1;
+        }
+        else {
+            // advance the clock: mostly a few ms, sometimes to the next expiry or far ahead
+            int t = twtimeout(&wheel,now);
+            long long next = LLONG_MAX;
+            for(long long d : due)
+                if(d != -1)
+                    next = min(next,d);
+            CHECK((t == -1) == (next == LLONG_MAX));
+            if(t != -1 && now + t > next) {
+                ++failures;
+                printf("FAILED op %d: twtimeout() sleeps till %lld past the expiry at %lld\n",op,now + t,next);
+            }
+            int a = rng() % 100;
+            if(a < 80) now += rng() % 8;
+            else if(a < 95 && t != -1) now += t;
+            else now += rng() % 200000;
+            TIMER* timer;
+            while((timer = twexpired(&wheel,now)) != NULL) {
+                int j = (intptr_t)timer->data;
+                if(due[j] == -1 || due[j] > now) {
+                    ++failures;
+                    printf("FAILED op %d: timer %d fired at %lld but is due at %lld\n",op,j,now,due[j]);
+                }
+                due[j] = -1;
+            }
+            for(int j=0;j<NTIMERS;++j) {
+                if(due[j] != -1 && due[j] <= now) {
+                    ++failures;
+                    printf("FAILED op %d: timer %d due at %lld didn't fire by %lld\n",op,j,due[j],now);
+                    twcancel(&wheel,&timers[j]);
+                    due[j] = -1;
+                }
+            }
+        }
+        int armed = 0;
+        for(long long d : due)
+            armed += (d != -1);
+        CHECK(wheel.count == armed);
+        if(failures > 20) {
+            printf("too many failures. stopping\n");
+            return;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    int n = RANDOMOPS;
+    unsigned seed = 1;
+    int opt;
+    while((opt = getopt(argc,argv,"n:s:")) != -1) {
+        if(opt == 'n') n = max(0,atoi(optarg));
+        else if(opt == 's') seed = strtoul(optarg,NULL,10);
+        else {
+            printf("Usage: ./timerwheeltest [-n RANDOM OPS] [-s SEED]\n");
+            return 1;
+        }
+    }
+    testgames();
+    testrandom(n,seed);
+    if(failures != 0) {
+        printf("%d checks failed\n",failures);
+        return 1;
+    }
+    printf("all checks passed (%d random ops, seed %u)\n",n,seed);
+    return 0;
+}
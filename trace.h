@@ -0,0 +1,162 @@
+/*
+    trace.h = Per-game event tracing of the TicTacToe server
+    Author = Vikram, CS19B021
+    Purpose = While tracing is on, every thread notes timestamped events of the games it serves into a ring of its
+              own. The ring holds the last TRACELEN events and has one writer, which fills a slot with relaxed stores
+              and then moves the head on, so an event takes no lock and no allocation (a thread gets its ring on its
+              first event). While tracing is off, an event costs the load of traceon and a branch. The rings are
+              dumped on demand in the Chrome trace event format (chrome://tracing, ui.perfetto.dev). Work done for a
+              game within one call (a recv, a send, a liveness check, a move, handing the game to the logger) is a
+              B/E span on the track of its thread. Waits of a game that outlast the call (the game itself, a move
+              prompt) are async b/e spans with the game id as their id, so a game can be followed across threads.
+              Every event has the game id in its args and a dump may be cut down to one game. Rings of exited
+              threads keep their events and are reused by new threads.
+*/
+#ifndef TRACE_H
+#define TRACE_H
+#include <bits/stdc++.h>
+#define TRACELEN 16384                                                  // num of events a ring holds. must be a power of 2
+#define TRACESLACK 64                                                   // num of the oldest events of a ring left out of a dump, since they may be overwritten meanwhile
+
+// names of events. TR_GAME and TR_WAITMOVE are async spans, TR_KEEPALIVE and TR_ACK are instants and the rest are spans
+enum TRACENAME { TR_RECV, TR_SEND, TR_FLUSH, TR_POLL, TR_CHECKLIVE, TR_MOVE, TR_LOGPUSH, TR_GAME, TR_WAITMOVE,
+                 TR_KEEPALIVE, TR_ACK, TR_NUMNAMES };
+const char* const tracenames[TR_NUMNAMES] = {"recv","send","flush","poll","checklive","move","logpush","game","wait move",
+                                             "keepalive sent","keepalive acked"};
+
+// phases of events, as in the Chrome trace event format
+enum TRACEPHASE { TP_BEGIN = 'B', TP_END = 'E', TP_ASYNCBEGIN = 'b', TP_ASYNCEND = 'e', TP_INSTANT = 'i' };
+
+// structure to represent the ring of a thread. slot i holds the time (in ns, steady clock) of the event and its
+// game id << 32 | name << 8 | phase
+struct TRACERING {
+    std::atomic<uint64_t> head;                                         // num of events noted so far
+    std::atomic<uint64_t> slots[TRACELEN][2];
+    int tid;                                                            // track of the ring in a dump
+    std::string name;                                                   // name of the thread that has the ring. guarded by the registry lock
+};
+
+// structure to represent the rings of all threads
+struct TRACEREGISTRY {
+    std::mutex lock;
+    std::vector<TRACERING*> rings;                                      // every ring ever made
+    std::vector<TRACERING*> free;                                       // rings of exited threads
+};
+
+TRACEREGISTRY traceregistry;
+std::atomic<bool> traceon(false);                                       // true iff events are noted
+
+// structure to represent the ring of the current thread. the ring is freed when the thread exits
+struct TRACEREF {
+    TRACERING* r = NULL;
+    std::string name;                                                   // name of the thread (see tracethread()). "" -> "thread <tid>"
+    ~TRACEREF() {
+        if(r == NULL)
+            return;
+        std::lock_guard<std::mutex> guard(traceregistry.lock);
+        r->name += " (exited)";
+        traceregistry.free.push_back(r);
+    }
+};
+
+inline TRACEREF& mytraceref() {
+    static thread_local TRACEREF ref;
+    return ref;
+}
+
+// function to name the current thread in dumps. it doesn't take a ring, so it costs nothing while tracing is off
+inline void tracethread(const std::string& name) {
+    TRACEREF& ref = mytraceref();
+    ref.name = name;
+    if(ref.r != NULL) {
+        std::lock_guard<std::mutex> guard(traceregistry.lock);
+        ref.r->name = name;
+    }
+}
+
+// function to return the ring of the current thread
+inline TRACERING* mytrace() {
+    TRACEREF& ref = mytraceref();
+    if(ref.r == NULL) {
+        std::lock_guard<std::mutex> guard(traceregistry.lock);
+        if(traceregistry.free.empty()) {
+            ref.r = new TRACERING();
+            ref.r->tid = traceregistry.rings.size() + 1;
+            traceregistry.rings.push_back(ref.r);
+        }
+        else {
+            ref.r = traceregistry.free.back();
+            traceregistry.free.pop_back();
+        }
+        ref.r->name = ref.name.empty() ? "thread " + std::to_string(ref.r->tid) : ref.name;
+    }
+    return ref.r;
+}
+
+// function to note an event of the given name and phase for the game gameid (0 -> no game) in the ring of the
+// current thread
+inline void tracenote(int name, int phase, uint32_t gameid) {
+    TRACERING* r = mytrace();
+    uint64_t h = r->head.load(std::memory_order_relaxed);
+    std::atomic<uint64_t>* slot = r->slots[h & (TRACELEN - 1)];
+    long long ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    slot[0].store(ns,std::memory_order_relaxed);
+    slot[1].store(((uint64_t)gameid << 32) | (name << 8) | phase,std::memory_order_relaxed);
+    r->head.store(h + 1,std::memory_order_release);
+}
+
+// function to note an event if tracing is on
+inline void trace(int name, int phase, uint32_t gameid) {
+    if(__builtin_expect(traceon.load(std::memory_order_relaxed),0))
+        tracenote(name,phase,gameid);
+}
+
+// function to write the events of all rings to out as a Chrome trace (a JSON object). gameid != 0 -> only the
+// events of that game. returns the num of events written
+inline size_t tracedump(std::string& out, uint32_t gameid) {
+    std::lock_guard<std::mutex> guard(traceregistry.lock);
+    out = "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    size_t n = 0;
+    char line[256];
+    for(TRACERING* r : traceregistry.rings) {
+        snprintf(line,sizeof line,"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"",r->tid);
+        out += line;
+        out += r->name + "\"}},\n";
+        // copy the ring. slots overwritten while they were copied belong to events past the second look at head,
+        // so the events that old are left out
+        uint64_t head = r->head.load(std::memory_order_acquire);
+        uint64_t from = head > TRACELEN ? head - TRACELEN : 0;
+        std::vector<std::pair<uint64_t,uint64_t>> evs;
+        evs.reserve(head - from);
+        for(uint64_t i=from;i<head;++i) {
+            std::atomic<uint64_t>* slot = r->slots[i & (TRACELEN - 1)];
+            evs.push_back({slot[0].load(std::memory_order_relaxed),slot[1].load(std::memory_order_relaxed)});
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t now = r->head.load(std::memory_order_relaxed);
+        uint64_t keep = (now + TRACESLACK > TRACELEN) ? now + TRACESLACK - TRACELEN : 0;
+        for(uint64_t i=std::max(from,keep);i<head;++i) {
+            uint64_t ns = evs[i - from].first, w = evs[i - from].second;
+            uint32_t game = w >> 32;
+            int name = (w >> 8) & 0xFF, phase = w & 0xFF;
+            if((gameid != 0 && game != gameid) || name >= TR_NUMNAMES)
+                continue;
+            int len = snprintf(line,sizeof line,"{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu.%03llu,\"pid\":1,\"tid\":%d,",
+                               tracenames[name],phase,(unsigned long long)(ns / 1000),(unsigned long long)(ns % 1000),r->tid);
+            if(phase == TP_ASYNCBEGIN || phase == TP_ASYNCEND)
+                len += snprintf(line + len,sizeof line - len,"\"cat\":\"game\",\"id\":%u,",game);
+            else if(phase == TP_INSTANT)
+                len += snprintf(line + len,sizeof line - len,"\"s\":\"t\",");
+            snprintf(line + len,sizeof line - len,"\"args\":{\"game\":%u}},\n",game);
+            out += line;
+            ++n;
+        }
+    }
+    // JSON has no trailing commas
+    if(!traceregistry.rings.empty())
+        out.erase(out.size() - 2);
+    out += "\n]}\n";
+    return n;
+}
+
+#endif